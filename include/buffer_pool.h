@@ -0,0 +1,66 @@
+#pragma once
+
+#include <vector>
+#include <cstddef>
+#include <cstdint>
+
+// Per-thread pool of byte buffers for file data and codec output.
+//
+// Buffers are std::vector<uint8_t> whose capacity is rounded up to a
+// power-of-two size class (4 KiB .. 64 MiB). Each thread keeps free lists of
+// released buffers per class and serves later requests of the same class
+// from them, so steady-state processing reuses a small working set instead of
+// asking malloc for megabyte blocks on every file. Free lists are never
+// shared, which keeps the hot path lock-free; a buffer released on another
+// thread simply joins that thread's lists. Each thread caches at most
+// POOL_MAX_CACHED bytes and frees the rest.
+
+const size_t POOL_MIN_CLASS_SIZE = 4 * 1024;
+const size_t POOL_MAX_CLASS_SIZE = 64 * 1024 * 1024;
+const size_t POOL_MAX_CACHED = 32 * 1024 * 1024;
+
+struct PoolCache;
+
+// A pooled buffer, returned to the current thread's pool when destroyed. The
+// thread that acquired it must outlive it (every user holds one only for the
+// duration of a task).
+class PooledBuffer {
+public:
+    PooledBuffer() {}
+    // Buffer of size zeroed bytes
+    explicit PooledBuffer(size_t size);
+    ~PooledBuffer() { release(); }
+
+    PooledBuffer(PooledBuffer &&other) noexcept;
+    PooledBuffer &operator=(PooledBuffer &&other);
+    PooledBuffer(const PooledBuffer &) = delete;
+    PooledBuffer &operator=(const PooledBuffer &) = delete;
+
+    // Make room for at least n bytes without reallocating later. Storage that
+    // is too small is swapped for an empty pooled buffer; the contents are
+    // then lost.
+    void reserve(size_t n);
+
+    // Give the storage back to the pool now
+    void release();
+
+    std::vector<uint8_t> &operator*() { return buf_; }
+    std::vector<uint8_t> *operator->() { return &buf_; }
+    const std::vector<uint8_t> &operator*() const { return buf_; }
+    const std::vector<uint8_t> *operator->() const { return &buf_; }
+
+private:
+    std::vector<uint8_t> buf_;
+    PoolCache *owner_ = nullptr; // Pool charged for buf_, null if not pooled
+    size_t charged_ = 0;         // Bytes charged to owner_
+};
+
+// Totals over every thread that used the pool, including exited ones
+struct PoolStats {
+    uint64_t acquired = 0;         // Buffers handed out
+    uint64_t reused = 0;           // ... of which came from a free list
+    uint64_t peak_thread = 0;      // Largest footprint (in use + cached) of one thread
+    uint64_t peak_total = 0;       // Sum of every thread's peak footprint
+};
+
+PoolStats buffer_pool_stats();
@@ -0,0 +1,161 @@
+#pragma once
+
+#include <string>
+#include <vector>
+#include <atomic>
+#include <unordered_map>
+#include <cstddef>
+#include <cstdint>
+#include <pthread.h>
+#include "container.h"
+#include "cli.h"
+
+// Content-defined chunking and the chunk store behind --dedup.
+//
+// Inputs are cut where a Gear rolling hash of the last bytes hits a mask
+// (FastCDC), so an insertion or deletion only moves the boundaries next to it
+// and identical content yields identical chunks wherever it sits in a file.
+// Each distinct chunk is compressed/encrypted once and appended to a store
+// shared by every file of the run and by later runs; the files themselves
+// become containers of references (see container.h).
+//
+// Store layout (integers little-endian):
+//
+//   header  magic "GSEA\x1aS", version, reserved byte, fingerprint length
+//           (16 bits), store id (64 bits), fingerprint, CRC32C of the header
+//   records per chunk: stored length, original length, CRC32C of the original
+//           bytes, 128-bit content hash, CRC32C of these 28 bytes; then the
+//           stored bytes
+//
+// The fingerprint names the stages every chunk in the store shares; for
+// encrypted chunks it ends with a key tag (see make_key_tag()), never a plain
+// hash of the key. The store id is drawn at random when the store is created,
+// so a deleted and recreated store is told apart from the one earlier outputs
+// reference. Records are only ever appended, but chunks of one run
+// are written in parallel into space reserved up front, so an interrupted run
+// can leave holes between complete records. When the store is next opened
+// for writing each record is checked on its own: holes are skipped (the next
+// record is found by its header checksum) and only an incomplete tail is
+// cut off. Encrypted chunks use their file offset in the store as the key
+// position.
+//
+// A run holds an exclusive flock() on the store while writing it, and syncs
+// it before any container referencing its new chunks is moved into place, so
+// a committed container never points at bytes lost in a crash.
+
+// Chunk sizes: smaller chunks find more duplicates, larger ones compress better
+const size_t CDC_MIN_SIZE = 8 * 1024;
+const size_t CDC_AVG_SIZE = 32 * 1024;
+const size_t CDC_MAX_SIZE = 128 * 1024;
+
+const size_t CHUNK_RECORD_HEADER_SIZE = 32;
+
+// Default store path: the output path plus this suffix
+#define CHUNK_STORE_SUFFIX ".gsea-chunks"
+
+// Length of the chunk that starts at data, given len available bytes. Unless
+// the input ends within them, callers pass at least CDC_MAX_SIZE bytes so the
+// boundary does not depend on how the input was buffered.
+size_t cdc_next_boundary(const uint8_t *data, size_t len);
+
+// Identity of a chunk's contents: two chunks with the same key are treated as
+// identical
+struct ChunkKey {
+    uint64_t hash[2] = {0, 0};
+    uint32_t original_len = 0;
+    uint32_t crc = 0;            // CRC32C of the original bytes
+
+    bool operator==(const ChunkKey &o) const {
+        return hash[0] == o.hash[0] && hash[1] == o.hash[1] && original_len == o.original_len && crc == o.crc;
+    }
+};
+
+ChunkKey make_chunk_key(const uint8_t *data, size_t len, uint32_t crc);
+
+// Store being written by a --dedup run. Thread-safe: the index is split into
+// shards with a lock each, and space for new chunks is reserved atomically so
+// their writes run in parallel. A chunk reserved by one thread is only handed
+// to others once its bytes are written.
+class ChunkStore {
+public:
+    ChunkStore();
+    ~ChunkStore();
+
+    // Open and lock the store at path for appending, creating it when
+    // missing, and index the chunks it already holds. Returns false (after
+    // logging) when it cannot be opened, is in use by another run or was
+    // written with another fingerprint or key. key is empty when the chunks
+    // are not encrypted.
+    bool open(const std::string &path, const std::string &fingerprint, const std::string &key);
+
+    // Reference to an already stored chunk with this key. Waits while another
+    // thread is still writing it.
+    bool find(const ChunkKey &key, ChunkRef &ref);
+
+    // Reserve room for a new chunk of stored_len bytes. Returns false when
+    // another thread stored the same chunk meanwhile: ref then names that
+    // copy (once written) and nothing is to be written. Otherwise the caller
+    // must write() the stored bytes to ref.
+    bool reserve(const ChunkKey &key, uint32_t stored_len, ChunkRef &ref);
+    bool write(const ChunkKey &key, const ChunkRef &ref, const uint8_t *stored);
+
+    // Make every chunk written so far durable. Call before committing a
+    // container that references the store; a no-op when nothing was written
+    // since the last sync.
+    bool sync();
+
+    // A failed write leaves a hole that earlier references may point into
+    bool failed() const { return failed_.load(); }
+
+    const std::string &path() const { return path_; }
+    uint64_t id() const { return id_; }
+    uint64_t added_chunks() const { return added_chunks_.load(); }
+    uint64_t added_bytes() const { return added_bytes_.load(); }
+    uint64_t reused_chunks() const { return reused_chunks_.load(); }
+    uint64_t reused_bytes() const { return reused_bytes_.load(); }
+    size_t chunk_count();
+
+private:
+    struct KeyHash {
+        size_t operator()(const ChunkKey &k) const { return static_cast<size_t>(k.hash[0]); }
+    };
+    struct Entry {
+        ChunkRef ref;
+        bool written = false;    // Reserved until its writer is done
+    };
+    struct Shard {
+        pthread_mutex_t mutex;
+        pthread_cond_t written_cv; // An entry was written or dropped
+        std::unordered_map<ChunkKey, Entry, KeyHash> index;
+    };
+    static const size_t SHARDS = 16;
+
+    Shard &shard(const ChunkKey &key) { return shards_[key.hash[1] % SHARDS]; }
+    const Entry *lookup_written(Shard &s, const ChunkKey &key);
+    bool load_records(uint64_t start, uint64_t file_size);
+    uint64_t next_record(uint64_t pos, uint64_t file_size);
+
+    int fd_ = -1;
+    std::string path_;
+    uint64_t id_ = 0;
+    Shard shards_[SHARDS];
+    std::atomic<uint64_t> end_{0};
+    std::atomic<bool> failed_{false};
+    pthread_mutex_t sync_mutex_;
+    std::atomic<uint64_t> writes_{0}; // Chunks written by this run
+    uint64_t synced_ = 0;             // writes_ covered by the last sync
+    std::atomic<uint64_t> added_chunks_{0}, added_bytes_{0}, reused_chunks_{0}, reused_bytes_{0};
+};
+
+// Fingerprint of the settings every chunk of a store shares: stages and
+// algorithms
+std::string chunk_store_fingerprint(const Options &opts);
+
+// Store holding the chunks of the deduplicated container at input: explicit
+// when set, otherwise the first of input, its parent directory and so on up
+// to the root with CHUNK_STORE_SUFFIX appended that exists. Empty when none.
+std::string find_chunk_store(const std::string &input, const std::string &explicit_path);
+
+// Open a store for reading chunks and check its header. Returns -1 (with err
+// set) on failure.
+int open_chunk_store(const std::string &path, std::string &err);
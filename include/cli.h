@@ -1,6 +1,10 @@
 #pragma once
 
 #include <string>
+#include <cstddef>
+#include <cstdint>
+#include "codec.h"
+#include "utils.h"
 
 struct Options {
     bool do_compress = false;
@@ -12,7 +16,22 @@ struct Options {
     std::string input_path;
     std::string output_path;
     std::string key;
+    size_t threads = 0; // Worker pool size; 0 = number of online CPUs
+    std::string io_mode = "mmap"; // I/O backend: "mmap" (falls back to read), "read" or "uring"
+    size_t lz_window = 65536; // Match window of the lz/lzhc codecs: power of two, 1 KiB..64 KiB
+    bool incremental = false; // Skip inputs unchanged since the last run (see manifest.h)
+    std::string manifest_path; // Manifest of --incremental; default <output>.gsea-manifest
+    bool dedup = false; // Store each distinct content-defined chunk once (see chunk_store.h)
+    std::string chunk_store_path; // Chunk store of --dedup; default <output>.gsea-chunks
+    std::string stats_path; // Per-file and aggregate timings/counters report (see stats.h); empty = off
+    std::string stats_format; // "json" or "csv"; default from the extension of stats_path
+    LogLevel log_level = LOG_INFO; // Messages above this level are not logged
+    bool range = false; // Decode only original bytes [range_offset, range_offset + range_length)
+    uint64_t range_offset = 0;
+    uint64_t range_length = 0;
+    Pipeline pipeline; // Codec and cipher objects resolved from the options above
 };
 
-// Parse command line into options. Returns true on success.
+// Parse command line into options and resolve the algorithm names into
+// out.pipeline. Returns true on success.
 bool parse_cli(int argc, char **argv, Options &out);
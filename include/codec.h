@@ -0,0 +1,100 @@
+#pragma once
+
+#include <memory>
+#include <string>
+#include <vector>
+#include <cstddef>
+#include <cstdint>
+
+// Codec registry. Compression codecs and ciphers are objects behind two small
+// interfaces, looked up by name once per run (from the command line) or once
+// per container (from its header). Workers call the resolved objects directly
+// and never compare algorithm names while processing data.
+//
+// Adding an engine takes a class implementing Codec or Cipher and one row in
+// the registry table in codec.cpp.
+
+// Capability flags
+const unsigned CODEC_CHUNKABLE = 1; // Headerless data decodes from any even offset with fresh state
+const unsigned CODEC_IN_PLACE = 2;  // Transforms a buffer in place, output size == input size
+const unsigned CODEC_NEEDS_KEY = 4; // Constructed with a non-empty key
+
+// Decoder position carried from one block of a stream to the next
+struct DecodeState {
+    bool have_last = false;       // diff: last output byte is valid
+    uint8_t last = 0;
+    std::vector<uint8_t> pending; // Framed codecs: bytes of an incomplete frame
+    std::unique_ptr<DecodeState> next; // State of the following stages of a chain
+
+    // No stage is holding back part of a frame
+    bool idle() const {
+        return pending.empty() && (!next || next->idle());
+    }
+};
+
+class Codec {
+public:
+    Codec(const std::string &name, unsigned flags) : name_(name), flags_(flags) {}
+    virtual ~Codec() {}
+
+    // Canonical (lowercase) name, as recorded in containers
+    const std::string &name() const { return name_; }
+    bool has(unsigned flag) const { return (flags_ & flag) != 0; }
+
+    // Compress one block into out. Every block is self-contained, so a
+    // stream is encoded by calling this once per block.
+    virtual void encode(const uint8_t *in, size_t len, std::vector<uint8_t> &out) const = 0;
+
+    // Decompress the next block of a stream into out, continuing from ds.
+    // Returns false on invalid data.
+    virtual bool decode(const uint8_t *in, size_t len, DecodeState &ds, std::vector<uint8_t> &out) const = 0;
+
+private:
+    std::string name_;
+    unsigned flags_;
+};
+
+// Keystream ciphers transform data in place (CODEC_IN_PLACE). key_offset is
+// the position of data[0] in the whole stream, so blocks and chunks can be
+// processed in any order and still line up with the key.
+class Cipher {
+public:
+    Cipher(const std::string &name, unsigned flags) : name_(name), flags_(flags) {}
+    virtual ~Cipher() {}
+
+    const std::string &name() const { return name_; }
+    bool has(unsigned flag) const { return (flags_ & flag) != 0; }
+
+    virtual void encrypt(uint8_t *data, size_t len, uint64_t key_offset) const = 0;
+    virtual void decrypt(uint8_t *data, size_t len, uint64_t key_offset) const = 0;
+
+private:
+    std::string name_;
+    unsigned flags_;
+};
+
+// Stages of one run, resolved once from the command line and shared by every
+// worker
+struct Pipeline {
+    std::shared_ptr<const Codec> codec;   // Set for --compress / --decompress
+    std::shared_ptr<const Cipher> cipher; // Set for --encrypt / --decrypt
+    bool auto_codec = false;              // --comp-alg auto: codec is chosen per file
+};
+
+// Resolve a codec name (case-insensitive): a single codec or a chain of
+// stages joined by '+', applied left to right. lz_window is the match window
+// of lz/lzhc. Returns null with err set for unknown names or invalid chains.
+std::shared_ptr<const Codec> make_codec(const std::string &name, size_t lz_window, std::string &err);
+
+// Resolve a cipher name (case-insensitive) bound to key. Returns null with
+// err set for unknown names or a missing key.
+std::shared_ptr<const Cipher> make_cipher(const std::string &name, const std::string &key, std::string &err);
+
+// Bytes of each file that --comp-alg auto inspects
+const size_t CODEC_SAMPLE_SIZE = 64 * 1024;
+
+// Pick the codec for data represented by sample (at most CODEC_SAMPLE_SIZE
+// bytes): "store" when the bytes look compressed or encrypted already or no
+// candidate saves at least 3%, otherwise the fastest candidate whose
+// trial-encoded size is within 3% of the smallest.
+std::shared_ptr<const Codec> choose_codec(const uint8_t *sample, size_t len, size_t lz_window);
@@ -0,0 +1,90 @@
+#pragma once
+
+#include <string>
+#include <vector>
+#include <cstddef>
+#include <cstdint>
+
+// On-disk layout of files written by compress/encrypt (all integers little-endian):
+//
+//   header  magic "GSEA\x1a\n", version, flags, original size, index offset,
+//           chunk count, algorithm names, CRC32C of the header
+//   data    the stored chunks back to back; each chunk decodes on its own
+//   index   per chunk: stored length, original length, CRC32C of the original
+//           bytes; then CRC32C of the index
+//
+// The header is enough to undo every stage without command-line flags, and
+// the index gives the position of any chunk in both the stored and the
+// original stream.
+//
+// A deduplicated container (--dedup) keeps its chunks in a chunk store shared
+// with other files (see chunk_store.h). Its data section holds one reference
+// per chunk instead: the store offset and stored length of the chunk, which
+// decodes there with the stages named in the header.
+
+const uint8_t CONTAINER_VERSION = 1;
+
+// Header flags: which stages were applied, in the order compress then encrypt
+const uint8_t CONTAINER_COMPRESSED = 1;
+const uint8_t CONTAINER_ENCRYPTED = 2;
+const uint8_t CONTAINER_DEDUP = 4;
+
+// Fixed part (32 bytes) + two names of at most 255 bytes + header CRC
+const size_t CONTAINER_MIN_HEADER = 36;
+const size_t CONTAINER_MAX_HEADER = 32 + 255 + 255 + 4;
+const size_t CONTAINER_INDEX_ENTRY_SIZE = 12;
+const size_t CONTAINER_CHUNK_REF_SIZE = 12;
+
+struct ContainerHeader {
+    uint8_t flags = 0;
+    std::string comp_alg;        // Set when CONTAINER_COMPRESSED
+    std::string enc_alg;         // Set when CONTAINER_ENCRYPTED
+    uint64_t original_size = 0;
+    uint64_t index_offset = 0;   // File offset of the chunk index
+    uint32_t chunk_count = 0;
+};
+
+struct ChunkEntry {
+    uint32_t stored_len = 0;
+    uint32_t original_len = 0;
+    uint32_t crc = 0;            // CRC32C of the original bytes
+    uint64_t stored_offset = 0;  // Derived on load: file offset of the stored bytes
+    uint64_t original_offset = 0;
+};
+
+// Where a chunk of a deduplicated container is kept in the chunk store
+struct ChunkRef {
+    uint64_t offset = 0;         // File offset of the stored bytes in the store
+    uint32_t stored_len = 0;
+};
+
+// Whether buf starts with the container magic.
+bool is_container(const uint8_t *buf, size_t len);
+
+// Size of the serialized header for these algorithm names.
+size_t container_header_size(const ContainerHeader &h);
+
+// Append the serialized header / index to out.
+void serialize_header(const ContainerHeader &h, std::vector<uint8_t> &out);
+void serialize_index(const std::vector<ChunkEntry> &chunks, std::vector<uint8_t> &out);
+
+// Parse and verify a header from the first bytes of a file. header_size
+// receives the offset where the chunk data starts. Returns false (with err set)
+// on a bad magic, unknown version or checksum mismatch.
+bool parse_header(const uint8_t *buf, size_t len, ContainerHeader &h, size_t &header_size, std::string &err);
+
+// Parse and verify the index of h (buf holds exactly the index bytes) and
+// derive the chunk offsets. Checks that the chunks tile the data section and
+// add up to the original size.
+bool parse_index(const uint8_t *buf, size_t len, const ContainerHeader &h, size_t header_size,
+                 std::vector<ChunkEntry> &chunks, std::string &err);
+
+// Append / read one reference of a deduplicated container's data section
+// (CONTAINER_CHUNK_REF_SIZE bytes).
+void serialize_chunk_ref(const ChunkRef &ref, std::vector<uint8_t> &out);
+ChunkRef parse_chunk_ref(const uint8_t *buf);
+
+// Bytes occupied by the index of a container with n chunks.
+inline size_t container_index_size(uint32_t n) {
+    return static_cast<size_t>(n) * CONTAINER_INDEX_ENTRY_SIZE + 4;
+}
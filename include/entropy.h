@@ -0,0 +1,24 @@
+#pragma once
+
+#include <cstddef>
+#include <cstdint>
+
+// Order-0 Huffman entropy coder used as the last stage of a codec chain.
+//
+// Encoded layout:
+//   [code lengths: 256 x 4 bits][stream sizes: 3 x u32 LE][4 bit streams]
+// The input is split into four quarters, each coded as its own bit stream,
+// so the decoder can interleave four independent dependency chains. Codes are
+// canonical and at most HUFFMAN_MAX_BITS long, which keeps the decode table
+// (one entry per HUFFMAN_MAX_BITS-bit prefix) small enough for L1.
+
+const unsigned HUFFMAN_MAX_BITS = 11;
+
+// Encode in[0..len) into out[0..cap). Returns the encoded size, or SIZE_MAX
+// when it would not fit in cap (callers pass cap = len to only accept output
+// that is smaller than the input).
+size_t huffman_encode(const uint8_t *in, size_t len, uint8_t *out, size_t cap);
+
+// Decode exactly raw_len symbols from p[0..len) into out. Returns false on
+// malformed input; never reads past p + len or writes past out + raw_len.
+bool huffman_decode(const uint8_t *p, size_t len, uint8_t *out, size_t raw_len);
@@ -3,11 +3,73 @@
 #include <string>
 #include <vector>
 #include <cstdint>
+#include <sys/types.h>
 
-// List files given an input path (file or directory). For directories, this should
-// traverse recursively and return regular files only.
-std::vector<std::string> list_input_files(const std::string &path);
+// Receives each regular file found by walk_input_files(). Called from the
+// walker threads concurrently, as soon as the file is found.
+typedef void (*FileSink)(const std::string &path, void *ctx);
+
+// Walk an input path (file or directory) with up to threads walker threads,
+// the calling thread included. Directories are traversed recursively and only
+// regular files reach the sink (symlinks are followed); the order is
+// unspecified. Temporaries and sidecars of a run (*.gsea-tmp,
+// *.gsea-manifest, *.gsea-chunks) are never reported, and the directory
+// prune, when given and found inside path, is not entered. Returns false when
+// path itself is not a file or directory.
+bool walk_input_files(const std::string &path, size_t threads, FileSink sink, void *ctx,
+                      const std::string &prune = std::string());
+
+// The whole walk as a sorted list
+std::vector<std::string> list_input_files(const std::string &path, size_t threads = 1,
+                                          const std::string &prune = std::string());
 
 // Read/write entire file into memory. Return true on success.
 bool read_entire_file(const std::string &path, std::vector<uint8_t> &out);
 bool write_entire_file(const std::string &path, const std::vector<uint8_t> &in);
+
+// Read-only view of a whole input file backed by mmap, so codecs read straight
+// from the page cache without copying into a heap buffer.
+struct MappedFile {
+    const uint8_t *data = nullptr;
+    size_t size = 0;
+    bool mapped = false;
+};
+
+// Map a regular file read-only with MADV_SEQUENTIAL. Returns false without
+// logging when the file cannot be mapped, so callers can fall back to read().
+// Zero-length files are reported as unmappable: they are either empty (read()
+// is free) or pseudo-files such as /proc entries whose size is unknown.
+bool map_input_file(const std::string &path, MappedFile &out);
+void unmap_input_file(MappedFile &m);
+
+// Sequential block I/O for streaming pipelines: memory use is bounded by the
+// caller's block size rather than the file size.
+struct InputStream {
+    int fd = -1;
+    std::string path;
+};
+
+// Output is written to a temporary file next to path and renamed into place on
+// commit, so a failed run never leaves a truncated output (and input == output
+// is safe).
+struct OutputStream {
+    int fd = -1;
+    std::string path;
+    std::string tmp_path;
+};
+
+bool open_input_stream(const std::string &path, InputStream &s);
+// Fill buf with up to count bytes; a short count means end of file. Returns -1 on error.
+ssize_t read_block(InputStream &s, uint8_t *buf, size_t count);
+void close_input_stream(InputStream &s);
+
+bool open_output_stream(const std::string &path, OutputStream &s);
+bool write_block(OutputStream &s, const uint8_t *buf, size_t count);
+// Overwrite bytes already written (e.g. a header finalized after the data),
+// without moving the sequential write position.
+bool write_block_at(OutputStream &s, const uint8_t *buf, size_t count, uint64_t offset);
+// Reserve the final output size up front when it is known. Best effort: file
+// systems without fallocate support are left to grow as blocks are written.
+void preallocate_output_stream(OutputStream &s, uint64_t size);
+bool commit_output_stream(OutputStream &s);
+void abort_output_stream(OutputStream &s);
@@ -0,0 +1,76 @@
+#pragma once
+
+#include <string>
+#include <unordered_map>
+#include <cstdint>
+#include <pthread.h>
+#include "cli.h"
+
+// Manifest of an incremental run (--incremental): what each input looked like
+// when it was last processed and which output it produced. An input is
+// skipped when both it and its output still match their entries.
+//
+// On disk it is a text file written atomically at the end of every run:
+//   GSEA-MANIFEST 1 <fingerprint>[ <key tag>]
+//   <size> <mtime_ns> <inode> <hash> <output size> <output mtime_ns> <input>\t<output>
+// one line per input. The fingerprint names the operation and algorithms,
+// and with --dedup the chunk store the outputs reference, so a recreated
+// store reprocesses everything; a manifest written with other settings is
+// ignored. When a cipher stage runs, the key tag (see make_key_tag()) makes
+// a manifest written with another key ignored too. Paths containing a tab or
+// newline are never recorded and always reprocessed.
+
+struct ManifestEntry {
+    uint64_t size = 0;
+    uint64_t mtime_ns = 0;
+    uint64_t inode = 0;
+    uint64_t hash = 0;           // Hash of the input contents, 0 when not hashed
+    std::string output;
+    uint64_t output_size = 0;
+    uint64_t output_mtime_ns = 0;
+};
+
+class Manifest {
+public:
+    Manifest();
+    ~Manifest();
+
+    // Read the previous run's manifest. A missing file starts an empty one;
+    // returns false (after logging) only for a manifest that cannot be read.
+    // key is empty when the outputs do not depend on it.
+    bool load(const std::string &path, const std::string &fingerprint, const std::string &key);
+
+    // Whether input can be skipped because neither it nor output changed
+    // since it was recorded. An input whose size, mtime and inode match is
+    // not read; one with a new mtime or inode but the same size is hashed and
+    // compared when its entry has a hash. A skipped input is carried over to
+    // the new manifest. Thread-safe.
+    bool unchanged(const std::string &input, const std::string &output);
+
+    // Describe input as it is now; false when it cannot be stat'ed. Call
+    // before processing it. The contents are only hashed when the previous
+    // entry has the same size, i.e. when the file may have been touched
+    // without changing: a new or resized file is not read twice. Thread-safe.
+    bool describe_input(const std::string &input, ManifestEntry &e);
+
+    // Record a successfully processed input. Fills in the output fields from
+    // the output file. Thread-safe.
+    void record(const std::string &input, ManifestEntry e);
+
+    // Write the inputs seen in this run (processed or skipped) to the path
+    // given to load(). Inputs that failed or disappeared are left out.
+    bool save();
+
+private:
+    pthread_mutex_t mutex_;
+    std::string path_;
+    std::string fingerprint_;
+    std::string key_;
+    std::string key_tag_;        // Tag of key_ read from or written to the manifest
+    std::unordered_map<std::string, ManifestEntry> previous_;
+    std::unordered_map<std::string, ManifestEntry> current_;
+};
+
+// Fingerprint of the settings that determine an output: operations,
+// algorithms, LZ window and, with --dedup, the id of the chunk store
+std::string manifest_fingerprint(const Options &opts, uint64_t store_id);
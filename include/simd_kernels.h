@@ -0,0 +1,48 @@
+#pragma once
+
+#include <cstddef>
+#include <cstdint>
+
+// Byte-array kernels used by the codecs. Each entry point dispatches once, at
+// first use, to the widest implementation the CPU supports (AVX2, SSE2, or a
+// portable scalar loop), so the binary stays runnable on any x86-64 or non-x86
+// machine.
+
+enum SimdLevel {
+    SIMD_SCALAR = 0,
+    SIMD_SSE2 = 1,
+    SIMD_AVX2 = 2,
+};
+
+// Widest instruction set detected on this CPU (cached after the first call).
+SimdLevel simd_level();
+const char *simd_level_name(SimdLevel level);
+
+// Element-wise in-place operations: dst[i] op= src[i] for i < len.
+// Arithmetic wraps modulo 256.
+void simd_xor_bytes(uint8_t *dst, const uint8_t *src, size_t len);
+void simd_add_bytes(uint8_t *dst, const uint8_t *src, size_t len);
+void simd_sub_bytes(uint8_t *dst, const uint8_t *src, size_t len);
+
+// Number of leading bytes of p[0..len) equal to value (RLE run detection:
+// compares a full vector against a broadcast of value per step).
+size_t simd_match_run(const uint8_t *p, size_t len, uint8_t value);
+
+// Write count copies of value at dst with full-width vector stores. The last
+// store may run past dst + count, so the buffer must have SIMD_FILL_SLACK
+// writable bytes beyond the run.
+const size_t SIMD_FILL_SLACK = 32;
+void simd_fill_run(uint8_t *dst, uint8_t value, size_t count);
+
+// Wraparound delta coding with a +128 bias, so a flat signal encodes as 0x80:
+//   encode: dst[i] = src[i] - src[i-1] + 128   (src[-1] = prev)
+//   decode: dst[i] = dst[i-1] + src[i] - 128   (dst[-1] = prev)
+// All arithmetic is modulo 256, so decode(encode(x)) == x for any input.
+// The decoder is a vector prefix sum and may run in place (dst == src); the
+// encoder requires non-overlapping buffers.
+void simd_delta_encode(uint8_t *dst, const uint8_t *src, size_t len, uint8_t prev);
+void simd_delta_decode(uint8_t *dst, const uint8_t *src, size_t len, uint8_t prev);
+
+// CRC32C (Castagnoli) of p[0..len), continuing from crc (0 to start). Uses the
+// SSE4.2 crc32 instruction when available, a lookup table otherwise.
+uint32_t simd_crc32c(uint32_t crc, const uint8_t *p, size_t len);
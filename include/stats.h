@@ -0,0 +1,149 @@
+#pragma once
+
+#include <string>
+#include <atomic>
+#include <cstdio>
+#include <cstdint>
+#include <pthread.h>
+#include "buffer_pool.h"
+
+// --stats: per-file and aggregate instrumentation written at the end of a run.
+//
+// Work is charged to the file whose StatsScope is active on the calling
+// thread, so chunks of one file stolen by other workers still count towards
+// it. Work outside any file (io_uring submissions of a batch, opening the
+// chunk store) is charged to the run itself. Stage times are summed over the
+// threads that ran the stage and may exceed the file's wall time. Nothing is
+// measured unless stats_enable() was called.
+
+enum StatsStage {
+    STAGE_READ,
+    STAGE_COMPRESS,
+    STAGE_DECOMPRESS,
+    STAGE_ENCRYPT,
+    STAGE_DECRYPT,
+    STAGE_DEDUP,     // Chunk boundaries, content hashes and store lookups
+    STAGE_WRITE,
+    STAGE_COUNT
+};
+
+enum StatsSyscall {
+    SYS_READ,        // read/pread
+    SYS_WRITE,       // write/pwrite
+    SYS_OPEN,
+    SYS_CLOSE,
+    SYS_STAT,        // stat/fstat
+    SYS_MMAP,        // mmap/munmap/madvise
+    SYS_URING,       // io_uring_enter (one call submits many requests)
+    SYS_OTHER,       // rename/unlink/fallocate/fdatasync
+    SYS_COUNT
+};
+
+struct FileStats {
+    std::atomic<uint64_t> stage_wall_ns[STAGE_COUNT] = {};
+    std::atomic<uint64_t> stage_cpu_ns[STAGE_COUNT] = {};
+    std::atomic<uint64_t> syscalls[SYS_COUNT] = {};
+    uint64_t queue_wait_ns = 0;  // Queued until a worker picked the file up
+    uint64_t wall_ns = 0;        // Picked up until done
+    uint64_t bytes_in = 0;
+    uint64_t bytes_out = 0;
+};
+
+// Stats of the file being processed on this thread, else of the run; null
+// when stats are off
+extern thread_local FileStats *tls_file_stats;
+extern FileStats *g_run_stats;
+
+inline FileStats *stats_current() {
+    return tls_file_stats ? tls_file_stats : g_run_stats;
+}
+
+inline void stats_syscall(StatsSyscall kind, uint64_t n = 1) {
+    if (FileStats *s = stats_current()) {
+        s->syscalls[kind].fetch_add(n, std::memory_order_relaxed);
+    }
+}
+
+uint64_t stats_now_ns();
+uint64_t stats_thread_cpu_ns();
+
+// Start charging unattributed work to run
+void stats_enable(FileStats *run);
+
+// Charge work on this thread to stats (null: to the run) until destroyed.
+// Scopes nest: a pool worker waiting on a file's chunks runs some of them
+// itself.
+class StatsScope {
+public:
+    explicit StatsScope(FileStats *stats) : saved_(tls_file_stats) { tls_file_stats = stats; }
+    ~StatsScope() { tls_file_stats = saved_; }
+    StatsScope(const StatsScope&) = delete;
+    StatsScope &operator=(const StatsScope&) = delete;
+private:
+    FileStats *saved_;
+};
+
+// Wall and thread CPU time of one stage, from construction to destruction
+class StageTimer {
+public:
+    explicit StageTimer(StatsStage stage) : stats_(stats_current()), stage_(stage) {
+        if (stats_) {
+            wall_ = stats_now_ns();
+            cpu_ = stats_thread_cpu_ns();
+        }
+    }
+    ~StageTimer() {
+        if (stats_) {
+            stats_->stage_wall_ns[stage_].fetch_add(stats_now_ns() - wall_, std::memory_order_relaxed);
+            stats_->stage_cpu_ns[stage_].fetch_add(stats_thread_cpu_ns() - cpu_, std::memory_order_relaxed);
+        }
+    }
+    StageTimer(const StageTimer&) = delete;
+    StageTimer &operator=(const StageTimer&) = delete;
+private:
+    FileStats *stats_;
+    StatsStage stage_;
+    uint64_t wall_ = 0;
+    uint64_t cpu_ = 0;
+};
+
+// Writes the --stats report: a row per file as it completes, then the run
+// and the totals. Thread-safe.
+class StatsWriter {
+public:
+    StatsWriter();
+    ~StatsWriter();
+
+    // format is "json" or "csv". Returns false (after logging) when path
+    // cannot be created.
+    bool open(const std::string &path, const std::string &format);
+    void add_file(const std::string &input, const std::string &output, bool ok, const FileStats &s);
+    // run holds the unattributed work; the totals include it
+    bool finish(const FileStats &run, uint64_t wall_ns, size_t skipped, const PoolStats &pool);
+
+private:
+    // Plain copy of a FileStats, or a sum of them
+    struct Counts {
+        uint64_t stage_wall_ns[STAGE_COUNT] = {};
+        uint64_t stage_cpu_ns[STAGE_COUNT] = {};
+        uint64_t syscalls[SYS_COUNT] = {};
+        uint64_t queue_wait_ns = 0;
+        uint64_t wall_ns = 0;
+        uint64_t bytes_in = 0;
+        uint64_t bytes_out = 0;
+    };
+
+    static Counts snapshot(const FileStats &s);
+    static void add(Counts &sum, const Counts &c);
+    void write_counts(const Counts &c);
+    void write_csv_field(const std::string &text);
+
+    FILE *file_ = nullptr;
+    std::string path_;
+    bool csv_ = false;
+    bool first_file_ = true;
+    pthread_mutex_t mutex_;
+    Counts total_;
+    size_t files_ = 0;
+    size_t failed_ = 0;
+};
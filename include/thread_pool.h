@@ -0,0 +1,89 @@
+#pragma once
+
+#include <pthread.h>
+#include <atomic>
+#include <cstddef>
+#include <deque>
+#include <vector>
+
+// Task signature matches pthread entry points so worker_entry can be queued as-is.
+typedef void *(*TaskFn)(void *);
+
+// Counts outstanding tasks submitted as a batch (e.g. the chunks of one file).
+struct TaskGroup {
+    std::atomic<size_t> remaining{0};
+    std::atomic<size_t> queued{0};    // Not yet picked up by any thread
+};
+
+struct Task {
+    TaskFn fn = nullptr;
+    void *arg = nullptr;
+    void **result = nullptr; // Optional slot receiving fn's return value
+    TaskGroup *group = nullptr;
+};
+
+// Fixed-size work-stealing pool of pthreads. Each worker owns a deque: it
+// pushes and pops its own work at the back (LIFO, cache-warm) while idle
+// workers steal from the front of other deques (FIFO, oldest/largest work).
+class ThreadPool {
+public:
+    ThreadPool();
+    ~ThreadPool();
+
+    // Spawn up to num_threads workers. Returns the number actually created
+    // (may be lower than requested if pthread_create fails, e.g. EAGAIN).
+    size_t start(size_t num_threads);
+
+    // Queue a task. Called from a pool worker, the task goes to that worker's
+    // own deque; otherwise deques are filled round-robin. The result slot, if
+    // given, is written before the task is counted as finished.
+    void submit(TaskFn fn, void *arg, void **result, TaskGroup *group = nullptr);
+
+    // Block until every task of the group has finished. A pool worker calling
+    // this keeps executing (and stealing) tasks of that group instead of
+    // sleeping, so nested fan-out never deadlocks the pool. It never picks up
+    // unrelated work: a whole-file job run inside another file's wait would
+    // hold its own window of buffers on top of the waiting one's.
+    void wait_group(TaskGroup &group);
+
+    // Block until every submitted task has finished.
+    void wait_idle();
+
+    // Stop accepting work, let workers drain the queues and join them.
+    void shutdown();
+
+    size_t size() const { return threads_.size(); }
+
+private:
+    struct WorkerQueue {
+        pthread_mutex_t mutex;
+        std::deque<Task> tasks;
+    };
+    struct ThreadArg {
+        ThreadPool *pool;
+        size_t index;
+    };
+
+    static void *thread_main(void *arg);
+    bool pop_local(size_t index, Task &out);
+    bool steal(size_t thief, Task &out);
+    bool try_get_task(int index, Task &out);
+    bool take_group_task(size_t index, const TaskGroup &group, Task &out);
+    void dequeued(const Task &t);
+    void run_task(const Task &t);
+
+    std::vector<pthread_t> threads_;
+    std::vector<WorkerQueue*> queues_;
+    std::vector<ThreadArg*> thread_args_;
+    pthread_mutex_t mutex_;   // Protects sleeping/waking only
+    pthread_cond_t work_cv_;  // New work queued
+    pthread_cond_t group_cv_; // A group task was queued or a group finished
+    pthread_cond_t idle_cv_;  // pending_ reached zero
+    std::atomic<size_t> queued_{0};  // Tasks sitting in deques
+    std::atomic<size_t> pending_{0}; // Queued + running
+    std::atomic<size_t> next_queue_{0};
+    bool stopping_ = false;
+};
+
+// Number of online CPUs (at least 1).
+size_t default_thread_count();
@@ -0,0 +1,77 @@
+#pragma once
+
+#include <linux/io_uring.h>
+#include <sys/stat.h>
+#include <cstddef>
+#include <cstdint>
+
+// Minimal io_uring wrapper on the raw syscalls (no liburing dependency).
+// One instance per thread; not thread-safe.
+class IoUring {
+public:
+    IoUring() = default;
+    ~IoUring();
+    IoUring(const IoUring &) = delete;
+    IoUring &operator=(const IoUring &) = delete;
+
+    // Set up a ring with at least `entries` submission slots. Returns false
+    // (errno set, ring not ready()) when io_uring is unavailable, e.g. old
+    // kernel or seccomp.
+    bool init(unsigned entries);
+    bool ready() const { return ring_fd_ >= 0; }
+
+    // Unmap and close the ring. Requests still in flight are cancelled by the
+    // kernel; ready() is false afterwards.
+    void shutdown();
+
+    // Next free submission entry (zeroed), or nullptr when the queue is full.
+    io_uring_sqe *get_sqe();
+
+    // Submit everything queued so far and wait for at least wait_nr
+    // completions. Returns the number submitted or -errno.
+    int submit_and_wait(unsigned wait_nr);
+
+    // Wait for at least wait_nr completions without submitting anything.
+    // Returns 0 or -errno.
+    int wait(unsigned wait_nr);
+
+    // Entries handed out by get_sqe() that the kernel has not taken yet; they
+    // will not complete unless submitted again.
+    unsigned unconsumed() const;
+
+    // Oldest unconsumed completion, or nullptr. Release it with cqe_seen().
+    io_uring_cqe *peek_cqe();
+    void cqe_seen();
+
+    // Request builders. user_data identifies the request in its completion.
+    static void prep_openat(io_uring_sqe *sqe, const char *path, int flags, mode_t mode, uint64_t user_data);
+    static void prep_statx(io_uring_sqe *sqe, const char *path, struct statx *buf, uint64_t user_data);
+    static void prep_read(io_uring_sqe *sqe, int fd, void *buf, unsigned len, uint64_t offset, uint64_t user_data);
+    static void prep_write(io_uring_sqe *sqe, int fd, const void *buf, unsigned len, uint64_t offset, uint64_t user_data);
+    static void prep_close(io_uring_sqe *sqe, int fd, uint64_t user_data);
+
+private:
+    int enter(unsigned to_submit, unsigned wait_nr);
+
+    int ring_fd_ = -1;
+    unsigned sq_entries_ = 0;
+
+    void *sq_ring_ = nullptr;
+    size_t sq_ring_size_ = 0;
+    void *cq_ring_ = nullptr;
+    size_t cq_ring_size_ = 0;
+    io_uring_sqe *sqes_ = nullptr;
+    size_t sqes_size_ = 0;
+
+    unsigned *sq_head_ = nullptr;
+    unsigned *sq_tail_ = nullptr;
+    unsigned *sq_mask_ = nullptr;
+    unsigned *sq_array_ = nullptr;
+    unsigned *cq_head_ = nullptr;
+    unsigned *cq_tail_ = nullptr;
+    unsigned *cq_mask_ = nullptr;
+    io_uring_cqe *cqes_ = nullptr;
+
+    unsigned sqe_tail_ = 0;      // Local tail of entries handed out by get_sqe()
+    unsigned sqe_submitted_ = 0; // Entries already published to the kernel
+};
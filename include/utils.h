@@ -3,6 +3,8 @@
 #include <string>
 #include <cstdarg>
 #include <vector>
+#include <cstdint>
+#include <sys/types.h>
 
 // Basic path utilities
 std::string path_join(const std::string &a, const std::string &b);
@@ -13,8 +15,31 @@ bool create_directory_recursive(const std::string &path);
 // Safe read/write loops
 ssize_t safe_read_loop(int fd, void *buf, size_t count);
 ssize_t safe_write_loop(int fd, const void *buf, size_t count);
+ssize_t safe_pread_loop(int fd, void *buf, size_t count, off_t offset);
+ssize_t safe_pwrite_loop(int fd, const void *buf, size_t count, off_t offset);
 
-// Simple logging (thread-safe)
-void init_logging();
-void log_info(const char *fmt, ...);
-void log_error(const char *fmt, ...);
+// XXH64 of a buffer: fast, 64-bit and well distributed. Not cryptographic.
+uint64_t hash64(const void *data, size_t len, uint64_t seed = 0);
+
+// 64 random bits from the kernel, for salts and identifiers
+uint64_t random_u64();
+
+// Tag recognising a key in a file kept between runs: "<salt>.<tag>" in hex,
+// the tag being hash64 of the key iterated 2^20 times from a random salt. It
+// stores no fast hash of the key, so guesses cannot be checked against it
+// cheaply.
+std::string make_key_tag(const std::string &key);
+bool key_tag_matches(const std::string &tag, const std::string &key);
+
+// Logging (thread-safe). Messages above the level set by init_logging() are
+// dropped; errors and warnings go to stderr, the rest to stdout. Once
+// init_logging() has run, messages are queued without locking and written by
+// a background thread, flushed by shutdown_logging() or at exit.
+enum LogLevel { LOG_ERROR, LOG_WARN, LOG_INFO, LOG_DEBUG };
+bool parse_log_level(const char *name, LogLevel &level);
+void init_logging(LogLevel level = LOG_INFO);
+void shutdown_logging();
+void log_error(const char *fmt, ...) __attribute__((format(printf, 1, 2)));
+void log_warn(const char *fmt, ...) __attribute__((format(printf, 1, 2)));
+void log_info(const char *fmt, ...) __attribute__((format(printf, 1, 2)));
+void log_debug(const char *fmt, ...) __attribute__((format(printf, 1, 2)));
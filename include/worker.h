@@ -4,12 +4,34 @@
 #include <vector>
 #include "cli.h"
 
+class ThreadPool;
+class ChunkStore;
+struct FileStats;
+
 struct WorkerArgs {
     Options opts;
     std::string input_file;
     std::string output_file;
     std::string key;
+    ThreadPool *pool = nullptr; // When set, large files are split into chunks on this pool
+    ChunkStore *store = nullptr; // --dedup: store receiving the distinct chunks of every file
+    FileStats *stats = nullptr;  // --stats: measurements of this file (see stats.h)
 };
 
 // Entry point for pthread
 void *worker_entry(void *arg);
+
+// Group of files handled by one task in --io-mode uring: opens, reads, writes
+// and closes of all files are batched on a per-thread io_uring, while each file
+// is transformed as soon as its data arrives.
+struct WorkerBatch {
+    std::vector<WorkerArgs*> items;
+    void **results = nullptr; // items.size() slots, same convention as worker_entry
+};
+
+// Upper bound on files per batch (keeps in-flight requests within the ring)
+const size_t WORKER_BATCH_MAX_FILES = 32;
+
+// Entry point for a batch task. Falls back to worker_entry per file when
+// io_uring is unavailable or a file is larger than one stream block.
+void *worker_batch_entry(void *arg);
@@ -0,0 +1,176 @@
+#include "buffer_pool.h"
+
+#include <atomic>
+#include <pthread.h>
+
+// Size classes POOL_MIN_CLASS_SIZE << 0 .. POOL_MIN_CLASS_SIZE << (POOL_CLASSES - 1)
+static const int POOL_CLASSES = 15;
+
+// One thread's free lists and counters. Only the owning thread touches the
+// free lists and changes cached; in_use is also changed by threads releasing
+// a buffer this one acquired, and the counters are read by
+// buffer_pool_stats().
+struct PoolCache {
+    std::vector<std::vector<uint8_t>> free[POOL_CLASSES];
+    std::atomic<uint64_t> cached{0}; // Capacity sitting in the free lists
+    std::atomic<uint64_t> in_use{0};
+    std::atomic<uint64_t> peak{0};
+    std::atomic<uint64_t> acquired{0};
+    std::atomic<uint64_t> reused{0};
+
+    PoolCache();
+    ~PoolCache();
+
+    // Footprint is sampled whenever a buffer changes hands
+    void note_footprint() {
+        uint64_t now = in_use.load(std::memory_order_relaxed) + cached.load(std::memory_order_relaxed);
+        uint64_t prev = peak.load(std::memory_order_relaxed);
+        while (now > prev && !peak.compare_exchange_weak(prev, now, std::memory_order_relaxed)) {
+        }
+    }
+};
+
+// Live caches, and the totals of threads that have exited
+static pthread_mutex_t registry_mutex = PTHREAD_MUTEX_INITIALIZER;
+static std::vector<PoolCache*> registry;
+static PoolStats retired;
+
+static void add_stats(PoolStats &s, const PoolCache &c) {
+    uint64_t peak = c.peak.load(std::memory_order_relaxed);
+    s.acquired += c.acquired.load(std::memory_order_relaxed);
+    s.reused += c.reused.load(std::memory_order_relaxed);
+    s.peak_thread = peak > s.peak_thread ? peak : s.peak_thread;
+    s.peak_total += peak;
+}
+
+PoolCache::PoolCache() {
+    pthread_mutex_lock(&registry_mutex);
+    registry.push_back(this);
+    pthread_mutex_unlock(&registry_mutex);
+}
+
+PoolCache::~PoolCache() {
+    pthread_mutex_lock(&registry_mutex);
+    for (size_t i = 0; i < registry.size(); ++i) {
+        if (registry[i] == this) {
+            registry[i] = registry.back();
+            registry.pop_back();
+            break;
+        }
+    }
+    add_stats(retired, *this);
+    pthread_mutex_unlock(&registry_mutex);
+}
+
+static thread_local PoolCache tls_pool;
+
+// Smallest class holding n bytes, or -1 when n is above every class
+static int class_for_request(size_t n) {
+    int c = 0;
+    while (c < POOL_CLASSES && (POOL_MIN_CLASS_SIZE << c) < n) {
+        ++c;
+    }
+    return c < POOL_CLASSES ? c : -1;
+}
+
+// Largest class a buffer of this capacity can serve, or -1 when it is below
+// the smallest class or above the largest
+static int class_for_capacity(size_t cap) {
+    if (cap < POOL_MIN_CLASS_SIZE || cap > POOL_MAX_CLASS_SIZE) {
+        return -1;
+    }
+    int c = 0;
+    while (c + 1 < POOL_CLASSES && (POOL_MIN_CLASS_SIZE << (c + 1)) <= cap) {
+        ++c;
+    }
+    return c;
+}
+
+PooledBuffer::PooledBuffer(size_t size) {
+    reserve(size);
+    buf_.resize(size);
+}
+
+PooledBuffer::PooledBuffer(PooledBuffer &&other) noexcept {
+    buf_.swap(other.buf_);
+    owner_ = other.owner_;
+    charged_ = other.charged_;
+    other.owner_ = nullptr;
+    other.charged_ = 0;
+}
+
+PooledBuffer &PooledBuffer::operator=(PooledBuffer &&other) {
+    if (this != &other) {
+        release();
+        buf_.swap(other.buf_);
+        owner_ = other.owner_;
+        charged_ = other.charged_;
+        other.owner_ = nullptr;
+        other.charged_ = 0;
+    }
+    return *this;
+}
+
+void PooledBuffer::reserve(size_t n) {
+    if (buf_.capacity() >= n) {
+        return;
+    }
+    release();
+
+    PoolCache &pool = tls_pool;
+    pool.acquired.fetch_add(1, std::memory_order_relaxed);
+    int c = class_for_request(n);
+    if (c >= 0 && !pool.free[c].empty()) {
+        buf_.swap(pool.free[c].back());
+        buf_.clear();
+        pool.free[c].pop_back();
+        pool.cached -= buf_.capacity();
+        pool.reused.fetch_add(1, std::memory_order_relaxed);
+    } else {
+        buf_.reserve(c >= 0 ? POOL_MIN_CLASS_SIZE << c : n);
+    }
+    owner_ = &pool;
+    charged_ = buf_.capacity();
+    pool.in_use.fetch_add(charged_, std::memory_order_relaxed);
+    pool.note_footprint();
+}
+
+void PooledBuffer::release() {
+    size_t cap = buf_.capacity();
+    if (owner_) {
+        // Writers may have grown the vector past its reserve: the footprint
+        // covers what it actually held
+        if (cap > charged_) {
+            owner_->in_use.fetch_add(cap - charged_, std::memory_order_relaxed);
+            owner_->note_footprint();
+            charged_ = cap;
+        }
+        owner_->in_use.fetch_sub(charged_, std::memory_order_relaxed);
+        owner_ = nullptr;
+        charged_ = 0;
+    }
+    int c = class_for_capacity(cap);
+    if (c < 0) {
+        std::vector<uint8_t>().swap(buf_);
+        return;
+    }
+    PoolCache &pool = tls_pool;
+    if (pool.cached + cap > POOL_MAX_CACHED) {
+        std::vector<uint8_t>().swap(buf_);
+        return;
+    }
+    pool.free[c].emplace_back();
+    pool.free[c].back().swap(buf_);
+    pool.cached += cap;
+    pool.note_footprint();
+}
+
+PoolStats buffer_pool_stats() {
+    pthread_mutex_lock(&registry_mutex);
+    PoolStats s = retired;
+    for (const PoolCache *c : registry) {
+        add_stats(s, *c);
+    }
+    pthread_mutex_unlock(&registry_mutex);
+    return s;
+}
@@ -0,0 +1,439 @@
+#include "chunk_store.h"
+#include "simd_kernels.h"
+#include "utils.h"
+#include "stats.h"
+
+#include <sys/stat.h>
+#include <sys/file.h>
+#include <fcntl.h>
+#include <unistd.h>
+#include <errno.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+static const uint8_t STORE_MAGIC[6] = {'G', 'S', 'E', 'A', 0x1a, 'S'};
+static const uint8_t STORE_VERSION = 1;
+static const size_t STORE_FINGERPRINT_AT = sizeof(STORE_MAGIC) + 4 + 8;
+static const size_t STORE_MIN_HEADER = STORE_FINGERPRINT_AT + 4;
+
+// FastCDC normalized chunking: a mask two bits stricter than log2 of the
+// average size before it and two bits looser after it pulls chunk sizes
+// towards the average. The mask bits sit at the top of the hash, which
+// depends on the last 64 bytes.
+static const uint64_t CDC_MASK_STRICT = ~0ULL << (64 - 17);
+static const uint64_t CDC_MASK_LOOSE = ~0ULL << (64 - 13);
+
+// Gear table: one random 64-bit value per byte (splitmix64 of a fixed seed,
+// so boundaries never change between builds)
+struct GearTable {
+    uint64_t v[256];
+    GearTable() {
+        uint64_t x = 0x4753454143444331ULL;
+        for (uint64_t &g : v) {
+            x += 0x9E3779B97F4A7C15ULL;
+            uint64_t z = x;
+            z = (z ^ (z >> 30)) * 0xBF58476D1CE4E5B9ULL;
+            z = (z ^ (z >> 27)) * 0x94D049BB133111EBULL;
+            g = z ^ (z >> 31);
+        }
+    }
+};
+static const GearTable GEAR;
+
+static void put_u32(uint8_t *p, uint32_t v) {
+    for (int i = 0; i < 4; ++i) {
+        p[i] = static_cast<uint8_t>(v >> (8 * i));
+    }
+}
+
+static void put_u64(uint8_t *p, uint64_t v) {
+    put_u32(p, static_cast<uint32_t>(v));
+    put_u32(p + 4, static_cast<uint32_t>(v >> 32));
+}
+
+static uint32_t get_u32(const uint8_t *p) {
+    return static_cast<uint32_t>(p[0]) | (static_cast<uint32_t>(p[1]) << 8) |
+           (static_cast<uint32_t>(p[2]) << 16) | (static_cast<uint32_t>(p[3]) << 24);
+}
+
+static uint64_t get_u64(const uint8_t *p) {
+    return static_cast<uint64_t>(get_u32(p)) | (static_cast<uint64_t>(get_u32(p + 4)) << 32);
+}
+
+size_t cdc_next_boundary(const uint8_t *data, size_t len) {
+    if (len <= CDC_MIN_SIZE) {
+        return len;
+    }
+    size_t end = len < CDC_MAX_SIZE ? len : CDC_MAX_SIZE;
+    size_t normal = end < CDC_AVG_SIZE ? end : CDC_AVG_SIZE;
+    uint64_t h = 0;
+    size_t i = CDC_MIN_SIZE;
+    for (; i < normal; ++i) {
+        h = (h << 1) + GEAR.v[data[i]];
+        if (!(h & CDC_MASK_STRICT)) {
+            return i + 1;
+        }
+    }
+    for (; i < end; ++i) {
+        h = (h << 1) + GEAR.v[data[i]];
+        if (!(h & CDC_MASK_LOOSE)) {
+            return i + 1;
+        }
+    }
+    return end;
+}
+
+ChunkKey make_chunk_key(const uint8_t *data, size_t len, uint32_t crc) {
+    ChunkKey key;
+    key.hash[0] = hash64(data, len, 0);
+    key.hash[1] = hash64(data, len, 0x9E3779B97F4A7C15ULL);
+    key.original_len = static_cast<uint32_t>(len);
+    key.crc = crc;
+    return key;
+}
+
+std::string chunk_store_fingerprint(const Options &opts) {
+    return std::string(opts.do_compress ? "c" : "") + (opts.do_encrypt ? "e" : "") + ":" +
+           (opts.do_compress ? opts.comp_alg : "-") + ":" + (opts.do_encrypt ? opts.enc_alg : "-");
+}
+
+// Read and verify the store header of fd. header_size receives the offset of
+// the first record.
+static bool read_store_header(int fd, std::string &fingerprint, uint64_t &id, uint64_t &header_size,
+                              std::string &err) {
+    uint8_t fixed[sizeof(STORE_MAGIC) + 4];
+    ssize_t r = safe_pread_loop(fd, fixed, sizeof(fixed), 0);
+    if (r != static_cast<ssize_t>(sizeof(fixed)) || memcmp(fixed, STORE_MAGIC, sizeof(STORE_MAGIC)) != 0) {
+        err = "not a GSEA chunk store";
+        return false;
+    }
+    if (fixed[6] != STORE_VERSION) {
+        err = "unsupported chunk store version " + std::to_string(fixed[6]);
+        return false;
+    }
+    size_t fp_len = static_cast<size_t>(fixed[8]) | (static_cast<size_t>(fixed[9]) << 8);
+    std::vector<uint8_t> buf(STORE_MIN_HEADER + fp_len);
+    r = safe_pread_loop(fd, buf.data(), buf.size(), 0);
+    if (r != static_cast<ssize_t>(buf.size()) ||
+        simd_crc32c(0, buf.data(), buf.size() - 4) != get_u32(buf.data() + buf.size() - 4)) {
+        err = "chunk store header is damaged";
+        return false;
+    }
+    id = get_u64(buf.data() + sizeof(fixed));
+    fingerprint.assign(reinterpret_cast<const char*>(buf.data() + STORE_FINGERPRINT_AT), fp_len);
+    header_size = buf.size();
+    return true;
+}
+
+ChunkStore::ChunkStore() {
+    for (Shard &s : shards_) {
+        pthread_mutex_init(&s.mutex, nullptr);
+        pthread_cond_init(&s.written_cv, nullptr);
+    }
+    pthread_mutex_init(&sync_mutex_, nullptr);
+}
+
+ChunkStore::~ChunkStore() {
+    if (fd_ >= 0) {
+        close(fd_); // Also releases the lock
+    }
+    for (Shard &s : shards_) {
+        pthread_cond_destroy(&s.written_cv);
+        pthread_mutex_destroy(&s.mutex);
+    }
+    pthread_mutex_destroy(&sync_mutex_);
+}
+
+bool ChunkStore::open(const std::string &path, const std::string &fingerprint, const std::string &key) {
+    path_ = path;
+    fd_ = ::open(path.c_str(), O_RDWR | O_CREAT | O_CLOEXEC, 0644);
+    if (fd_ < 0) {
+        log_error("Failed to open chunk store '%s': %s", path.c_str(), strerror(errno));
+        return false;
+    }
+    // Two runs appending at once would reserve the same offsets
+    if (flock(fd_, LOCK_EX | LOCK_NB) != 0) {
+        if (errno == EWOULDBLOCK) {
+            log_error("Chunk store '%s' is in use by another run", path.c_str());
+        } else {
+            log_error("Failed to lock chunk store '%s': %s", path.c_str(), strerror(errno));
+        }
+        return false;
+    }
+    // Sized under the lock: a run that just finished may have grown it
+    struct stat st;
+    if (fstat(fd_, &st) != 0) {
+        log_error("Failed to open chunk store '%s': %s", path.c_str(), strerror(errno));
+        return false;
+    }
+
+    if (st.st_size == 0) {
+        std::string stored = key.empty() ? fingerprint : fingerprint + " " + make_key_tag(key);
+        id_ = random_u64();
+        std::vector<uint8_t> header(STORE_MIN_HEADER + stored.size());
+        memcpy(header.data(), STORE_MAGIC, sizeof(STORE_MAGIC));
+        header[6] = STORE_VERSION;
+        header[7] = 0; // Reserved
+        header[8] = static_cast<uint8_t>(stored.size());
+        header[9] = static_cast<uint8_t>(stored.size() >> 8);
+        put_u64(header.data() + sizeof(STORE_MAGIC) + 4, id_);
+        memcpy(header.data() + STORE_FINGERPRINT_AT, stored.data(), stored.size());
+        put_u32(header.data() + header.size() - 4, simd_crc32c(0, header.data(), header.size() - 4));
+        if (safe_pwrite_loop(fd_, header.data(), header.size(), 0) != static_cast<ssize_t>(header.size())) {
+            log_error("Failed to write chunk store '%s': %s", path.c_str(), strerror(errno));
+            return false;
+        }
+        end_ = header.size();
+        log_info("Chunk store '%s': created", path.c_str());
+        return true;
+    }
+
+    std::string stored, err;
+    uint64_t header_size = 0;
+    if (!read_store_header(fd_, stored, id_, header_size, err)) {
+        log_error("Chunk store '%s': %s", path.c_str(), err.c_str());
+        return false;
+    }
+    bool same = key.empty() ? stored == fingerprint :
+                stored.compare(0, fingerprint.size() + 1, fingerprint + " ") == 0 &&
+                key_tag_matches(stored.substr(fingerprint.size() + 1), key);
+    if (!same) {
+        // Its chunks are still referenced by earlier outputs, so it is never replaced
+        log_error("Chunk store '%s' was written with other settings; use another --chunk-store", path.c_str());
+        return false;
+    }
+    if (!load_records(header_size, static_cast<uint64_t>(st.st_size))) {
+        return false;
+    }
+    log_info("Chunk store '%s': %zu chunk(s) from earlier runs", path.c_str(), chunk_count());
+    return true;
+}
+
+// Whether rec holds a record header whose stored bytes fit before file_size
+static bool valid_record_header(const uint8_t *rec, uint64_t pos, uint64_t file_size) {
+    return simd_crc32c(0, rec, 28) == get_u32(rec + 28) &&
+           file_size - pos - CHUNK_RECORD_HEADER_SIZE >= get_u32(rec);
+}
+
+// Offset of the first valid record header at or after pos, or file_size when
+// there is none. Only read past a damaged record or a hole.
+uint64_t ChunkStore::next_record(uint64_t pos, uint64_t file_size) {
+    const size_t WINDOW = 1024 * 1024;
+    std::vector<uint8_t> buf(WINDOW);
+    while (file_size - pos >= CHUNK_RECORD_HEADER_SIZE) {
+        size_t want = file_size - pos < WINDOW ? static_cast<size_t>(file_size - pos) : WINDOW;
+        ssize_t r = safe_pread_loop(fd_, buf.data(), want, static_cast<off_t>(pos));
+        if (r < static_cast<ssize_t>(CHUNK_RECORD_HEADER_SIZE)) {
+            break;
+        }
+        size_t last = static_cast<size_t>(r) - CHUNK_RECORD_HEADER_SIZE;
+        for (size_t i = 0; i <= last; ++i) {
+            if (valid_record_header(buf.data() + i, pos + i, file_size)) {
+                return pos + i;
+            }
+        }
+        pos += last + 1;
+    }
+    return file_size;
+}
+
+bool ChunkStore::load_records(uint64_t pos, uint64_t file_size) {
+    uint8_t rec[CHUNK_RECORD_HEADER_SIZE];
+    uint64_t end = pos;     // End of the last valid record
+    uint64_t skipped = 0;   // Bytes of holes between valid records
+    while (file_size - pos >= CHUNK_RECORD_HEADER_SIZE) {
+        ssize_t r = safe_pread_loop(fd_, rec, sizeof(rec), static_cast<off_t>(pos));
+        if (r < 0) {
+            log_error("Failed to read chunk store '%s': %s", path_.c_str(), strerror(errno));
+            return false;
+        }
+        if (r != static_cast<ssize_t>(sizeof(rec)) || !valid_record_header(rec, pos, file_size)) {
+            // A chunk whose write never finished: records after it may still
+            // be complete and referenced by committed containers
+            pos = next_record(pos + 1, file_size);
+            continue;
+        }
+        uint32_t stored_len = get_u32(rec);
+        ChunkKey key;
+        key.original_len = get_u32(rec + 4);
+        key.crc = get_u32(rec + 8);
+        key.hash[0] = get_u64(rec + 12);
+        key.hash[1] = get_u64(rec + 20);
+        Entry e;
+        e.ref.offset = pos + CHUNK_RECORD_HEADER_SIZE;
+        e.ref.stored_len = stored_len;
+        e.written = true;
+        shard(key).index.emplace(key, e);
+        skipped += pos - end;
+        pos = e.ref.offset + stored_len;
+        end = pos;
+    }
+    if (skipped > 0) {
+        log_warn("Chunk store '%s': skipping %llu byte(s) of chunks an interrupted run did not finish",
+                path_.c_str(), static_cast<unsigned long long>(skipped));
+    }
+    if (end != file_size) {
+        log_warn("Chunk store '%s': dropping %llu byte(s) left by an interrupted run", path_.c_str(),
+                static_cast<unsigned long long>(file_size - end));
+        if (ftruncate(fd_, static_cast<off_t>(end)) != 0) {
+            log_error("Failed to truncate chunk store '%s': %s", path_.c_str(), strerror(errno));
+            return false;
+        }
+    }
+    end_ = end;
+    return true;
+}
+
+// Called with the shard locked: the entry of key once it is written, or null
+// when there is none (or its write failed)
+const ChunkStore::Entry *ChunkStore::lookup_written(Shard &s, const ChunkKey &key) {
+    for (;;) {
+        auto it = s.index.find(key);
+        if (it == s.index.end()) {
+            return nullptr;
+        }
+        if (it->second.written) {
+            return &it->second;
+        }
+        pthread_cond_wait(&s.written_cv, &s.mutex);
+    }
+}
+
+bool ChunkStore::find(const ChunkKey &key, ChunkRef &ref) {
+    Shard &s = shard(key);
+    pthread_mutex_lock(&s.mutex);
+    const Entry *e = lookup_written(s, key);
+    if (e) {
+        ref = e->ref;
+    }
+    pthread_mutex_unlock(&s.mutex);
+    if (e) {
+        reused_chunks_++;
+        reused_bytes_ += key.original_len;
+    }
+    return e != nullptr;
+}
+
+bool ChunkStore::reserve(const ChunkKey &key, uint32_t stored_len, ChunkRef &ref) {
+    Shard &s = shard(key);
+    pthread_mutex_lock(&s.mutex);
+    const Entry *e = lookup_written(s, key);
+    if (!e) {
+        Entry fresh;
+        fresh.ref.offset = end_.fetch_add(CHUNK_RECORD_HEADER_SIZE + stored_len) + CHUNK_RECORD_HEADER_SIZE;
+        fresh.ref.stored_len = stored_len;
+        s.index.emplace(key, fresh);
+        ref = fresh.ref;
+    } else {
+        ref = e->ref;
+    }
+    pthread_mutex_unlock(&s.mutex);
+    if (e) {
+        reused_chunks_++;
+        reused_bytes_ += key.original_len;
+    }
+    return e == nullptr;
+}
+
+bool ChunkStore::write(const ChunkKey &key, const ChunkRef &ref, const uint8_t *stored) {
+    uint8_t rec[CHUNK_RECORD_HEADER_SIZE];
+    put_u32(rec, ref.stored_len);
+    put_u32(rec + 4, key.original_len);
+    put_u32(rec + 8, key.crc);
+    put_u64(rec + 12, key.hash[0]);
+    put_u64(rec + 20, key.hash[1]);
+    put_u32(rec + 28, simd_crc32c(0, rec, 28));
+    off_t at = static_cast<off_t>(ref.offset - CHUNK_RECORD_HEADER_SIZE);
+    bool ok = safe_pwrite_loop(fd_, rec, sizeof(rec), at) == static_cast<ssize_t>(sizeof(rec)) &&
+              safe_pwrite_loop(fd_, stored, ref.stored_len, static_cast<off_t>(ref.offset)) ==
+                  static_cast<ssize_t>(ref.stored_len);
+    if (!ok) {
+        log_error("Failed to write chunk store '%s': %s", path_.c_str(), strerror(errno));
+        failed_ = true;
+    } else {
+        writes_++;
+    }
+
+    // Hand the chunk to threads waiting for it; a failed one is dropped so
+    // they store their own copy
+    Shard &s = shard(key);
+    pthread_mutex_lock(&s.mutex);
+    if (ok) {
+        s.index[key].written = true;
+    } else {
+        s.index.erase(key);
+    }
+    pthread_cond_broadcast(&s.written_cv);
+    pthread_mutex_unlock(&s.mutex);
+    if (ok) {
+        added_chunks_++;
+        added_bytes_ += ref.stored_len;
+    }
+    return ok;
+}
+
+bool ChunkStore::sync() {
+    uint64_t target = writes_.load();
+    pthread_mutex_lock(&sync_mutex_);
+    bool ok = true;
+    if (synced_ < target) {
+        stats_syscall(SYS_OTHER);
+        ok = fdatasync(fd_) == 0;
+        if (ok) {
+            synced_ = target;
+        } else {
+            log_error("Failed to sync chunk store '%s': %s", path_.c_str(), strerror(errno));
+            failed_ = true;
+        }
+    }
+    pthread_mutex_unlock(&sync_mutex_);
+    return ok;
+}
+
+size_t ChunkStore::chunk_count() {
+    size_t n = 0;
+    for (Shard &s : shards_) {
+        pthread_mutex_lock(&s.mutex);
+        n += s.index.size();
+        pthread_mutex_unlock(&s.mutex);
+    }
+    return n;
+}
+
+std::string find_chunk_store(const std::string &input, const std::string &explicit_path) {
+    if (!explicit_path.empty()) {
+        return explicit_path;
+    }
+    // Walk up from the absolute path, so a relative input finds the store
+    // next to a parent of the current directory too
+    char *real = realpath(input.c_str(), nullptr);
+    std::string p = real ? real : input;
+    free(real);
+    while (!p.empty()) {
+        std::string candidate = p + CHUNK_STORE_SUFFIX;
+        if (access(candidate.c_str(), F_OK) == 0) {
+            return candidate;
+        }
+        size_t slash = p.find_last_of('/');
+        p = slash == std::string::npos || p == "/" ? std::string() : p.substr(0, slash == 0 ? 1 : slash);
+    }
+    return "";
+}
+
+int open_chunk_store(const std::string &path, std::string &err) {
+    stats_syscall(SYS_OPEN);
+    int fd = ::open(path.c_str(), O_RDONLY | O_CLOEXEC);
+    if (fd < 0) {
+        err = strerror(errno);
+        return -1;
+    }
+    std::string fingerprint;
+    uint64_t id = 0, header_size = 0;
+    if (!read_store_header(fd, fingerprint, id, header_size, err)) {
+        stats_syscall(SYS_CLOSE);
+        close(fd);
+        return -1;
+    }
+    return fd;
+}
@@ -1,7 +1,37 @@
 #include "cli.h"
+#include "chunk_store.h"
 
 #include <getopt.h>
 #include <iostream>
+#include <cstdlib>
+#include <strings.h>
+#include <ctype.h>
+#include <errno.h>
+
+// Path with trailing slashes removed, plus suffix
+static std::string sidecar_path(const std::string &path, const char *suffix) {
+    std::string base = path;
+    while (base.size() > 1 && base.back() == '/') {
+        base.pop_back();
+    }
+    return base + suffix;
+}
+
+// "OFFSET:LEN", both decimal byte counts; LEN must be positive
+static bool parse_range(const char *arg, uint64_t &offset, uint64_t &length) {
+    char *end = nullptr;
+    if (!isdigit(static_cast<unsigned char>(arg[0]))) {
+        return false;
+    }
+    errno = 0;
+    offset = strtoull(arg, &end, 10);
+    if (errno != 0 || *end != ':' || !isdigit(static_cast<unsigned char>(end[1]))) {
+        return false;
+    }
+    const char *len = end + 1;
+    length = strtoull(len, &end, 10);
+    return errno == 0 && *end == '\0' && length > 0;
+}
 
 // Minimal parse implementation using getopt_long. This is a skeleton — extend as needed.
 bool parse_cli(int argc, char **argv, Options &out) {
@@ -15,12 +45,23 @@ bool parse_cli(int argc, char **argv, Options &out) {
         {"key", required_argument, nullptr, 'k'},
         {"comp-alg", required_argument, nullptr, 'a'},
         {"enc-alg", required_argument, nullptr, 'b'},
+        {"threads", required_argument, nullptr, 't'},
+        {"io-mode", required_argument, nullptr, 'm'},
+        {"lz-window", required_argument, nullptr, 'w'},
+        {"incremental", no_argument, nullptr, 'I'},
+        {"manifest", required_argument, nullptr, 'M'},
+        {"dedup", no_argument, nullptr, 'D'},
+        {"chunk-store", required_argument, nullptr, 'S'},
+        {"stats", required_argument, nullptr, 'j'},
+        {"stats-format", required_argument, nullptr, 'J'},
+        {"log-level", required_argument, nullptr, 'L'},
+        {"range", required_argument, nullptr, 'R'},
         {0,0,0,0}
     };
 
     int opt;
     int opt_index = 0;
-    while ((opt = getopt_long(argc, argv, "cderi:o:k:a:b:", long_options, &opt_index)) != -1) {
+    while ((opt = getopt_long(argc, argv, "cderi:o:k:a:b:t:m:w:IM:DS:j:J:L:R:", long_options, &opt_index)) != -1) {
         switch (opt) {
             case 'c': out.do_compress = true; break;
             case 'd': out.do_decompress = true; break;
@@ -31,6 +72,58 @@ bool parse_cli(int argc, char **argv, Options &out) {
             case 'k': out.key = optarg; break;
             case 'a': out.comp_alg = optarg; break;
             case 'b': out.enc_alg = optarg; break;
+            case 't': {
+                char *end = nullptr;
+                long n = strtol(optarg, &end, 10);
+                if (end == optarg || *end != '\0' || n <= 0) {
+                    std::cerr << "--threads requires a positive integer\n";
+                    return false;
+                }
+                out.threads = static_cast<size_t>(n);
+                break;
+            }
+            case 'm':
+                out.io_mode = optarg;
+                if (out.io_mode != "mmap" && out.io_mode != "read" && out.io_mode != "uring") {
+                    std::cerr << "Unknown I/O mode '" << out.io_mode << "'. Supported: mmap, read, uring\n";
+                    return false;
+                }
+                break;
+            case 'w': {
+                char *end = nullptr;
+                long n = strtol(optarg, &end, 10);
+                if (end == optarg || *end != '\0' || n < 1024 || n > 65536 || (n & (n - 1)) != 0) {
+                    std::cerr << "--lz-window requires a power of two between 1024 and 65536\n";
+                    return false;
+                }
+                out.lz_window = static_cast<size_t>(n);
+                break;
+            }
+            case 'I': out.incremental = true; break;
+            case 'M': out.incremental = true; out.manifest_path = optarg; break;
+            case 'D': out.dedup = true; break;
+            case 'S': out.chunk_store_path = optarg; break;
+            case 'j': out.stats_path = optarg; break;
+            case 'J':
+                out.stats_format = optarg;
+                if (out.stats_format != "json" && out.stats_format != "csv") {
+                    std::cerr << "Unknown stats format '" << out.stats_format << "'. Supported: json, csv\n";
+                    return false;
+                }
+                break;
+            case 'L':
+                if (!parse_log_level(optarg, out.log_level)) {
+                    std::cerr << "Unknown log level '" << optarg << "'. Supported: error, warn, info, debug\n";
+                    return false;
+                }
+                break;
+            case 'R':
+                if (!parse_range(optarg, out.range_offset, out.range_length)) {
+                    std::cerr << "--range requires OFFSET:LEN in bytes\n";
+                    return false;
+                }
+                out.range = true;
+                break;
             default:
                 std::cerr << "Unknown option\n";
                 return false;
@@ -42,5 +135,59 @@ bool parse_cli(int argc, char **argv, Options &out) {
         std::cerr << "input path required\n";
         return false;
     }
+
+    // The manifest and the chunk store sit next to the output, not inside it,
+    // so they are never taken as inputs by a later run over the output directory
+    if (out.incremental && out.manifest_path.empty()) {
+        out.manifest_path = sidecar_path(out.output_path, ".gsea-manifest");
+    }
+    bool encoding = out.do_compress || (out.do_encrypt && !out.do_decompress);
+    if (out.dedup && !encoding) {
+        std::cerr << "--dedup applies to compress/encrypt; decoding finds the chunk store on its own\n";
+        return false;
+    }
+    if (out.dedup && out.do_compress && strcasecmp(out.comp_alg.c_str(), "auto") == 0) {
+        // Chunks are shared between files, so they cannot each pick a codec
+        std::cerr << "--dedup needs a fixed --comp-alg, not auto\n";
+        return false;
+    }
+    if (out.range && (encoding || (!out.do_decompress && !out.do_decrypt))) {
+        std::cerr << "--range applies to decompress/decrypt\n";
+        return false;
+    }
+    if (out.dedup && out.chunk_store_path.empty()) {
+        out.chunk_store_path = sidecar_path(out.output_path, CHUNK_STORE_SUFFIX);
+    }
+
+    if (out.stats_format.empty()) {
+        size_t n = out.stats_path.size();
+        bool csv = n >= 4 && strcasecmp(out.stats_path.c_str() + n - 4, ".csv") == 0;
+        out.stats_format = csv ? "csv" : "json";
+    }
+
+    // Resolve the algorithms once; workers share the resulting objects
+    std::string err;
+    if ((out.do_compress || out.do_decompress) && strcasecmp(out.comp_alg.c_str(), "auto") == 0) {
+        // Each worker picks the codec of its file (see choose_codec)
+        out.comp_alg = "auto";
+        out.pipeline.auto_codec = true;
+    } else if (out.do_compress || out.do_decompress) {
+        out.comp_alg = out.comp_alg.empty() ? "rle" : out.comp_alg;
+        out.pipeline.codec = make_codec(out.comp_alg, out.lz_window, err);
+        if (!out.pipeline.codec) {
+            std::cerr << err << "\n";
+            return false;
+        }
+        out.comp_alg = out.pipeline.codec->name();
+    }
+    if (out.do_encrypt || out.do_decrypt) {
+        out.enc_alg = out.enc_alg.empty() ? "vigenere" : out.enc_alg;
+        out.pipeline.cipher = make_cipher(out.enc_alg, out.key, err);
+        if (!out.pipeline.cipher) {
+            std::cerr << err << "\n";
+            return false;
+        }
+        out.enc_alg = out.pipeline.cipher->name();
+    }
     return true;
 }
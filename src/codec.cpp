@@ -0,0 +1,950 @@
+#include "codec.h"
+#include "entropy.h"
+#include "buffer_pool.h"
+#include "simd_kernels.h"
+#include "utils.h"
+
+#include <cmath>
+#include <string.h>
+
+// RLE Compression: encode sequences as [count][byte] pairs
+// Handles runs > 255 by splitting into multiple runs
+// Runs never cross the end of the buffer, so independently compressed chunks
+// concatenate into a valid stream.
+static void compress_rle(const uint8_t *in, size_t len, std::vector<uint8_t> &out) {
+    out.clear();
+    if (len == 0) {
+        return;
+    }
+    
+    // Worst case is one pair per input byte; write through a raw pointer and
+    // trim once at the end instead of growing with push_back
+    out.resize(2 * len);
+    uint8_t *o = out.data();
+    
+    size_t i = 0;
+    while (i < len) {
+        uint8_t value = in[i];
+        size_t run = 1;
+        // Most text runs are a single byte: only pay for a vector compare when
+        // the next byte repeats, then skip whole vectors of the run at once
+        if (i + 1 < len && in[i + 1] == value) {
+            run = 2 + simd_match_run(in + i + 2, len - i - 2, value);
+        }
+        i += run;
+        
+        while (run > 255) {
+            *o++ = 255;
+            *o++ = value;
+            run -= 255;
+        }
+        *o++ = static_cast<uint8_t>(run);
+        *o++ = value;
+    }
+    
+    out.resize(static_cast<size_t>(o - out.data()));
+}
+
+// RLE Decompression: read [count][byte] pairs and expand
+// Any split at an even offset decodes independently.
+static bool decompress_rle(const uint8_t *in, size_t len, std::vector<uint8_t> &out) {
+    out.clear();
+    if (len == 0) {
+        return true;
+    }
+    
+    // RLE format requires pairs, so input must be even length
+    if (len % 2 != 0) {
+        log_error("Invalid RLE data: odd number of bytes");
+        return false;
+    }
+    
+    // Exact output size is the sum of the counts; one cheap pass avoids any
+    // reallocation while expanding
+    size_t total = 0;
+    for (size_t i = 0; i < len; i += 2) {
+        total += in[i];
+    }
+    
+    // Runs are expanded with full-width vector stores that may overshoot
+    out.resize(total + SIMD_FILL_SLACK);
+    uint8_t *o = out.data();
+    for (size_t i = 0; i < len; i += 2) {
+        uint8_t count = in[i];
+        uint8_t value = in[i + 1];
+        
+        // Expand: write 'count' copies of 'value'
+        simd_fill_run(o, value, count);
+        o += count;
+    }
+    
+    out.resize(total);
+    return total > 0; // Encoders never emit zero counts
+}
+
+// Framed codecs (rle2, lz, lzhc) never expand incompressible data.
+// The stream is a sequence of self-delimiting frames, one per compressed
+// buffer:
+//   [mode:1][raw_len:4 LE][payload_len:4 LE][payload]
+// mode FRAME_STORED carries the input verbatim, so a frame is never larger
+// than its input plus the 9-byte header; FRAME_PACKED carries codec tokens.
+static const uint8_t FRAME_STORED = 0;
+static const uint8_t FRAME_PACKED = 1;
+static const size_t FRAME_HEADER_SIZE = 9;
+// Guards allocations against corrupt headers; frames are at most one chunk
+static const uint32_t FRAME_MAX_RAW = 64 * 1024 * 1024;
+
+static void put_u32le(uint8_t *p, uint32_t v) {
+    p[0] = static_cast<uint8_t>(v);
+    p[1] = static_cast<uint8_t>(v >> 8);
+    p[2] = static_cast<uint8_t>(v >> 16);
+    p[3] = static_cast<uint8_t>(v >> 24);
+}
+
+static uint32_t get_u32le(const uint8_t *p) {
+    return static_cast<uint32_t>(p[0]) | (static_cast<uint32_t>(p[1]) << 8) |
+           (static_cast<uint32_t>(p[2]) << 16) | (static_cast<uint32_t>(p[3]) << 24);
+}
+
+// Complete a frame whose payload was packed at out + FRAME_HEADER_SIZE.
+// A payload that is not smaller than the input (or a packer that gave up,
+// payload_len == SIZE_MAX) is replaced by the input itself.
+static void finish_frame(std::vector<uint8_t> &out, const uint8_t *in, size_t len, size_t payload_len) {
+    if (payload_len >= len) {
+        out.resize(FRAME_HEADER_SIZE + len);
+        out[0] = FRAME_STORED;
+        memcpy(out.data() + FRAME_HEADER_SIZE, in, len);
+        payload_len = len;
+    } else {
+        out[0] = FRAME_PACKED;
+    }
+    put_u32le(out.data() + 1, static_cast<uint32_t>(len));
+    put_u32le(out.data() + 5, static_cast<uint32_t>(payload_len));
+    out.resize(FRAME_HEADER_SIZE + payload_len);
+}
+
+// Decodes one complete packed payload, appending exactly raw_len bytes to out
+typedef bool (*UnpackFn)(const uint8_t *p, size_t len, uint32_t raw_len, std::vector<uint8_t> &out);
+
+// Frames may straddle block boundaries when streaming: bytes of an incomplete
+// trailing frame are kept in pending for the next call. Instantiated per
+// codec, so the payload decoder is called directly.
+template <UnpackFn Unpack>
+static bool decompress_frames(const char *codec, const uint8_t *in, size_t len,
+                              std::vector<uint8_t> &pending, std::vector<uint8_t> &out) {
+    const uint8_t *p = in;
+    size_t avail = len;
+    if (!pending.empty()) {
+        pending.insert(pending.end(), in, in + len);
+        p = pending.data();
+        avail = pending.size();
+    }
+    
+    size_t pos = 0;
+    while (avail - pos >= FRAME_HEADER_SIZE) {
+        uint8_t mode = p[pos];
+        uint32_t raw_len = get_u32le(p + pos + 1);
+        uint32_t payload_len = get_u32le(p + pos + 5);
+        if ((mode != FRAME_STORED && mode != FRAME_PACKED) || raw_len > FRAME_MAX_RAW ||
+            (mode == FRAME_STORED && payload_len != raw_len) || payload_len > raw_len) {
+            log_error("Invalid %s data: corrupt frame header", codec);
+            return false;
+        }
+        if (avail - pos - FRAME_HEADER_SIZE < payload_len) {
+            break; // Frame continues in the next block
+        }
+        const uint8_t *payload = p + pos + FRAME_HEADER_SIZE;
+        if (mode == FRAME_STORED) {
+            out.insert(out.end(), payload, payload + payload_len);
+        } else if (!Unpack(payload, payload_len, raw_len, out)) {
+            log_error("Invalid %s data: corrupt frame payload", codec);
+            return false;
+        }
+        pos += FRAME_HEADER_SIZE + payload_len;
+    }
+    
+    // Keep the incomplete tail, reusing pending's storage
+    if (p == pending.data()) {
+        pending.erase(pending.begin(), pending.begin() + pos);
+    } else {
+        pending.assign(p + pos, p + avail);
+    }
+    return true;
+}
+
+// RLE2: escape-based RLE in frames. Packed tokens:
+//   0..127   literal run: the next (h + 1) bytes are copied as-is
+//   128..255 repeat run: the next byte is repeated (h - 125) times (3..130)
+static const size_t RLE2_MAX_LITERAL = 128;
+static const size_t RLE2_MIN_REPEAT = 3;
+static const size_t RLE2_MAX_REPEAT = 130;
+
+static void compress_rle2(const uint8_t *in, size_t len, std::vector<uint8_t> &out) {
+    out.clear();
+    if (len == 0) {
+        return;
+    }
+    
+    // Packed tokens cost at most one header byte per 128 literals; anything
+    // beyond the stored size is abandoned in favour of a stored frame
+    out.resize(FRAME_HEADER_SIZE + len + len / RLE2_MAX_LITERAL + 1);
+    uint8_t *payload = out.data() + FRAME_HEADER_SIZE;
+    uint8_t *o = payload;
+    uint8_t *limit = payload + len;
+    
+    size_t i = 0;
+    size_t lit_start = 0;
+    while (i < len && o < limit) {
+        uint8_t value = in[i];
+        size_t run = 1;
+        if (i + 1 < len && in[i + 1] == value) {
+            run = 2 + simd_match_run(in + i + 2, len - i - 2, value);
+        }
+        if (run < RLE2_MIN_REPEAT) {
+            i += run;
+            continue;
+        }
+        
+        // Flush pending literals, then the repeat run in pieces of 130
+        while (lit_start < i) {
+            size_t n = i - lit_start < RLE2_MAX_LITERAL ? i - lit_start : RLE2_MAX_LITERAL;
+            *o++ = static_cast<uint8_t>(n - 1);
+            memcpy(o, in + lit_start, n);
+            o += n;
+            lit_start += n;
+        }
+        i += run;
+        while (run >= RLE2_MIN_REPEAT) {
+            size_t n = run < RLE2_MAX_REPEAT ? run : RLE2_MAX_REPEAT;
+            *o++ = static_cast<uint8_t>(n + 125);
+            *o++ = value;
+            run -= n;
+        }
+        // A leftover of 1-2 bytes joins the next literal run
+        lit_start = i - run;
+    }
+    while (lit_start < len && o < limit) {
+        size_t n = len - lit_start < RLE2_MAX_LITERAL ? len - lit_start : RLE2_MAX_LITERAL;
+        *o++ = static_cast<uint8_t>(n - 1);
+        memcpy(o, in + lit_start, n);
+        o += n;
+        lit_start += n;
+    }
+    
+    finish_frame(out, in, len, static_cast<size_t>(o - payload));
+}
+
+static bool decode_rle2_payload(const uint8_t *p, size_t len, uint32_t raw_len, std::vector<uint8_t> &out) {
+    size_t base = out.size();
+    out.resize(base + raw_len + SIMD_FILL_SLACK);
+    uint8_t *o = out.data() + base;
+    uint8_t *end = o + raw_len;
+    
+    size_t i = 0;
+    while (i < len) {
+        uint8_t h = p[i++];
+        if (h < 128) {
+            size_t n = static_cast<size_t>(h) + 1;
+            if (i + n > len || o + n > end) {
+                return false;
+            }
+            memcpy(o, p + i, n);
+            o += n;
+            i += n;
+        } else {
+            size_t n = static_cast<size_t>(h) - 125;
+            if (i >= len || o + n > end) {
+                return false;
+            }
+            simd_fill_run(o, p[i++], n);
+            o += n;
+        }
+    }
+    if (o != end) {
+        return false;
+    }
+    out.resize(base + raw_len);
+    return true;
+}
+
+// LZ: LZ77 dictionary coder using the LZ4 sequence layout, in frames.
+// Each sequence is
+//   [token][literal length ext][literals][offset:2 LE][match length ext]
+// The token's high nibble is the literal count and its low nibble the match
+// length minus 4; a nibble of 15 continues in extension bytes, each adding up
+// to 255, until one is below 255. The last sequence has literals only.
+// Offsets are 16-bit, so the window is at most 64 KiB (--lz-window).
+//   lz    fast level: one candidate per position, skipping ahead faster the
+//         longer no match is found (incompressible data stays cheap)
+//   lzhc  high-ratio level: walks a hash chain of earlier positions and
+//         defers a match by one byte when the next position matches longer
+static const size_t LZ_MIN_MATCH = 4;
+static const unsigned LZ_HASH_BITS = 16;
+static const size_t LZ_HC_DEPTH = 64;
+static const size_t LZ_NICE_MATCH = 1024; // Stop searching once a match is this long
+static const size_t LZ_COPY_SLACK = 16;   // Decoder copies matches 16 bytes at a time
+
+static uint32_t lz_hash(const uint8_t *p) {
+    uint32_t v;
+    memcpy(&v, p, sizeof(v));
+    return (v * 2654435761u) >> (32 - LZ_HASH_BITS);
+}
+
+// Length of the common prefix of a and b, at most limit
+static size_t lz_match_length(const uint8_t *a, const uint8_t *b, size_t limit) {
+    size_t n = 0;
+    while (n + 8 <= limit) {
+        uint64_t x, y;
+        memcpy(&x, a + n, 8);
+        memcpy(&y, b + n, 8);
+        if (x != y) {
+            return n + static_cast<size_t>(__builtin_ctzll(x ^ y) >> 3);
+        }
+        n += 8;
+    }
+    while (n < limit && a[n] == b[n]) {
+        ++n;
+    }
+    return n;
+}
+
+// Hash-chain match finder over a sliding window of earlier positions
+struct LzMatcher {
+    std::vector<int32_t> head;  // Latest position per hash
+    std::vector<int32_t> chain; // Previous position with the same hash, by pos & mask
+    size_t mask;
+    size_t window;
+    size_t depth;
+
+    LzMatcher(size_t window_size, size_t max_depth)
+        : head(size_t(1) << LZ_HASH_BITS, -1), chain(window_size, -1),
+          mask(window_size - 1), window(window_size), depth(max_depth) {}
+
+    void insert(const uint8_t *in, size_t pos) {
+        uint32_t h = lz_hash(in + pos);
+        chain[pos & mask] = head[h];
+        head[h] = static_cast<int32_t>(pos);
+    }
+
+    // Longest match for pos among the candidates; 0 when none reaches LZ_MIN_MATCH
+    size_t find(const uint8_t *in, size_t pos, size_t len, size_t &offset) const {
+        size_t best = 0;
+        size_t limit = len - pos;
+        int32_t cand = head[lz_hash(in + pos)];
+        for (size_t d = 0; d < depth && cand >= 0; ++d) {
+            size_t dist = pos - static_cast<size_t>(cand);
+            if (dist >= window || dist > 0xffff) {
+                break;
+            }
+            if (in[cand + best] == in[pos + best]) {
+                size_t n = lz_match_length(in + cand, in + pos, limit);
+                if (n > best) {
+                    best = n;
+                    offset = dist;
+                    if (n >= LZ_NICE_MATCH || n == limit) {
+                        break;
+                    }
+                }
+            }
+            cand = chain[static_cast<size_t>(cand) & mask];
+        }
+        return best >= LZ_MIN_MATCH ? best : 0;
+    }
+};
+
+static void lz_put_length(uint8_t *&o, size_t n) {
+    while (n >= 255) {
+        *o++ = 255;
+        n -= 255;
+    }
+    *o++ = static_cast<uint8_t>(n);
+}
+
+// Emit one sequence; match_len 0 marks the final literals-only sequence.
+// Returns false when the output would reach end (packing does not pay off).
+static bool lz_put_sequence(uint8_t *&o, uint8_t *end, const uint8_t *lit, size_t lit_len,
+                            size_t match_len, size_t offset) {
+    size_t worst = 1 + lit_len / 255 + 1 + lit_len + 2 + match_len / 255 + 1;
+    if (worst >= static_cast<size_t>(end - o)) {
+        return false;
+    }
+    size_t ml = match_len ? match_len - LZ_MIN_MATCH : 0;
+    uint8_t *token = o++;
+    *token = static_cast<uint8_t>(((lit_len < 15 ? lit_len : 15) << 4) | (ml < 15 ? ml : 15));
+    if (lit_len >= 15) {
+        lz_put_length(o, lit_len - 15);
+    }
+    memcpy(o, lit, lit_len);
+    o += lit_len;
+    if (match_len) {
+        *o++ = static_cast<uint8_t>(offset);
+        *o++ = static_cast<uint8_t>(offset >> 8);
+        if (ml >= 15) {
+            lz_put_length(o, ml - 15);
+        }
+    }
+    return true;
+}
+
+// Pack in[0..len) into out[0..cap). Returns the payload size, or SIZE_MAX
+// when it would not be smaller than cap. Compiled once per level, so the fast
+// level carries no lazy-matching code.
+template <bool High>
+static size_t lz_pack(const uint8_t *in, size_t len, uint8_t *out, size_t cap, size_t window) {
+    LzMatcher m(window, High ? LZ_HC_DEPTH : 1);
+    uint8_t *o = out;
+    uint8_t *end = out + cap;
+    size_t anchor = 0;
+    size_t i = 0;
+    size_t misses = 0;
+    
+    while (i + LZ_MIN_MATCH <= len) {
+        size_t offset = 0;
+        size_t match = m.find(in, i, len, offset);
+        m.insert(in, i);
+        if (match == 0) {
+            // Fast level: step grows with the length of the literal stretch
+            i += High ? 1 : 1 + (misses++ >> 6);
+            continue;
+        }
+        if (High) {
+            // Lazy evaluation: prefer a longer match starting one byte later
+            while (i + 1 + LZ_MIN_MATCH <= len) {
+                size_t next_offset = 0;
+                size_t next = m.find(in, i + 1, len, next_offset);
+                if (next <= match) {
+                    break;
+                }
+                m.insert(in, i + 1);
+                ++i;
+                match = next;
+                offset = next_offset;
+            }
+        }
+        if (!lz_put_sequence(o, end, in + anchor, i - anchor, match, offset)) {
+            return SIZE_MAX;
+        }
+        // Index the matched bytes: all of them at the high level, only the
+        // tail (the likeliest start of the next match) at the fast level
+        size_t match_end = i + match;
+        size_t from = High ? i + 1 : (match_end > i + 2 ? match_end - 2 : i + 1);
+        for (size_t k = from; k < match_end && k + LZ_MIN_MATCH <= len; ++k) {
+            m.insert(in, k);
+        }
+        i = match_end;
+        anchor = i;
+        misses = 0;
+    }
+    if (!lz_put_sequence(o, end, in + anchor, len - anchor, 0, 0)) {
+        return SIZE_MAX;
+    }
+    return static_cast<size_t>(o - out);
+}
+
+// HUFF: order-0 Huffman entropy stage in frames (see entropy.h). Meant to
+// follow a codec whose output has a skewed byte distribution, e.g. diff+huff.
+static void compress_huff(const uint8_t *in, size_t len, std::vector<uint8_t> &out) {
+    out.clear();
+    if (len == 0) {
+        return;
+    }
+    out.resize(FRAME_HEADER_SIZE + len);
+    size_t payload_len = huffman_encode(in, len, out.data() + FRAME_HEADER_SIZE, len);
+    finish_frame(out, in, len, payload_len);
+}
+
+static bool decode_huff_payload(const uint8_t *p, size_t len, uint32_t raw_len, std::vector<uint8_t> &out) {
+    size_t base = out.size();
+    out.resize(base + raw_len);
+    return huffman_decode(p, len, out.data() + base, raw_len);
+}
+
+template <bool High>
+static void compress_lz(const uint8_t *in, size_t len, size_t window, std::vector<uint8_t> &out) {
+    out.clear();
+    if (len == 0) {
+        return;
+    }
+    out.resize(FRAME_HEADER_SIZE + len);
+    size_t payload_len = lz_pack<High>(in, len, out.data() + FRAME_HEADER_SIZE, len, window);
+    finish_frame(out, in, len, payload_len);
+}
+
+// Read the extension bytes of a length nibble; fails on truncated input or a
+// length beyond max
+static bool lz_read_length(const uint8_t *&ip, const uint8_t *iend, size_t &n, size_t max) {
+    uint8_t b;
+    do {
+        if (ip >= iend || n > max) {
+            return false;
+        }
+        b = *ip++;
+        n += b;
+    } while (b == 255);
+    return true;
+}
+
+static bool decode_lz_payload(const uint8_t *p, size_t len, uint32_t raw_len, std::vector<uint8_t> &out) {
+    size_t base = out.size();
+    out.resize(base + raw_len + LZ_COPY_SLACK);
+    uint8_t *start = out.data() + base;
+    uint8_t *o = start;
+    uint8_t *end = start + raw_len;
+    const uint8_t *ip = p;
+    const uint8_t *iend = p + len;
+    
+    for (;;) {
+        if (ip >= iend) {
+            return false;
+        }
+        uint8_t token = *ip++;
+        size_t lit = token >> 4;
+        if (lit == 15 && !lz_read_length(ip, iend, lit, raw_len)) {
+            return false;
+        }
+        if (lit > static_cast<size_t>(iend - ip) || lit > static_cast<size_t>(end - o)) {
+            return false;
+        }
+        memcpy(o, ip, lit);
+        o += lit;
+        ip += lit;
+        if (ip == iend) {
+            break; // Final literals-only sequence
+        }
+        
+        if (iend - ip < 2) {
+            return false;
+        }
+        size_t offset = static_cast<size_t>(ip[0]) | (static_cast<size_t>(ip[1]) << 8);
+        ip += 2;
+        size_t match = token & 15;
+        if (match == 15 && !lz_read_length(ip, iend, match, raw_len)) {
+            return false;
+        }
+        match += LZ_MIN_MATCH;
+        if (offset == 0 || offset > static_cast<size_t>(o - start) || match > static_cast<size_t>(end - o)) {
+            return false;
+        }
+        
+        const uint8_t *src = o - offset;
+        if (offset >= 16) {
+            // Source and destination are 16+ bytes apart: copy whole vectors,
+            // possibly running into the slack past the match
+            for (size_t k = 0; k < match; k += 16) {
+                memcpy(o + k, src + k, 16);
+            }
+        } else {
+            // Overlapping copy repeats the last `offset` bytes
+            for (size_t k = 0; k < match; ++k) {
+                o[k] = src[k];
+            }
+        }
+        o += match;
+    }
+    if (o != end) {
+        return false;
+    }
+    out.resize(base + raw_len);
+    return true;
+}
+
+// Differential Encoding Compression: store differences between consecutive bytes
+// First byte is stored as-is, subsequent bytes store (byte - previous + 128)
+// modulo 256, so every difference fits in one byte and the code is lossless.
+// Every call starts afresh, so each container chunk decodes on its own.
+static void compress_differential(const uint8_t *in, size_t len, std::vector<uint8_t> &out) {
+    out.clear();
+    if (len == 0) {
+        return;
+    }
+    
+    out.resize(len);
+    out[0] = in[0];
+    simd_delta_encode(out.data() + 1, in + 1, len - 1, in[0]);
+}
+
+// Differential Encoding Decompression: reconstruct original data from differences
+// (a running sum, computed as a vector prefix sum).
+// prev is the last output byte of the preceding block (nullptr at stream start).
+static void decompress_differential(const uint8_t *in, size_t len, const uint8_t *prev_out,
+                                    std::vector<uint8_t> &out) {
+    out.clear();
+    if (len == 0) {
+        return;
+    }
+    
+    out.resize(len);
+    if (prev_out) {
+        simd_delta_decode(out.data(), in, len, *prev_out);
+    } else {
+        // First byte of the stream is stored as-is
+        out[0] = in[0];
+        simd_delta_decode(out.data() + 1, in + 1, len - 1, in[0]);
+    }
+}
+
+// Repeating key laid out flat so that the key bytes for any stream position are
+// a contiguous window of `width` bytes starting at `bytes + phase`. width is a
+// multiple of the key length, so the phase is the same for every window.
+struct ExpandedKey {
+    std::vector<uint8_t> bytes; // Key repeated to width + key length bytes
+    size_t period = 0;          // Key length
+    size_t width = 0;           // Bytes processed per window
+};
+
+static const size_t KEY_WINDOW_MIN = 256;
+
+static ExpandedKey expand_key(const std::string &key) {
+    ExpandedKey k;
+    k.period = key.length();
+    k.width = k.period * ((KEY_WINDOW_MIN + k.period - 1) / k.period);
+    k.bytes.resize(k.width + k.period);
+    for (size_t i = 0; i < k.bytes.size(); ++i) {
+        k.bytes[i] = static_cast<uint8_t>(key[i % k.period]);
+    }
+    return k;
+}
+
+// Combine data in place with the keystream starting at stream position
+// key_offset, one vectorized window at a time.
+typedef void (*KeystreamKernel)(uint8_t *dst, const uint8_t *src, size_t len);
+
+template <KeystreamKernel Kernel>
+static void apply_keystream(uint8_t *data, size_t len, const ExpandedKey &k, uint64_t key_offset) {
+    const uint8_t *window = k.bytes.data() + key_offset % k.period;
+    for (size_t pos = 0; pos < len; pos += k.width) {
+        size_t n = len - pos < k.width ? len - pos : k.width;
+        Kernel(data + pos, window, n);
+    }
+}
+
+
+// Codec and cipher classes. The per-block work is bound at compile time
+// (template arguments), so each codec's hot loop is a direct call.
+
+class RleCodec : public Codec {
+public:
+    RleCodec() : Codec("rle", CODEC_CHUNKABLE) {}
+
+    void encode(const uint8_t *in, size_t len, std::vector<uint8_t> &out) const override {
+        compress_rle(in, len, out);
+    }
+
+    bool decode(const uint8_t *in, size_t len, DecodeState &, std::vector<uint8_t> &out) const override {
+        return decompress_rle(in, len, out);
+    }
+};
+
+// store: no compression, only the container. What auto picks for data that
+// is already compressed or encrypted.
+class StoreCodec : public Codec {
+public:
+    StoreCodec() : Codec("store", CODEC_CHUNKABLE) {}
+
+    void encode(const uint8_t *in, size_t len, std::vector<uint8_t> &out) const override {
+        out.assign(in, in + len);
+    }
+
+    bool decode(const uint8_t *in, size_t len, DecodeState &, std::vector<uint8_t> &out) const override {
+        out.assign(in, in + len);
+        return true;
+    }
+};
+
+typedef void (*CompressFn)(const uint8_t *in, size_t len, std::vector<uint8_t> &out);
+
+// rle2, huff: frames packed by Compress and unpacked by Unpack
+template <CompressFn Compress, UnpackFn Unpack>
+class FramedCodec : public Codec {
+public:
+    FramedCodec(const char *name, const char *label) : Codec(name, 0), label_(label) {}
+
+    void encode(const uint8_t *in, size_t len, std::vector<uint8_t> &out) const override {
+        Compress(in, len, out);
+    }
+
+    bool decode(const uint8_t *in, size_t len, DecodeState &ds, std::vector<uint8_t> &out) const override {
+        out.clear();
+        return decompress_frames<Unpack>(label_, in, len, ds.pending, out);
+    }
+
+private:
+    const char *label_; // Codec name in error messages
+};
+
+// lz (High = false) and lzhc (High = true); both decode the same frames
+template <bool High>
+class LzCodec : public Codec {
+public:
+    explicit LzCodec(size_t window) : Codec(High ? "lzhc" : "lz", 0), window_(window) {}
+
+    void encode(const uint8_t *in, size_t len, std::vector<uint8_t> &out) const override {
+        compress_lz<High>(in, len, window_, out);
+    }
+
+    bool decode(const uint8_t *in, size_t len, DecodeState &ds, std::vector<uint8_t> &out) const override {
+        out.clear();
+        return decompress_frames<decode_lz_payload>("LZ", in, len, ds.pending, out);
+    }
+
+private:
+    size_t window_;
+};
+
+class DiffCodec : public Codec {
+public:
+    DiffCodec() : Codec("diff", 0) {}
+
+    void encode(const uint8_t *in, size_t len, std::vector<uint8_t> &out) const override {
+        compress_differential(in, len, out);
+    }
+
+    bool decode(const uint8_t *in, size_t len, DecodeState &ds, std::vector<uint8_t> &out) const override {
+        decompress_differential(in, len, ds.have_last ? &ds.last : nullptr, out);
+        if (!out.empty()) {
+            ds.have_last = true;
+            ds.last = out.back();
+        }
+        return !out.empty() || len == 0;
+    }
+};
+
+// Stages applied left to right when encoding and undone last stage first.
+// Stage i keeps its decoder state in the i-th link of the DecodeState chain.
+class ChainCodec : public Codec {
+public:
+    ChainCodec(const std::string &name, unsigned flags, std::vector<std::shared_ptr<const Codec>> stages)
+        : Codec(name, flags), stages_(std::move(stages)) {}
+
+    // Intermediate outputs alternate between out and a pooled buffer
+    void encode(const uint8_t *in, size_t len, std::vector<uint8_t> &out) const override {
+        PooledBuffer tmp_buf;
+        tmp_buf.reserve(len);
+        std::vector<uint8_t> &tmp = *tmp_buf;
+        stages_[0]->encode(in, len, out);
+        for (size_t i = 1; i < stages_.size(); ++i) {
+            tmp.swap(out);
+            stages_[i]->encode(tmp.data(), tmp.size(), out);
+        }
+    }
+
+    bool decode(const uint8_t *in, size_t len, DecodeState &ds, std::vector<uint8_t> &out) const override {
+        std::vector<DecodeState*> states(stages_.size());
+        DecodeState *s = &ds;
+        for (size_t i = 0; i < stages_.size(); ++i) {
+            states[i] = s;
+            if (i + 1 < stages_.size()) {
+                if (!s->next) {
+                    s->next.reset(new DecodeState());
+                }
+                s = s->next.get();
+            }
+        }
+
+        PooledBuffer tmp_buf;
+        tmp_buf.reserve(out.capacity() > len ? out.capacity() : len);
+        std::vector<uint8_t> &tmp = *tmp_buf;
+        size_t last = stages_.size() - 1;
+        if (!stages_[last]->decode(in, len, *states[last], out)) {
+            return false;
+        }
+        for (size_t i = last; i-- > 0;) {
+            tmp.swap(out);
+            if (!stages_[i]->decode(tmp.data(), tmp.size(), *states[i], out)) {
+                return false;
+            }
+        }
+        return true;
+    }
+
+private:
+    std::vector<std::shared_ptr<const Codec>> stages_;
+};
+
+// Repeating-key ciphers: data[i] = Encrypt(data[i], key byte), undone by Decrypt
+template <KeystreamKernel Encrypt, KeystreamKernel Decrypt>
+class KeystreamCipher : public Cipher {
+public:
+    KeystreamCipher(const char *name, const std::string &key)
+        : Cipher(name, CODEC_CHUNKABLE | CODEC_IN_PLACE | CODEC_NEEDS_KEY), key_(expand_key(key)) {}
+
+    void encrypt(uint8_t *data, size_t len, uint64_t key_offset) const override {
+        apply_keystream<Encrypt>(data, len, key_, key_offset);
+    }
+
+    void decrypt(uint8_t *data, size_t len, uint64_t key_offset) const override {
+        apply_keystream<Decrypt>(data, len, key_, key_offset);
+    }
+
+private:
+    ExpandedKey key_; // Expanded once per run, not per block
+};
+
+// Registry. A chain lists its stages in increasing `order`: an optional diff,
+// at most one of rle/rle2/lz/lzhc, and an optional huff entropy stage last.
+struct CodecEntry {
+    const char *name;
+    int order;
+    std::shared_ptr<const Codec> (*make)(size_t lz_window);
+};
+
+static const CodecEntry CODECS[] = {
+    {"diff", 0, [](size_t) -> std::shared_ptr<const Codec> { return std::make_shared<DiffCodec>(); }},
+    {"rle", 1, [](size_t) -> std::shared_ptr<const Codec> { return std::make_shared<RleCodec>(); }},
+    {"rle2", 1, [](size_t) -> std::shared_ptr<const Codec> {
+        return std::make_shared<FramedCodec<compress_rle2, decode_rle2_payload>>("rle2", "RLE2");
+    }},
+    {"lz", 1, [](size_t w) -> std::shared_ptr<const Codec> { return std::make_shared<LzCodec<false>>(w); }},
+    {"lzhc", 1, [](size_t w) -> std::shared_ptr<const Codec> { return std::make_shared<LzCodec<true>>(w); }},
+    {"store", 1, [](size_t) -> std::shared_ptr<const Codec> { return std::make_shared<StoreCodec>(); }},
+    {"huff", 2, [](size_t) -> std::shared_ptr<const Codec> {
+        return std::make_shared<FramedCodec<compress_huff, decode_huff_payload>>("huff", "HUFF");
+    }},
+};
+
+struct CipherEntry {
+    const char *name;
+    unsigned flags;
+    std::shared_ptr<const Cipher> (*make)(const std::string &key);
+};
+
+static const CipherEntry CIPHERS[] = {
+    {"vigenere", CODEC_NEEDS_KEY, [](const std::string &key) -> std::shared_ptr<const Cipher> {
+        return std::make_shared<KeystreamCipher<simd_add_bytes, simd_sub_bytes>>("vigenere", key);
+    }},
+    {"xor", CODEC_NEEDS_KEY, [](const std::string &key) -> std::shared_ptr<const Cipher> {
+        return std::make_shared<KeystreamCipher<simd_xor_bytes, simd_xor_bytes>>("xor", key); // XOR is its own inverse
+    }},
+};
+
+static std::string lowercase(const std::string &s) {
+    std::string r = s;
+    for (char &c : r) {
+        if (c >= 'A' && c <= 'Z') {
+            c = c - 'A' + 'a';
+        }
+    }
+    return r;
+}
+
+std::shared_ptr<const Codec> make_codec(const std::string &name, size_t lz_window, std::string &err) {
+    std::string alg = lowercase(name);
+    std::vector<std::shared_ptr<const Codec>> stages;
+    unsigned flags = CODEC_CHUNKABLE;
+    int prev_order = -1;
+    size_t start = 0;
+    for (;;) {
+        size_t plus = alg.find('+', start);
+        std::string stage = alg.substr(start, plus == std::string::npos ? std::string::npos : plus - start);
+        const CodecEntry *entry = nullptr;
+        for (const CodecEntry &e : CODECS) {
+            if (stage == e.name) {
+                entry = &e;
+            }
+        }
+        if (!entry || entry->order <= prev_order) {
+            err = "Unknown compression algorithm '" + name +
+                  "'. Supported: rle, rle2, lz, lzhc, diff, huff, store, auto and chains such as diff+lz+huff";
+            return nullptr;
+        }
+        prev_order = entry->order;
+        stages.push_back(entry->make(lz_window));
+        if (!stages.back()->has(CODEC_CHUNKABLE)) {
+            flags &= ~CODEC_CHUNKABLE;
+        }
+        if (plus == std::string::npos) {
+            break;
+        }
+        start = plus + 1;
+    }
+
+    if (stages.size() == 1) {
+        return stages[0];
+    }
+    return std::make_shared<ChainCodec>(alg, flags, std::move(stages));
+}
+
+std::shared_ptr<const Cipher> make_cipher(const std::string &name, const std::string &key, std::string &err) {
+    std::string alg = lowercase(name);
+    for (const CipherEntry &e : CIPHERS) {
+        if (alg != e.name) {
+            continue;
+        }
+        if ((e.flags & CODEC_NEEDS_KEY) && key.empty()) {
+            err = "Encryption/decryption requires a key (-k option)";
+            return nullptr;
+        }
+        return e.make(key);
+    }
+    err = "Unknown encryption algorithm '" + name + "'. Supported: vigenere, xor";
+    return nullptr;
+}
+
+// Order-0 entropy in bits per byte of a histogram of n bytes
+static double entropy_bits(const uint32_t hist[256], size_t n) {
+    double bits = 0;
+    for (int s = 0; s < 256; ++s) {
+        if (hist[s]) {
+            double p = static_cast<double>(hist[s]) / n;
+            bits -= p * std::log2(p);
+        }
+    }
+    return bits;
+}
+
+// Above this many bits per byte, both for the bytes and for their deltas, the
+// data is taken to be compressed or encrypted already and no trial is run
+static const double AUTO_INCOMPRESSIBLE_BITS = 7.8;
+
+// Candidates from fastest to slowest. The diff chains are only tried when the
+// deltas have lower entropy than the bytes (smooth numeric data).
+static const char *const AUTO_CANDIDATES[] = {"rle2", "lz", "huff", "diff+huff", "lz+huff", "diff+lz+huff"};
+
+std::shared_ptr<const Codec> choose_codec(const uint8_t *sample, size_t len, size_t lz_window) {
+    std::string err;
+    if (len == 0) {
+        return make_codec("store", lz_window, err);
+    }
+
+    uint32_t hist[256] = {0};
+    uint32_t delta_hist[256] = {0};
+    hist[sample[0]]++;
+    delta_hist[128]++;
+    for (size_t i = 1; i < len; ++i) {
+        hist[sample[i]]++;
+        delta_hist[static_cast<uint8_t>(sample[i] - sample[i - 1] + 128)]++;
+    }
+    double bits = entropy_bits(hist, len);
+    double delta_bits = entropy_bits(delta_hist, len);
+    if (bits > AUTO_INCOMPRESSIBLE_BITS && delta_bits > AUTO_INCOMPRESSIBLE_BITS) {
+        return make_codec("store", lz_window, err);
+    }
+
+    // Trial-encode the sample with each candidate
+    std::vector<std::shared_ptr<const Codec>> codecs;
+    std::vector<size_t> sizes;
+    std::vector<uint8_t> out;
+    size_t best = len;
+    for (const char *name : AUTO_CANDIDATES) {
+        if (strncmp(name, "diff+", 5) == 0 && delta_bits >= bits) {
+            continue;
+        }
+        codecs.push_back(make_codec(name, lz_window, err));
+        codecs.back()->encode(sample, len, out);
+        sizes.push_back(out.size());
+        best = out.size() < best ? out.size() : best;
+    }
+
+    // Store unless something saves at least 3%; otherwise take the fastest
+    // candidate within 3% of the best result
+    if (best > len - len / 32) {
+        return make_codec("store", lz_window, err);
+    }
+    size_t good_enough = best + best / 32;
+    for (size_t i = 0; i < codecs.size(); ++i) {
+        if (sizes[i] <= good_enough) {
+            return codecs[i];
+        }
+    }
+    return codecs.back();
+}
@@ -0,0 +1,147 @@
+#include "container.h"
+#include "simd_kernels.h"
+
+#include <string.h>
+
+static const uint8_t CONTAINER_MAGIC[6] = {'G', 'S', 'E', 'A', 0x1a, '\n'};
+
+static void put_u32(std::vector<uint8_t> &out, uint32_t v) {
+    for (int i = 0; i < 4; ++i) {
+        out.push_back(static_cast<uint8_t>(v >> (8 * i)));
+    }
+}
+
+static void put_u64(std::vector<uint8_t> &out, uint64_t v) {
+    for (int i = 0; i < 8; ++i) {
+        out.push_back(static_cast<uint8_t>(v >> (8 * i)));
+    }
+}
+
+static uint32_t get_u32(const uint8_t *p) {
+    return static_cast<uint32_t>(p[0]) | (static_cast<uint32_t>(p[1]) << 8) |
+           (static_cast<uint32_t>(p[2]) << 16) | (static_cast<uint32_t>(p[3]) << 24);
+}
+
+static uint64_t get_u64(const uint8_t *p) {
+    return static_cast<uint64_t>(get_u32(p)) | (static_cast<uint64_t>(get_u32(p + 4)) << 32);
+}
+
+bool is_container(const uint8_t *buf, size_t len) {
+    return len >= sizeof(CONTAINER_MAGIC) && memcmp(buf, CONTAINER_MAGIC, sizeof(CONTAINER_MAGIC)) == 0;
+}
+
+size_t container_header_size(const ContainerHeader &h) {
+    return CONTAINER_MIN_HEADER + h.comp_alg.size() + h.enc_alg.size();
+}
+
+void serialize_header(const ContainerHeader &h, std::vector<uint8_t> &out) {
+    size_t start = out.size();
+    out.insert(out.end(), CONTAINER_MAGIC, CONTAINER_MAGIC + sizeof(CONTAINER_MAGIC));
+    out.push_back(CONTAINER_VERSION);
+    out.push_back(h.flags);
+    put_u64(out, h.original_size);
+    put_u64(out, h.index_offset);
+    put_u32(out, h.chunk_count);
+    out.push_back(static_cast<uint8_t>(h.comp_alg.size()));
+    out.push_back(static_cast<uint8_t>(h.enc_alg.size()));
+    out.push_back(0); // Reserved
+    out.push_back(0);
+    out.insert(out.end(), h.comp_alg.begin(), h.comp_alg.end());
+    out.insert(out.end(), h.enc_alg.begin(), h.enc_alg.end());
+    put_u32(out, simd_crc32c(0, out.data() + start, out.size() - start));
+}
+
+void serialize_index(const std::vector<ChunkEntry> &chunks, std::vector<uint8_t> &out) {
+    size_t start = out.size();
+    for (const ChunkEntry &c : chunks) {
+        put_u32(out, c.stored_len);
+        put_u32(out, c.original_len);
+        put_u32(out, c.crc);
+    }
+    put_u32(out, simd_crc32c(0, out.data() + start, out.size() - start));
+}
+
+void serialize_chunk_ref(const ChunkRef &ref, std::vector<uint8_t> &out) {
+    put_u64(out, ref.offset);
+    put_u32(out, ref.stored_len);
+}
+
+ChunkRef parse_chunk_ref(const uint8_t *buf) {
+    ChunkRef ref;
+    ref.offset = get_u64(buf);
+    ref.stored_len = get_u32(buf + 8);
+    return ref;
+}
+
+bool parse_header(const uint8_t *buf, size_t len, ContainerHeader &h, size_t &header_size, std::string &err) {
+    if (!is_container(buf, len) || len < CONTAINER_MIN_HEADER) {
+        err = "not a GSEA container";
+        return false;
+    }
+    if (buf[6] != CONTAINER_VERSION) {
+        err = "unsupported container version " + std::to_string(buf[6]);
+        return false;
+    }
+    size_t comp_len = buf[28];
+    size_t enc_len = buf[29];
+    header_size = CONTAINER_MIN_HEADER + comp_len + enc_len;
+    if (len < header_size) {
+        err = "truncated header";
+        return false;
+    }
+    if (simd_crc32c(0, buf, header_size - 4) != get_u32(buf + header_size - 4)) {
+        err = "header checksum mismatch";
+        return false;
+    }
+
+    h.flags = buf[7];
+    h.original_size = get_u64(buf + 8);
+    h.index_offset = get_u64(buf + 16);
+    h.chunk_count = get_u32(buf + 24);
+    h.comp_alg.assign(reinterpret_cast<const char*>(buf + 32), comp_len);
+    h.enc_alg.assign(reinterpret_cast<const char*>(buf + 32 + comp_len), enc_len);
+    if ((h.flags & ~(CONTAINER_COMPRESSED | CONTAINER_ENCRYPTED | CONTAINER_DEDUP)) != 0 ||
+        ((h.flags & CONTAINER_COMPRESSED) != 0) != !h.comp_alg.empty() ||
+        ((h.flags & CONTAINER_ENCRYPTED) != 0) != !h.enc_alg.empty() ||
+        h.index_offset < header_size) {
+        err = "inconsistent header fields";
+        return false;
+    }
+    return true;
+}
+
+bool parse_index(const uint8_t *buf, size_t len, const ContainerHeader &h, size_t header_size,
+                 std::vector<ChunkEntry> &chunks, std::string &err) {
+    if (len != container_index_size(h.chunk_count)) {
+        err = "index size mismatch";
+        return false;
+    }
+    if (simd_crc32c(0, buf, len - 4) != get_u32(buf + len - 4)) {
+        err = "index checksum mismatch";
+        return false;
+    }
+
+    chunks.resize(h.chunk_count);
+    uint64_t stored = header_size;
+    uint64_t original = 0;
+    for (uint32_t i = 0; i < h.chunk_count; ++i) {
+        const uint8_t *e = buf + static_cast<size_t>(i) * CONTAINER_INDEX_ENTRY_SIZE;
+        ChunkEntry &c = chunks[i];
+        c.stored_len = get_u32(e);
+        c.original_len = get_u32(e + 4);
+        c.crc = get_u32(e + 8);
+        c.stored_offset = stored;
+        c.original_offset = original;
+        if ((h.flags & CONTAINER_DEDUP) && c.stored_len != CONTAINER_CHUNK_REF_SIZE) {
+            err = "malformed chunk reference";
+            return false;
+        }
+        stored += c.stored_len;
+        original += c.original_len;
+    }
+    if (stored != h.index_offset || original != h.original_size) {
+        err = "chunk table does not match the header";
+        return false;
+    }
+    return true;
+}
@@ -0,0 +1,303 @@
+#include "entropy.h"
+#include "buffer_pool.h"
+
+#include <algorithm>
+#include <vector>
+#include <string.h>
+
+static const size_t HUFFMAN_LENGTHS_SIZE = 128; // 256 nibbles
+static const size_t HUFFMAN_HEADER_SIZE = HUFFMAN_LENGTHS_SIZE + 3 * 4;
+static const size_t HUFFMAN_STREAMS = 4;
+static const size_t HUFFMAN_TABLE_SIZE = size_t(1) << HUFFMAN_MAX_BITS;
+// Decode table entry: symbol in bits 0..7, code length in bits 8..11
+static const uint16_t HUFFMAN_INVALID = 0x8000;
+
+// Code lengths of an optimal prefix code for freq. When the tree is deeper
+// than HUFFMAN_MAX_BITS the counts are halved (keeping every used symbol
+// non-zero) and the tree is rebuilt; flatter counts give a shallower tree.
+static void build_lengths(const uint64_t freq_in[256], uint8_t len[256]) {
+    uint64_t freq[256];
+    memcpy(freq, freq_in, sizeof(freq));
+    memset(len, 0, 256);
+
+    for (;;) {
+        std::vector<std::pair<uint64_t, int>> leaves;
+        for (int s = 0; s < 256; ++s) {
+            if (freq[s]) {
+                leaves.push_back(std::make_pair(freq[s], s));
+            }
+        }
+        if (leaves.size() == 1) {
+            len[leaves[0].second] = 1;
+            return;
+        }
+        std::sort(leaves.begin(), leaves.end());
+
+        // Two-queue construction: leaves in ascending order, internal nodes
+        // are created in ascending order too, so the two smallest weights are
+        // always at the queue fronts
+        size_t n = leaves.size();
+        std::vector<uint64_t> weight(2 * n - 1);
+        std::vector<int> parent(2 * n - 1, -1);
+        for (size_t i = 0; i < n; ++i) {
+            weight[i] = leaves[i].first;
+        }
+        size_t next_leaf = 0, next_node = n;
+        for (size_t node = n; node < 2 * n - 1; ++node) {
+            size_t pick[2];
+            for (size_t &p : pick) {
+                if (next_leaf < n && (next_node >= node || weight[next_leaf] <= weight[next_node])) {
+                    p = next_leaf++;
+                } else {
+                    p = next_node++;
+                }
+            }
+            weight[node] = weight[pick[0]] + weight[pick[1]];
+            parent[pick[0]] = parent[pick[1]] = static_cast<int>(node);
+        }
+
+        unsigned max_len = 0;
+        for (size_t i = 0; i < n; ++i) {
+            unsigned depth = 0;
+            for (int p = parent[i]; p >= 0; p = parent[p]) {
+                ++depth;
+            }
+            len[leaves[i].second] = static_cast<uint8_t>(depth);
+            max_len = std::max(max_len, depth);
+        }
+        if (max_len <= HUFFMAN_MAX_BITS) {
+            return;
+        }
+        for (int s = 0; s < 256; ++s) {
+            if (freq[s]) {
+                freq[s] = (freq[s] + 1) / 2;
+            }
+        }
+    }
+}
+
+// Canonical code for each symbol, bit-reversed so it can be written and read
+// least significant bit first
+static void build_codes(const uint8_t len[256], uint32_t code[256]) {
+    unsigned count[HUFFMAN_MAX_BITS + 1] = {0};
+    for (int s = 0; s < 256; ++s) {
+        count[len[s]]++;
+    }
+    count[0] = 0;
+    uint32_t next[HUFFMAN_MAX_BITS + 1] = {0};
+    uint32_t c = 0;
+    for (unsigned l = 1; l <= HUFFMAN_MAX_BITS; ++l) {
+        c = (c + count[l - 1]) << 1;
+        next[l] = c;
+    }
+    for (int s = 0; s < 256; ++s) {
+        if (len[s]) {
+            uint32_t v = next[len[s]]++;
+            uint32_t r = 0;
+            for (unsigned b = 0; b < len[s]; ++b) {
+                r = (r << 1) | ((v >> b) & 1);
+            }
+            code[s] = r;
+        }
+    }
+}
+
+static void put_u32(uint8_t *p, uint32_t v) {
+    p[0] = static_cast<uint8_t>(v);
+    p[1] = static_cast<uint8_t>(v >> 8);
+    p[2] = static_cast<uint8_t>(v >> 16);
+    p[3] = static_cast<uint8_t>(v >> 24);
+}
+
+static uint32_t get_u32(const uint8_t *p) {
+    return static_cast<uint32_t>(p[0]) | (static_cast<uint32_t>(p[1]) << 8) |
+           (static_cast<uint32_t>(p[2]) << 16) | (static_cast<uint32_t>(p[3]) << 24);
+}
+
+// Symbols [first, first + count) of stream k in a message of len symbols.
+// The last stream also takes the remainder of len / 4.
+static void stream_range(size_t len, size_t k, size_t &first, size_t &count) {
+    size_t q = len / HUFFMAN_STREAMS;
+    first = k * q;
+    count = k + 1 < HUFFMAN_STREAMS ? q : len - first;
+}
+
+size_t huffman_encode(const uint8_t *in, size_t len, uint8_t *out, size_t cap) {
+    if (len == 0) {
+        return SIZE_MAX;
+    }
+
+    // One histogram per stream: it doubles as the per-stream size count
+    uint64_t hist[HUFFMAN_STREAMS][256];
+    memset(hist, 0, sizeof(hist));
+    for (size_t k = 0; k < HUFFMAN_STREAMS; ++k) {
+        size_t first, count;
+        stream_range(len, k, first, count);
+        for (size_t i = first; i < first + count; ++i) {
+            hist[k][in[i]]++;
+        }
+    }
+    uint64_t freq[256];
+    for (int s = 0; s < 256; ++s) {
+        freq[s] = hist[0][s] + hist[1][s] + hist[2][s] + hist[3][s];
+    }
+
+    uint8_t lens[256];
+    uint32_t code[256];
+    build_lengths(freq, lens);
+    build_codes(lens, code);
+
+    // Exact output size is known before writing any bit
+    size_t stream_size[HUFFMAN_STREAMS];
+    size_t total = HUFFMAN_HEADER_SIZE;
+    for (size_t k = 0; k < HUFFMAN_STREAMS; ++k) {
+        uint64_t bits = 0;
+        for (int s = 0; s < 256; ++s) {
+            bits += hist[k][s] * lens[s];
+        }
+        stream_size[k] = static_cast<size_t>((bits + 7) / 8);
+        total += stream_size[k];
+    }
+    if (total >= cap) {
+        return SIZE_MAX;
+    }
+
+    for (size_t i = 0; i < HUFFMAN_LENGTHS_SIZE; ++i) {
+        out[i] = static_cast<uint8_t>(lens[2 * i] | (lens[2 * i + 1] << 4));
+    }
+    for (size_t k = 0; k + 1 < HUFFMAN_STREAMS; ++k) {
+        put_u32(out + HUFFMAN_LENGTHS_SIZE + 4 * k, static_cast<uint32_t>(stream_size[k]));
+    }
+
+    uint8_t *o = out + HUFFMAN_HEADER_SIZE;
+    for (size_t k = 0; k < HUFFMAN_STREAMS; ++k) {
+        size_t first, count;
+        stream_range(len, k, first, count);
+        uint64_t acc = 0;
+        unsigned bits = 0;
+        uint8_t *p = o;
+        for (size_t i = first; i < first + count; ++i) {
+            uint8_t s = in[i];
+            acc |= static_cast<uint64_t>(code[s]) << bits;
+            bits += lens[s];
+            if (bits >= 32) {
+                put_u32(p, static_cast<uint32_t>(acc));
+                p += 4;
+                acc >>= 32;
+                bits -= 32;
+            }
+        }
+        while (bits > 0) {
+            *p++ = static_cast<uint8_t>(acc);
+            acc >>= 8;
+            bits = bits > 8 ? bits - 8 : 0;
+        }
+        o += stream_size[k];
+    }
+    return total;
+}
+
+bool huffman_decode(const uint8_t *p, size_t len, uint8_t *out, size_t raw_len) {
+    if (len < HUFFMAN_HEADER_SIZE || raw_len == 0) {
+        return false;
+    }
+
+    uint8_t lens[256];
+    for (size_t i = 0; i < HUFFMAN_LENGTHS_SIZE; ++i) {
+        lens[2 * i] = p[i] & 0x0f;
+        lens[2 * i + 1] = p[i] >> 4;
+    }
+    // Kraft inequality: the codes must fit in the table without overlapping
+    uint64_t kraft = 0;
+    for (int s = 0; s < 256; ++s) {
+        if (lens[s] > HUFFMAN_MAX_BITS) {
+            return false;
+        }
+        if (lens[s]) {
+            kraft += HUFFMAN_TABLE_SIZE >> lens[s];
+        }
+    }
+    if (kraft == 0 || kraft > HUFFMAN_TABLE_SIZE) {
+        return false;
+    }
+
+    uint32_t code[256];
+    build_codes(lens, code);
+    // The table is reused by every call on this thread; the padded stream
+    // copy comes from the buffer pool
+    static thread_local std::vector<uint16_t> table(HUFFMAN_TABLE_SIZE);
+    std::fill(table.begin(), table.end(), HUFFMAN_INVALID);
+    for (int s = 0; s < 256; ++s) {
+        if (lens[s]) {
+            for (size_t i = code[s]; i < HUFFMAN_TABLE_SIZE; i += size_t(1) << lens[s]) {
+                table[i] = static_cast<uint16_t>(s | (lens[s] << 8));
+            }
+        }
+    }
+
+    // Stream bounds; every stream is copied into one buffer with 8 bytes of
+    // padding so the decoder can always load a full 64-bit word
+    size_t stream_start[HUFFMAN_STREAMS];
+    size_t stream_size[HUFFMAN_STREAMS];
+    size_t pos = 0;
+    size_t data_len = len - HUFFMAN_HEADER_SIZE;
+    for (size_t k = 0; k < HUFFMAN_STREAMS; ++k) {
+        stream_size[k] = k + 1 < HUFFMAN_STREAMS ? get_u32(p + HUFFMAN_LENGTHS_SIZE + 4 * k) : data_len - pos;
+        if (stream_size[k] > data_len - pos) {
+            return false;
+        }
+        stream_start[k] = pos;
+        pos += stream_size[k];
+    }
+    PooledBuffer buf(data_len + 8);
+    memcpy(buf->data(), p + HUFFMAN_HEADER_SIZE, data_len);
+    memset(buf->data() + data_len, 0, 8);
+    const uint8_t *data = buf->data();
+    const uint16_t *t = table.data();
+
+    uint64_t bitpos[HUFFMAN_STREAMS];
+    uint64_t limit[HUFFMAN_STREAMS];
+    uint8_t *dst[HUFFMAN_STREAMS];
+    size_t count[HUFFMAN_STREAMS];
+    for (size_t k = 0; k < HUFFMAN_STREAMS; ++k) {
+        size_t first;
+        stream_range(raw_len, k, first, count[k]);
+        dst[k] = out + first;
+        bitpos[k] = static_cast<uint64_t>(stream_start[k]) * 8;
+        limit[k] = static_cast<uint64_t>(stream_start[k] + stream_size[k]) * 8;
+    }
+
+    uint16_t bad = 0;
+#define GSEA_HUFF_STEP(k, i)                                                  \
+    do {                                                                      \
+        uint64_t v;                                                           \
+        memcpy(&v, data + (bitpos[k] >> 3), 8);                               \
+        uint16_t e = t[(v >> (bitpos[k] & 7)) & (HUFFMAN_TABLE_SIZE - 1)];    \
+        bad |= e;                                                             \
+        dst[k][i] = static_cast<uint8_t>(e);                                  \
+        bitpos[k] += (e >> 8) & 0x0f;                                         \
+    } while (0)
+
+    // Four independent streams per iteration keep several table lookups in
+    // flight. A stream that overruns its bytes is caught after the round,
+    // before the next load could leave the padded buffer.
+    size_t q = count[0];
+    for (size_t i = 0; i < q; ++i) {
+        GSEA_HUFF_STEP(0, i);
+        GSEA_HUFF_STEP(1, i);
+        GSEA_HUFF_STEP(2, i);
+        GSEA_HUFF_STEP(3, i);
+        if ((bitpos[0] > limit[0]) | (bitpos[1] > limit[1]) | (bitpos[2] > limit[2]) | (bitpos[3] > limit[3])) {
+            return false;
+        }
+    }
+    for (size_t i = q; i < count[3]; ++i) {
+        GSEA_HUFF_STEP(3, i);
+        if (bitpos[3] > limit[3]) {
+            return false;
+        }
+    }
+#undef GSEA_HUFF_STEP
+
+    return (bad & HUFFMAN_INVALID) == 0;
+}
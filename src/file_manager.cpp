@@ -1,70 +1,236 @@
 #include "file_manager.h"
 #include "utils.h"
+#include "stats.h"
 
 #include <sys/stat.h>
+#include <sys/mman.h>
 #include <dirent.h>
 #include <fcntl.h>
 #include <unistd.h>
 #include <errno.h>
 
+#include <stdio.h>
 #include <string.h>
 #include <iostream>
 #include <cstdint>
+#include <atomic>
+#include <algorithm>
+#include <pthread.h>
 
-static const size_t CHUNK = 4096;
+static const size_t CHUNK = 256 * 1024;
 
-std::vector<std::string> list_input_files(const std::string &path) {
-    std::vector<std::string> out;
-    struct stat st;
-    
-    if (stat(path.c_str(), &st) != 0) {
-        log_error("Failed to stat path '%s': %s", path.c_str(), strerror(errno));
-        return out;
+// Files a run writes next to its outputs. The walk may overlap the output
+// directory, and these must never be taken as inputs.
+static const char *const ARTIFACT_SUFFIXES[] = {".gsea-tmp", ".gsea-manifest", ".gsea-chunks"};
+
+static bool is_run_artifact(const char *name) {
+    size_t n = strlen(name);
+    for (const char *suffix : ARTIFACT_SUFFIXES) {
+        size_t k = strlen(suffix);
+        if (n >= k && memcmp(name + n - k, suffix, k) == 0) {
+            return true;
+        }
     }
-    
-    if (S_ISDIR(st.st_mode)) {
-        // simple recursive BFS
-        std::vector<std::string> q;
-        q.push_back(path);
-        for (size_t qi = 0; qi < q.size(); ++qi) {
-            DIR *d = opendir(q[qi].c_str());
-            if (!d) {
-                log_error("Failed to open directory '%s': %s", q[qi].c_str(), strerror(errno));
+    return false;
+}
+
+// One directory of a walk. The directory stays open while entries still need
+// it: its own walker while reading it, and each subdirectory until that
+// subdirectory has been opened relative to it with openat(). It is freed with
+// its last reference, so only directories in progress are held in memory.
+struct WalkDir {
+    WalkDir *parent = nullptr;
+    std::string path;              // Prefix of the reported paths of its entries
+    std::string name;              // Entry name within parent
+    DIR *dir = nullptr;
+    std::atomic<size_t> refs{1};   // Own walker + subdirectories not opened yet
+};
+
+// Directories found but not read yet, shared by the walker threads. A stack:
+// going deep first keeps few directories open at a time.
+struct Walk {
+    FileSink sink = nullptr;
+    void *ctx = nullptr;
+    pthread_mutex_t mutex = PTHREAD_MUTEX_INITIALIZER;
+    pthread_cond_t cv = PTHREAD_COND_INITIALIZER;
+    std::vector<WalkDir*> stack;
+    size_t outstanding = 0;        // Directories pushed and not finished
+    bool prune = false;            // Skip the directory prune_dev/prune_ino
+    dev_t prune_dev = 0;
+    ino_t prune_ino = 0;
+};
+
+static void release_dir(WalkDir *d) {
+    if (d->refs.fetch_sub(1) == 1) {
+        if (d->dir) {
+            closedir(d->dir);
+        }
+        delete d;
+    }
+}
+
+static void push_dir(Walk &walk, WalkDir *d) {
+    pthread_mutex_lock(&walk.mutex);
+    walk.stack.push_back(d);
+    walk.outstanding++;
+    pthread_cond_signal(&walk.cv);
+    pthread_mutex_unlock(&walk.mutex);
+}
+
+// Read one directory. d_type classifies most entries without a stat; only
+// file systems that leave it unset (and symlinks, which are followed) need
+// an fstatat(). Files go straight to the sink, subdirectories to the stack.
+static void walk_dir(Walk &walk, WalkDir *d) {
+    int fd = d->parent ? openat(dirfd(d->parent->dir), d->name.c_str(), O_RDONLY | O_DIRECTORY | O_CLOEXEC)
+                       : open(d->path.c_str(), O_RDONLY | O_DIRECTORY | O_CLOEXEC);
+    int open_errno = errno;
+    if (d->parent) {
+        release_dir(d->parent);
+        d->parent = nullptr;
+    }
+    if (fd >= 0) {
+        d->dir = fdopendir(fd);
+        if (!d->dir) {
+            open_errno = errno;
+            close(fd);
+        }
+    }
+    if (!d->dir) {
+        log_error("Failed to open directory '%s': %s", d->path.c_str(), strerror(open_errno));
+        release_dir(d);
+        return;
+    }
+
+    for (;;) {
+        errno = 0; // Clear errno before readdir
+        struct dirent *e = readdir(d->dir);
+        if (!e) break;
+        if (strcmp(e->d_name, ".") == 0 || strcmp(e->d_name, "..") == 0) continue;
+
+        unsigned char type = e->d_type;
+        // Subdirectories are only stat'ed when one of them is to be pruned
+        struct stat st;
+        if (type == DT_UNKNOWN || type == DT_LNK || (type == DT_DIR && walk.prune)) {
+            if (fstatat(dirfd(d->dir), e->d_name, &st, 0) != 0) {
+                log_error("Failed to stat '%s/%s': %s", d->path.c_str(), e->d_name, strerror(errno));
                 continue;
             }
-            
-            struct dirent *e;
-            errno = 0; // Clear errno before readdir
-            while ((e = readdir(d)) != nullptr) {
-                if (strcmp(e->d_name, ".") == 0 || strcmp(e->d_name, "..") == 0) continue;
-                
-                std::string child = q[qi] + "/" + e->d_name;
-                struct stat st2;
-                if (stat(child.c_str(), &st2) != 0) {
-                    log_error("Failed to stat '%s': %s", child.c_str(), strerror(errno));
-                    continue;
-                }
-                
-                if (S_ISDIR(st2.st_mode)) {
-                    q.push_back(child);
-                } else if (S_ISREG(st2.st_mode)) {
-                    out.push_back(child);
-                }
-            }
-            
-            if (errno != 0) {
-                log_error("Error reading directory '%s': %s", q[qi].c_str(), strerror(errno));
+            type = S_ISDIR(st.st_mode) ? DT_DIR : S_ISREG(st.st_mode) ? DT_REG : DT_UNKNOWN;
+        }
+
+        if (type == DT_DIR) {
+            if (walk.prune && st.st_dev == walk.prune_dev && st.st_ino == walk.prune_ino) {
+                continue;
             }
-            
-            closedir(d);
+            WalkDir *sub = new WalkDir();
+            sub->parent = d;
+            sub->path = d->path + "/" + e->d_name;
+            sub->name = e->d_name;
+            d->refs.fetch_add(1);
+            push_dir(walk, sub);
+        } else if (type == DT_REG && !is_run_artifact(e->d_name)) {
+            walk.sink(d->path + "/" + e->d_name, walk.ctx);
+        }
+    }
+
+    if (errno != 0) {
+        log_error("Error reading directory '%s': %s", d->path.c_str(), strerror(errno));
+    }
+    release_dir(d);
+}
+
+// Walker thread: take directories until the stack is empty and no other
+// walker can push more
+static void *walk_thread(void *arg) {
+    Walk &walk = *static_cast<Walk*>(arg);
+    pthread_mutex_lock(&walk.mutex);
+    for (;;) {
+        while (walk.stack.empty() && walk.outstanding > 0) {
+            pthread_cond_wait(&walk.cv, &walk.mutex);
+        }
+        if (walk.stack.empty()) {
+            break;
         }
-    } else if (S_ISREG(st.st_mode)) {
-        out.push_back(path);
-    } else {
+        WalkDir *d = walk.stack.back();
+        walk.stack.pop_back();
+        pthread_mutex_unlock(&walk.mutex);
+
+        walk_dir(walk, d);
+
+        pthread_mutex_lock(&walk.mutex);
+        if (--walk.outstanding == 0) {
+            pthread_cond_broadcast(&walk.cv);
+        }
+    }
+    pthread_mutex_unlock(&walk.mutex);
+    return nullptr;
+}
+
+bool walk_input_files(const std::string &path, size_t threads, FileSink sink, void *ctx,
+                      const std::string &prune) {
+    struct stat st;
+    if (stat(path.c_str(), &st) != 0) {
+        log_error("Failed to stat path '%s': %s", path.c_str(), strerror(errno));
+        return false;
+    }
+    if (S_ISREG(st.st_mode)) {
+        sink(path, ctx);
+        return true;
+    }
+    if (!S_ISDIR(st.st_mode)) {
         log_error("Path '%s' is neither a regular file nor a directory", path.c_str());
+        return false;
     }
-    
-    return out;
+
+    Walk walk;
+    walk.sink = sink;
+    walk.ctx = ctx;
+    struct stat prune_st;
+    if (!prune.empty() && stat(prune.c_str(), &prune_st) == 0 && S_ISDIR(prune_st.st_mode)) {
+        walk.prune = true;
+        walk.prune_dev = prune_st.st_dev;
+        walk.prune_ino = prune_st.st_ino;
+    }
+    WalkDir *root = new WalkDir();
+    root->path = path;
+    push_dir(walk, root);
+
+    // The calling thread is one of the walkers
+    std::vector<pthread_t> helpers;
+    for (size_t i = 1; i < threads; ++i) {
+        pthread_t t;
+        if (pthread_create(&t, nullptr, walk_thread, &walk) != 0) {
+            break;
+        }
+        helpers.push_back(t);
+    }
+    walk_thread(&walk);
+    for (pthread_t t : helpers) {
+        pthread_join(t, nullptr);
+    }
+    pthread_mutex_destroy(&walk.mutex);
+    pthread_cond_destroy(&walk.cv);
+    return true;
+}
+
+struct FileList {
+    pthread_mutex_t mutex = PTHREAD_MUTEX_INITIALIZER;
+    std::vector<std::string> files;
+};
+
+static void collect_file(const std::string &path, void *ctx) {
+    FileList *list = static_cast<FileList*>(ctx);
+    pthread_mutex_lock(&list->mutex);
+    list->files.push_back(path);
+    pthread_mutex_unlock(&list->mutex);
+}
+
+std::vector<std::string> list_input_files(const std::string &path, size_t threads, const std::string &prune) {
+    FileList list;
+    walk_input_files(path, threads, collect_file, &list, prune);
+    pthread_mutex_destroy(&list.mutex);
+    std::sort(list.files.begin(), list.files.end());
+    return list.files;
 }
 
 bool read_entire_file(const std::string &path, std::vector<uint8_t> &out) {
@@ -76,11 +242,23 @@ bool read_entire_file(const std::string &path, std::vector<uint8_t> &out) {
         return false;
     }
     
-    uint8_t buf[CHUNK];
+    // Size the buffer once from fstat and read straight into it; keep growing
+    // only for files whose size is unknown up front (pipes, /proc, ...)
+    struct stat st;
+    size_t expected = (fstat(fd, &st) == 0 && S_ISREG(st.st_mode)) ? static_cast<size_t>(st.st_size) : 0;
+    out.resize(expected);
+    size_t filled = 0;
     ssize_t r;
-    while ((r = read(fd, buf, CHUNK)) > 0) {
-        out.insert(out.end(), buf, buf + r);
+    for (;;) {
+        if (filled == out.size()) {
+            out.resize(out.size() + CHUNK);
+        }
+        r = read(fd, out.data() + filled, out.size() - filled);
+        if (r < 0 && errno == EINTR) continue;
+        if (r <= 0) break;
+        filled += static_cast<size_t>(r);
     }
+    out.resize(filled);
     
     if (r < 0) {
         log_error("Failed to read from file '%s': %s", path.c_str(), strerror(errno));
@@ -125,3 +303,142 @@ bool write_entire_file(const std::string &path, const std::vector<uint8_t> &in)
     
     return true;
 }
+
+bool map_input_file(const std::string &path, MappedFile &out) {
+    out = MappedFile();
+    stats_syscall(SYS_OPEN);
+    int fd = open(path.c_str(), O_RDONLY);
+    if (fd < 0) {
+        return false;
+    }
+    struct stat st;
+    stats_syscall(SYS_STAT);
+    if (fstat(fd, &st) != 0 || !S_ISREG(st.st_mode) || st.st_size == 0) {
+        stats_syscall(SYS_CLOSE);
+        close(fd);
+        return false;
+    }
+
+    stats_syscall(SYS_MMAP);
+    void *p = mmap(nullptr, static_cast<size_t>(st.st_size), PROT_READ, MAP_PRIVATE, fd, 0);
+    // The mapping stays valid after the descriptor is closed
+    stats_syscall(SYS_CLOSE);
+    close(fd);
+    if (p == MAP_FAILED) {
+        return false;
+    }
+    stats_syscall(SYS_MMAP);
+    madvise(p, static_cast<size_t>(st.st_size), MADV_SEQUENTIAL);
+
+    out.data = static_cast<const uint8_t*>(p);
+    out.size = static_cast<size_t>(st.st_size);
+    out.mapped = true;
+    return true;
+}
+
+void unmap_input_file(MappedFile &m) {
+    if (m.mapped) {
+        stats_syscall(SYS_MMAP);
+        munmap(const_cast<uint8_t*>(m.data), m.size);
+    }
+    m = MappedFile();
+}
+
+bool open_input_stream(const std::string &path, InputStream &s) {
+    s.path = path;
+    stats_syscall(SYS_OPEN);
+    s.fd = open(path.c_str(), O_RDONLY);
+    if (s.fd < 0) {
+        log_error("Failed to open file '%s' for reading: %s", path.c_str(), strerror(errno));
+        return false;
+    }
+    return true;
+}
+
+ssize_t read_block(InputStream &s, uint8_t *buf, size_t count) {
+    ssize_t r = safe_read_loop(s.fd, buf, count);
+    if (r < 0) {
+        log_error("Failed to read from file '%s': %s", s.path.c_str(), strerror(errno));
+    }
+    return r;
+}
+
+void close_input_stream(InputStream &s) {
+    if (s.fd < 0) {
+        return;
+    }
+    stats_syscall(SYS_CLOSE);
+    if (close(s.fd) != 0) {
+        log_error("Failed to close file '%s' after reading: %s", s.path.c_str(), strerror(errno));
+    }
+    s.fd = -1;
+}
+
+bool open_output_stream(const std::string &path, OutputStream &s) {
+    s.path = path;
+    s.tmp_path = path + ".gsea-tmp";
+    stats_syscall(SYS_OPEN);
+    s.fd = open(s.tmp_path.c_str(), O_WRONLY | O_CREAT | O_TRUNC, 0644);
+    if (s.fd < 0) {
+        log_error("Failed to open file '%s' for writing: %s", s.tmp_path.c_str(), strerror(errno));
+        return false;
+    }
+    return true;
+}
+
+bool write_block(OutputStream &s, const uint8_t *buf, size_t count) {
+    ssize_t w = safe_write_loop(s.fd, buf, count);
+    if (w < 0) {
+        log_error("Failed to write to file '%s': %s", s.path.c_str(), strerror(errno));
+        return false;
+    }
+    return true;
+}
+
+bool write_block_at(OutputStream &s, const uint8_t *buf, size_t count, uint64_t offset) {
+    ssize_t w = safe_pwrite_loop(s.fd, buf, count, static_cast<off_t>(offset));
+    if (w < 0) {
+        log_error("Failed to write to file '%s': %s", s.path.c_str(), strerror(errno));
+        return false;
+    }
+    return true;
+}
+
+void preallocate_output_stream(OutputStream &s, uint64_t size) {
+    if (size > 0) {
+        // fallocate() rather than posix_fallocate(): the latter emulates
+        // unsupported file systems by writing zeros. Failure is harmless.
+        stats_syscall(SYS_OTHER);
+        (void)fallocate(s.fd, 0, 0, static_cast<off_t>(size));
+    }
+}
+
+bool commit_output_stream(OutputStream &s) {
+    stats_syscall(SYS_CLOSE);
+    if (close(s.fd) != 0) {
+        log_error("Failed to close file '%s' after writing: %s", s.tmp_path.c_str(), strerror(errno));
+        s.fd = -1;
+        unlink(s.tmp_path.c_str());
+        return false;
+    }
+    s.fd = -1;
+    stats_syscall(SYS_OTHER);
+    if (rename(s.tmp_path.c_str(), s.path.c_str()) != 0) {
+        log_error("Failed to move '%s' into place as '%s': %s", s.tmp_path.c_str(), s.path.c_str(), strerror(errno));
+        unlink(s.tmp_path.c_str());
+        return false;
+    }
+    return true;
+}
+
+void abort_output_stream(OutputStream &s) {
+    if (s.fd >= 0) {
+        stats_syscall(SYS_CLOSE);
+        close(s.fd);
+        s.fd = -1;
+    }
+    if (!s.tmp_path.empty()) {
+        stats_syscall(SYS_OTHER);
+        unlink(s.tmp_path.c_str());
+    }
+}
@@ -1,51 +1,200 @@
 // New main using the CLI/file manager/worker skeleton with pthreads
 #include <iostream>
 #include <vector>
+#include <memory>
 #include <pthread.h>
 #include <sys/stat.h>
 #include <errno.h>
 #include <string.h>
+#include <stdlib.h>
 #include "cli.h"
 #include "file_manager.h"
 #include "worker.h"
 #include "utils.h"
+#include "thread_pool.h"
+#include "simd_kernels.h"
+#include "buffer_pool.h"
+#include "manifest.h"
+#include "chunk_store.h"
+#include "stats.h"
+
+// Files queued or in progress per worker before the walk waits for them
+static const size_t MAX_QUEUED_PER_THREAD = 64;
+// Directory walker threads (mostly waiting on the file system)
+static const size_t MAX_WALK_THREADS = 8;
 
 void usage() {
-    std::cout << "gsea [--compress|--decompress|--encrypt|--decrypt] --input <path> --output <path> [-k key]\n";
+    std::cout << "gsea [--compress|--decompress|--encrypt|--decrypt] --input <path> --output <path> [-k key] [--threads N] [--lz-window BYTES]\n"
+                 "     [--io-mode mmap|read|uring]\n"
+                 "     [--incremental] [--manifest <path>]\n"
+                 "     [--dedup] [--chunk-store <path>]\n"
+                 "     [--stats <path>] [--stats-format json|csv]\n"
+                 "     [--log-level error|warn|info|debug]\n"
+                 "     [--range OFFSET:LEN]\n";
 }
 
-int main(int argc, char **argv) {
-    Options opts;
-    if (!parse_cli(argc, argv, opts)) {
-        usage();
-        return 1;
+struct BatchJob;
+
+// Turns the files found by the walk into pool tasks while the walk goes on.
+// At most max_in_flight files are queued or being processed at any time: the
+// walker threads wait for workers to finish before queuing more, so memory
+// stays bounded however large the tree is.
+//
+// The output path names a file when the input is exactly one file, and a
+// directory otherwise. For a directory input without a trailing '/' on the
+// output, the first file is held back until a second one shows up (or the
+// walk ends) to tell the two apart.
+struct Dispatcher {
+    const Options *opts = nullptr;
+    ThreadPool *pool = nullptr;
+    size_t threads = 0;
+    size_t max_in_flight = 0;
+
+    pthread_mutex_t mutex = PTHREAD_MUTEX_INITIALIZER;
+    pthread_cond_t room_cv = PTHREAD_COND_INITIALIZER; // in_flight went down
+    size_t in_flight = 0;
+    size_t found = 0;
+    size_t succeeded = 0;
+    size_t failed = 0;
+    size_t skipped = 0;               // --incremental: unchanged since the manifest
+    Manifest *manifest = nullptr;
+    ChunkStore *store = nullptr;      // --dedup
+    StatsWriter *stats = nullptr;     // --stats
+    bool directory_output = false;
+    std::string held;                 // First file of a directory input
+    BatchJob *batch = nullptr;        // --io-mode uring: batch being filled
+    int error_code = 0;               // Set when output setup fails; stops dispatch
+};
+
+struct FileJob {
+    Dispatcher *d;
+    WorkerArgs args;
+    uint64_t queued_ns = 0;
+};
+
+// --incremental: each input is described as it is before processing and
+// recorded once its output is in place. An input that cannot be described is
+// processed but not recorded, so the next run processes it again.
+struct PendingRecord {
+    ManifestEntry entry;
+    bool describable = false;
+};
+
+static void describe_for_manifest(const Dispatcher *d, const WorkerArgs &args, PendingRecord &rec) {
+    rec.describable = d->manifest && d->manifest->describe_input(args.input_file, rec.entry);
+}
+
+static void record_in_manifest(Dispatcher *d, const WorkerArgs &args, PendingRecord &rec, void *result) {
+    if (rec.describable && result == reinterpret_cast<void*>(0)) {
+        rec.entry.output = args.output_file;
+        d->manifest->record(args.input_file, rec.entry);
     }
+}
 
-    init_logging();
+// --stats: measure a file from the moment a worker picks it up. The input is
+// sized now: with output == input it is replaced by the time the file is done.
+static void start_file_stats(const Dispatcher *d, WorkerArgs &args, FileStats &stats, uint64_t queued_ns,
+                             uint64_t start_ns) {
+    if (d->stats) {
+        args.stats = &stats;
+        stats.queue_wait_ns = start_ns - queued_ns;
+        struct stat st;
+        if (stat(args.input_file.c_str(), &st) == 0) {
+            stats.bytes_in = static_cast<uint64_t>(st.st_size);
+        }
+    }
+}
 
-    // Validate input path exists and is accessible
+static void report_file_stats(Dispatcher *d, const WorkerArgs &args, FileStats &stats, uint64_t start_ns,
+                              void *result) {
+    if (!d->stats) {
+        return;
+    }
+    bool ok = result == reinterpret_cast<void*>(0);
+    stats.wall_ns = stats_now_ns() - start_ns;
     struct stat st;
-    if (stat(opts.input_path.c_str(), &st) != 0) {
-        log_error("Input path '%s' does not exist or is not accessible: %s", 
-                 opts.input_path.c_str(), strerror(errno));
-        return 2;
+    if (ok && stat(args.output_file.c_str(), &st) == 0) {
+        stats.bytes_out = static_cast<uint64_t>(st.st_size);
     }
+    d->stats->add_file(args.input_file, args.output_file, ok, stats);
+}
 
-    if (!S_ISDIR(st.st_mode) && !S_ISREG(st.st_mode)) {
-        log_error("Input path '%s' is neither a file nor a directory", opts.input_path.c_str());
-        return 2;
+static void job_done(Dispatcher *d, size_t files, size_t failures) {
+    pthread_mutex_lock(&d->mutex);
+    d->in_flight -= files;
+    d->succeeded += files - failures;
+    d->failed += failures;
+    pthread_cond_broadcast(&d->room_cv);
+    pthread_mutex_unlock(&d->mutex);
+}
+
+static void *run_file_job(void *arg) {
+    FileJob *job = static_cast<FileJob*>(arg);
+    uint64_t start = stats_now_ns();
+    FileStats stats;
+    start_file_stats(job->d, job->args, stats, job->queued_ns, start);
+    PendingRecord rec;
+    describe_for_manifest(job->d, job->args, rec);
+    void *result = worker_entry(&job->args);
+    record_in_manifest(job->d, job->args, rec, result);
+    report_file_stats(job->d, job->args, stats, start, result);
+    job_done(job->d, 1, result == reinterpret_cast<void*>(0) ? 0 : 1);
+    delete job;
+    return nullptr;
+}
+
+struct BatchJob {
+    Dispatcher *d;
+    WorkerBatch batch;
+    std::vector<void*> results;
+    uint64_t queued_ns = 0;
+};
+
+static void *run_batch_job(void *arg) {
+    BatchJob *job = static_cast<BatchJob*>(arg);
+    WorkerBatch &batch = job->batch;
+    job->results.assign(batch.items.size(), reinterpret_cast<void*>(1));
+    batch.results = job->results.data();
+    // The files of a batch progress together, so each is timed as the batch
+    uint64_t start = stats_now_ns();
+    std::unique_ptr<FileStats[]> stats(new FileStats[batch.items.size()]);
+    std::vector<PendingRecord> recs(batch.items.size());
+    for (size_t i = 0; i < batch.items.size(); ++i) {
+        start_file_stats(job->d, *batch.items[i], stats[i], job->queued_ns, start);
+        describe_for_manifest(job->d, *batch.items[i], recs[i]);
     }
+    worker_batch_entry(&batch);
+    size_t failures = 0;
+    for (size_t i = 0; i < batch.items.size(); ++i) {
+        record_in_manifest(job->d, *batch.items[i], recs[i], job->results[i]);
+        report_file_stats(job->d, *batch.items[i], stats[i], start, job->results[i]);
+        failures += job->results[i] == reinterpret_cast<void*>(0) ? 0 : 1;
+        delete batch.items[i];
+    }
+    job_done(job->d, batch.items.size(), failures);
+    delete job;
+    return nullptr;
+}
 
-    auto files = list_input_files(opts.input_path);
-    if (files.empty()) {
-        log_error("No input files found for path: %s", opts.input_path.c_str());
-        return 2;
+// Called with the mutex held: wait until `files` more can be queued
+static void wait_for_room(Dispatcher *d, size_t files) {
+    while (d->in_flight > 0 && d->in_flight + files > d->max_in_flight) {
+        pthread_cond_wait(&d->room_cv, &d->mutex);
     }
+    d->in_flight += files;
+}
 
-    log_info("Found %zu file(s) to process", files.size());
+static void submit_batch(Dispatcher *d, BatchJob *job) {
+    wait_for_room(d, job->batch.items.size());
+    job->queued_ns = stats_now_ns();
+    d->pool->submit(run_batch_job, job, nullptr);
+}
 
-    // Create output directory if processing multiple files or output_path is a directory
-    if (files.size() > 1 || (!opts.output_path.empty() && opts.output_path.back() == '/')) {
+// Create the output directory of a multi-file run, or the parent directory of
+// a single output file. Called with the mutex held, once.
+static bool prepare_output(Dispatcher *d) {
+    const Options &opts = *d->opts;
+    if (d->directory_output) {
         std::string output_dir = opts.output_path.empty() ? "." : opts.output_path;
         // Remove trailing slash for directory check
         if (output_dir.back() == '/') {
@@ -54,10 +203,10 @@ int main(int argc, char **argv) {
         if (!output_dir.empty() && output_dir != ".") {
             if (!create_directory_recursive(output_dir)) {
                 log_error("Failed to create output directory '%s': %s", output_dir.c_str(), strerror(errno));
-                return 3;
+                return false;
             }
         }
-    } else if (files.size() == 1 && !opts.output_path.empty()) {
+    } else if (!opts.output_path.empty()) {
         // Single file: create parent directory of output file if needed
         std::string output_dir = dirname_from_path(opts.output_path);
         if (!output_dir.empty() && output_dir != "." && output_dir != "/") {
@@ -65,91 +214,316 @@ int main(int argc, char **argv) {
             if (stat(output_dir.c_str(), &out_st) != 0 || !S_ISDIR(out_st.st_mode)) {
                 if (!create_directory_recursive(output_dir)) {
                     log_error("Failed to create output directory '%s': %s", output_dir.c_str(), strerror(errno));
-                    return 3;
+                    return false;
                 }
             }
         }
     }
+    return true;
+}
 
-    // Create one pthread per file
-    std::vector<pthread_t> threads(files.size());
-    std::vector<WorkerArgs*> args(files.size(), nullptr);
-    size_t threads_created = 0;
+static void init_args(const Dispatcher *d, const std::string &path, WorkerArgs *args) {
+    const Options &opts = *d->opts;
+    args->opts = opts;
+    args->input_file = path;
+    args->key = opts.key;
+    args->pool = d->pool;
+    args->store = d->store;
 
-    for (size_t i = 0; i < files.size(); ++i) {
-        args[i] = new WorkerArgs();
-        args[i]->opts = opts;
-        args[i]->input_file = files[i];
-        
-        // Determine output filename
-        if (files.size() == 1 && !opts.output_path.empty()) {
-            // Single file: use output_path directly as filename (unless it's an existing directory)
-            struct stat out_st;
-            if (stat(opts.output_path.c_str(), &out_st) == 0 && S_ISDIR(out_st.st_mode)) {
-                // Output path is an existing directory, append basename
-                std::string base = basename_from_path(files[i]);
-                args[i]->output_file = path_join(opts.output_path, base);
-            } else {
-                // Output path is a filename (or doesn't exist yet), use it directly
-                args[i]->output_file = opts.output_path;
-            }
+    // Determine output filename
+    if (!d->directory_output && !opts.output_path.empty()) {
+        // Single file: use output_path directly as filename (unless it's an existing directory)
+        struct stat out_st;
+        if (stat(opts.output_path.c_str(), &out_st) == 0 && S_ISDIR(out_st.st_mode)) {
+            // Output path is an existing directory, append basename
+            args->output_file = path_join(opts.output_path, basename_from_path(path));
         } else {
-            // Multiple files: output_path is a directory, append basename
-            std::string base = basename_from_path(files[i]);
-            args[i]->output_file = path_join(opts.output_path.empty() ? "." : opts.output_path, base);
+            // Output path is a filename (or doesn't exist yet), use it directly
+            args->output_file = opts.output_path;
+        }
+    } else {
+        // Multiple files: output_path is a directory, append basename
+        args->output_file = path_join(opts.output_path.empty() ? "." : opts.output_path, basename_from_path(path));
+    }
+}
+
+// --incremental: whether the file and its output match the manifest. Called
+// with the mutex held, which is dropped during the check: it stats both files
+// and may hash the input.
+static bool skip_unchanged(Dispatcher *d, const WorkerArgs &args) {
+    if (!d->manifest) {
+        return false;
+    }
+    pthread_mutex_unlock(&d->mutex);
+    bool unchanged = d->manifest->unchanged(args.input_file, args.output_file);
+    pthread_mutex_lock(&d->mutex);
+    if (unchanged) {
+        d->skipped++;
+    }
+    return unchanged;
+}
+
+// Queue one file for processing. Called with the mutex held.
+static void queue_file(Dispatcher *d, const std::string &path) {
+    // Deduplicated files are cut into chunks as they are read, and a --range
+    // reads a few chunks of each file, not whole files: both outside the ring
+    if (d->opts->io_mode == "uring" && !d->store && !d->opts->range) {
+        WorkerArgs *args = new WorkerArgs();
+        init_args(d, path, args);
+        if (skip_unchanged(d, *args)) {
+            delete args;
+            return;
+        }
+        // Consecutive files share a batch so each task amortizes its ring submissions
+        if (!d->batch) {
+            d->batch = new BatchJob{d, WorkerBatch(), {}};
+        }
+        d->batch->batch.items.push_back(args);
+        if (d->batch->batch.items.size() == WORKER_BATCH_MAX_FILES) {
+            BatchJob *full = d->batch;
+            d->batch = nullptr;
+            submit_batch(d, full);
+        }
+        return;
+    }
+
+    FileJob *job = new FileJob{d, WorkerArgs()};
+    init_args(d, path, &job->args);
+    if (skip_unchanged(d, job->args)) {
+        delete job;
+        return;
+    }
+    wait_for_room(d, 1);
+    job->queued_ns = stats_now_ns();
+    d->pool->submit(run_file_job, job, nullptr);
+}
+
+// FileSink for walk_input_files(), called from the walker threads
+static void dispatch_file(const std::string &path, void *ctx) {
+    Dispatcher *d = static_cast<Dispatcher*>(ctx);
+    pthread_mutex_lock(&d->mutex);
+    d->found++;
+    if (d->error_code == 0) {
+        if (d->found == 1 && !d->directory_output) {
+            d->held = path;
+        } else {
+            if (d->found == 2 && !d->directory_output) {
+                // A second file: the output is a directory after all
+                d->directory_output = true;
+                if (!prepare_output(d)) {
+                    d->error_code = 3;
+                }
+            }
+            if (d->error_code == 0 && !d->held.empty()) {
+                // Taken before queue_file() drops the mutex, so no other
+                // walker queues it too
+                std::string held;
+                held.swap(d->held);
+                queue_file(d, held);
+            }
+            if (d->error_code == 0) {
+                queue_file(d, path);
+            }
         }
-        args[i]->key = opts.key;
+    }
+    pthread_mutex_unlock(&d->mutex);
+}
 
-        int rc = pthread_create(&threads[i], nullptr, worker_entry, args[i]);
-        if (rc != 0) {
-            log_error("Failed to create thread for '%s': %s", files[i].c_str(), strerror(rc));
-            delete args[i];
-            args[i] = nullptr;
+// Absolute path with symlinks resolved, also when its last components do not
+// exist yet (an output directory created later)
+static std::string resolve_path(const std::string &path) {
+    std::string head = path.empty() ? "." : path;
+    while (head.size() > 1 && head.back() == '/') {
+        head.pop_back();
+    }
+    std::string tail;
+    for (;;) {
+        char *real = realpath(head.c_str(), nullptr);
+        if (real) {
+            std::string resolved = path_join(real, tail);
+            free(real);
+            return resolved;
+        }
+        if (errno != ENOENT || head == "." || head == "/") {
+            return path;
+        }
+        tail = path_join(basename_from_path(head), tail);
+        head = dirname_from_path(head);
+    }
+}
+
+// Whether outputs of a directory input land inside the tree being walked
+static bool output_inside_input(const Options &opts, bool &same_dir) {
+    std::string in = resolve_path(opts.input_path);
+    std::string out = resolve_path(opts.output_path);
+    same_dir = out == in;
+    return same_dir || out.compare(0, in.size() + 1, in == "/" ? in : in + "/") == 0;
+}
+
+// The walk is over: queue a held-back lone file and split the last partial
+// io_uring batch so it still spreads over the workers
+static void finish_dispatch(Dispatcher *d) {
+    pthread_mutex_lock(&d->mutex);
+    if (d->error_code == 0 && !d->held.empty()) {
+        std::string held;
+        held.swap(d->held);
+        if (prepare_output(d)) {
+            queue_file(d, held);
         } else {
-            threads_created++;
+            d->error_code = 3;
+        }
+    }
+    if (d->batch) {
+        std::vector<WorkerArgs*> &rest = d->batch->batch.items;
+        size_t per_batch = (rest.size() + d->threads - 1) / d->threads;
+        for (size_t first = 0; first < rest.size(); first += per_batch) {
+            size_t last = first + per_batch < rest.size() ? first + per_batch : rest.size();
+            BatchJob *part = new BatchJob{d, WorkerBatch(), {}};
+            part->batch.items.assign(rest.begin() + first, rest.begin() + last);
+            submit_batch(d, part);
         }
+        delete d->batch;
+        d->batch = nullptr;
+    }
+    pthread_mutex_unlock(&d->mutex);
+}
+
+int main(int argc, char **argv) {
+    Options opts;
+    if (!parse_cli(argc, argv, opts)) {
+        usage();
+        return 1;
+    }
+
+    init_logging(opts.log_level);
+
+    // Validate input path exists and is accessible
+    struct stat st;
+    if (stat(opts.input_path.c_str(), &st) != 0) {
+        log_error("Input path '%s' does not exist or is not accessible: %s",
+                 opts.input_path.c_str(), strerror(errno));
+        return 2;
+    }
+
+    if (!S_ISDIR(st.st_mode) && !S_ISREG(st.st_mode)) {
+        log_error("Input path '%s' is neither a file nor a directory", opts.input_path.c_str());
+        return 2;
     }
 
+    // The pool is not capped by the file count: idle workers steal chunks of
+    // large files. It starts before the input is walked, so files are
+    // processed while the rest of the tree is still being listed.
+    size_t num_threads = opts.threads > 0 ? opts.threads : default_thread_count();
+
+    ThreadPool pool;
+    size_t threads_created = pool.start(num_threads);
     if (threads_created == 0) {
         log_error("Failed to create any worker threads");
         return 3;
     }
+    log_info("Using %zu worker thread(s), %s kernels", threads_created, simd_level_name(simd_level()));
 
-    // Join threads and count successes/failures
-    size_t success_count = 0;
-    size_t failure_count = 0;
-
-    for (size_t i = 0; i < threads.size(); ++i) {
-        if (args[i] == nullptr) {
-            failure_count++;
-            continue;
+    Dispatcher d;
+    d.opts = &opts;
+    d.pool = &pool;
+    d.threads = threads_created;
+    d.max_in_flight = MAX_QUEUED_PER_THREAD * threads_created;
+    // A trailing '/' asks for a directory even for a single file
+    d.directory_output = !opts.output_path.empty() && opts.output_path.back() == '/';
+    if (d.directory_output && !prepare_output(&d)) {
+        return 3;
+    }
+    // Opened before any work so a bad path fails the run up front
+    StatsWriter stats_writer;
+    FileStats run_stats;
+    uint64_t run_start = stats_now_ns();
+    if (!opts.stats_path.empty()) {
+        if (!stats_writer.open(opts.stats_path, opts.stats_format)) {
+            return 3;
+        }
+        stats_enable(&run_stats);
+        d.stats = &stats_writer;
+    }
+    ChunkStore store;
+    if (opts.dedup) {
+        std::string key = opts.do_encrypt ? opts.key : std::string();
+        if (!store.open(opts.chunk_store_path, chunk_store_fingerprint(opts), key)) {
+            return 3;
+        }
+        d.store = &store;
+    }
+    Manifest manifest;
+    if (opts.incremental) {
+        // The key only matters to runs with a cipher stage. Deduplicated
+        // outputs are only intact while their store is, so the manifest names
+        // the store it was written against.
+        std::string key = opts.do_encrypt || opts.do_decrypt ? opts.key : std::string();
+        if (!manifest.load(opts.manifest_path, manifest_fingerprint(opts, d.store ? store.id() : 0), key)) {
+            return 3;
         }
+        d.manifest = &manifest;
+    }
 
-        void *result = nullptr;
-        int rc = pthread_join(threads[i], &result);
-        if (rc != 0) {
-            log_error("Failed to join thread for '%s': %s", args[i]->input_file.c_str(), strerror(rc));
-            failure_count++;
-        } else {
-            // Check return value: 0 = success, non-zero = failure
-            uintptr_t status = reinterpret_cast<uintptr_t>(result);
-            if (status == 0) {
-                success_count++;
-            } else {
-                failure_count++;
-            }
+    size_t walk_threads = threads_created < MAX_WALK_THREADS ? threads_created : MAX_WALK_THREADS;
+    bool same_dir = false;
+    if (S_ISDIR(st.st_mode) && output_inside_input(opts, same_dir)) {
+        // Walking while writing would meet this run's temporaries and
+        // outputs: list the tree first, skipping the output directory unless
+        // it is the input itself
+        std::vector<std::string> files = list_input_files(opts.input_path, walk_threads,
+                                                          same_dir ? std::string() : opts.output_path);
+        for (const std::string &path : files) {
+            dispatch_file(path, &d);
         }
-        delete args[i];
+    } else {
+        walk_input_files(opts.input_path, S_ISDIR(st.st_mode) ? walk_threads : 1, dispatch_file, &d);
+    }
+    finish_dispatch(&d);
+    pool.wait_idle();
+    pool.shutdown();
+
+    // The workers have exited, so their pools are included in the totals
+    PoolStats ps = buffer_pool_stats();
+    bool stats_written = !d.stats || stats_writer.finish(run_stats, stats_now_ns() - run_start, d.skipped, ps);
+
+    if (d.found == 0) {
+        log_error("No input files found for path: %s", opts.input_path.c_str());
+        return 2;
+    }
+    log_info("Found %zu file(s) to process", d.found);
+    if (d.error_code != 0) {
+        return d.error_code;
     }
 
     // Print summary
-    log_info("Processing complete: %zu file(s) processed successfully, %zu file(s) failed", 
-            success_count, failure_count);
+    log_info("Processing complete: %zu file(s) processed successfully, %zu file(s) failed",
+            d.succeeded, d.failed);
+    // A manifest that was not written makes the next run process everything
+    bool manifest_saved = true;
+    if (d.manifest) {
+        log_info("Incremental: %zu unchanged file(s) skipped", d.skipped);
+        manifest_saved = manifest.save();
+    }
+    if (d.store) {
+        log_info("Dedup: %llu chunk(s) added (%llu bytes), %llu duplicate(s) of %.1f MiB referenced; '%s' holds %zu chunk(s)",
+                static_cast<unsigned long long>(store.added_chunks()),
+                static_cast<unsigned long long>(store.added_bytes()),
+                static_cast<unsigned long long>(store.reused_chunks()), store.reused_bytes() / (1024.0 * 1024.0),
+                store.path().c_str(), store.chunk_count());
+    }
 
-    if (failure_count > 0) {
+    log_info("Buffer pool: %llu buffer(s) served, %llu reused; peak %.1f MiB on one thread, %.1f MiB across threads",
+            static_cast<unsigned long long>(ps.acquired), static_cast<unsigned long long>(ps.reused),
+            ps.peak_thread / (1024.0 * 1024.0), ps.peak_total / (1024.0 * 1024.0));
+
+    if (d.store && store.failed()) {
+        log_error("Chunk store '%s' could not be written; outputs of this run may be incomplete",
+                 store.path().c_str());
+        return 4;
+    }
+    if (d.failed > 0 || !stats_written || !manifest_saved) {
         return 4; // Return error code if any files failed
     }
 
     return 0;
 }
-
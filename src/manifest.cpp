@@ -0,0 +1,221 @@
+#include "manifest.h"
+#include "file_manager.h"
+#include "utils.h"
+
+#include <sys/stat.h>
+#include <fcntl.h>
+#include <unistd.h>
+#include <errno.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <vector>
+
+static const char MANIFEST_MAGIC[] = "GSEA-MANIFEST 1 ";
+
+static uint64_t mtime_ns(const struct stat &st) {
+    return static_cast<uint64_t>(st.st_mtim.tv_sec) * 1000000000ULL + static_cast<uint64_t>(st.st_mtim.tv_nsec);
+}
+
+static bool hash_file(const std::string &path, uint64_t size, uint64_t &out) {
+    if (size == 0) {
+        out = hash64(nullptr, 0);
+        return true;
+    }
+    MappedFile map;
+    if (!map_input_file(path, map)) {
+        return false;
+    }
+    out = hash64(map.data, map.size);
+    unmap_input_file(map);
+    return true;
+}
+
+std::string manifest_fingerprint(const Options &opts, uint64_t store_id) {
+    std::string ops;
+    ops += opts.do_compress ? "c" : "";
+    ops += opts.do_decompress ? "d" : "";
+    ops += opts.do_encrypt ? "e" : "";
+    ops += opts.do_decrypt ? "r" : "";
+    ops += opts.dedup ? "D" : "";
+    return ops + ":" + (opts.comp_alg.empty() ? "-" : opts.comp_alg) + ":" +
+           (opts.enc_alg.empty() ? "-" : opts.enc_alg) + ":" + std::to_string(opts.lz_window) +
+           (opts.dedup ? ":" + std::to_string(store_id) : "");
+}
+
+Manifest::Manifest() {
+    pthread_mutex_init(&mutex_, nullptr);
+}
+
+Manifest::~Manifest() {
+    pthread_mutex_destroy(&mutex_);
+}
+
+bool Manifest::load(const std::string &path, const std::string &fingerprint, const std::string &key) {
+    path_ = path;
+    fingerprint_ = fingerprint;
+    key_ = key;
+    FILE *f = fopen(path.c_str(), "r");
+    if (!f) {
+        if (errno == ENOENT) {
+            return true;
+        }
+        log_error("Failed to open manifest '%s': %s", path.c_str(), strerror(errno));
+        return false;
+    }
+
+    char *line = nullptr;
+    size_t cap = 0;
+    ssize_t n = getline(&line, &cap, f);
+    std::string header = n > 0 ? std::string(line, static_cast<size_t>(n)) : std::string();
+    std::string expected = std::string(MANIFEST_MAGIC) + fingerprint;
+    bool match;
+    if (key.empty()) {
+        match = header == expected + "\n";
+    } else {
+        // "<fingerprint> <key tag>": the tag's salt is kept for the next save
+        std::string tag = header.compare(0, expected.size() + 1, expected + " ") == 0 && header.back() == '\n' ?
+                          header.substr(expected.size() + 1, header.size() - expected.size() - 2) : std::string();
+        match = key_tag_matches(tag, key);
+        key_tag_ = match ? tag : std::string();
+    }
+    if (match) {
+        while ((n = getline(&line, &cap, f)) > 0) {
+            if (line[n - 1] == '\n') {
+                line[--n] = '\0';
+            }
+            ManifestEntry e;
+            char *p = line;
+            uint64_t *fields[] = {&e.size, &e.mtime_ns, &e.inode, &e.hash, &e.output_size, &e.output_mtime_ns};
+            bool ok = true;
+            for (uint64_t *field : fields) {
+                char *next;
+                errno = 0;
+                *field = strtoull(p, &next, field == &e.hash ? 16 : 10);
+                ok = ok && next != p && *next == ' ' && errno == 0;
+                p = ok ? next + 1 : p;
+            }
+            char *tab = ok ? strchr(p, '\t') : nullptr;
+            if (!tab) {
+                continue; // Damaged line: that input is simply reprocessed
+            }
+            e.output.assign(tab + 1);
+            previous_[std::string(p, tab)] = e;
+        }
+    } else if (n > 0) {
+        log_warn("Manifest '%s' was written with other settings; processing every file", path.c_str());
+    }
+    free(line);
+    fclose(f);
+    log_info("Manifest '%s': %zu entr%s from the previous run", path.c_str(), previous_.size(),
+            previous_.size() == 1 ? "y" : "ies");
+    return true;
+}
+
+bool Manifest::unchanged(const std::string &input, const std::string &output) {
+    ManifestEntry e;
+    pthread_mutex_lock(&mutex_);
+    auto it = previous_.find(input);
+    bool known = it != previous_.end();
+    if (known) {
+        e = it->second;
+    }
+    pthread_mutex_unlock(&mutex_);
+    if (!known || e.output != output) {
+        return false;
+    }
+
+    struct stat in_st, out_st;
+    if (stat(input.c_str(), &in_st) != 0 || static_cast<uint64_t>(in_st.st_size) != e.size ||
+        stat(output.c_str(), &out_st) != 0 || static_cast<uint64_t>(out_st.st_size) != e.output_size ||
+        mtime_ns(out_st) != e.output_mtime_ns) {
+        return false;
+    }
+    if (mtime_ns(in_st) != e.mtime_ns || static_cast<uint64_t>(in_st.st_ino) != e.inode) {
+        // Touched, copied or restored: the contents decide, if they were hashed
+        uint64_t hash;
+        if (e.hash == 0 || !hash_file(input, e.size, hash) || hash != e.hash) {
+            return false;
+        }
+        e.mtime_ns = mtime_ns(in_st);
+        e.inode = static_cast<uint64_t>(in_st.st_ino);
+    }
+
+    pthread_mutex_lock(&mutex_);
+    current_[input] = e;
+    pthread_mutex_unlock(&mutex_);
+    return true;
+}
+
+bool Manifest::describe_input(const std::string &input, ManifestEntry &e) {
+    struct stat st;
+    if (stat(input.c_str(), &st) != 0 || !S_ISREG(st.st_mode)) {
+        return false;
+    }
+    e.size = static_cast<uint64_t>(st.st_size);
+    e.mtime_ns = mtime_ns(st);
+    e.inode = static_cast<uint64_t>(st.st_ino);
+    e.hash = 0;
+
+    ManifestEntry prev;
+    pthread_mutex_lock(&mutex_);
+    auto it = previous_.find(input);
+    bool known = it != previous_.end();
+    if (known) {
+        prev = it->second;
+    }
+    pthread_mutex_unlock(&mutex_);
+    if (!known || prev.size != e.size) {
+        return true;
+    }
+    if (prev.mtime_ns == e.mtime_ns && prev.inode == e.inode) {
+        // Only the output changed: the contents are the ones hashed before
+        e.hash = prev.hash;
+        return true;
+    }
+    if (!hash_file(input, e.size, e.hash)) {
+        e.hash = 0;
+    }
+    return true;
+}
+
+void Manifest::record(const std::string &input, ManifestEntry e) {
+    struct stat st;
+    if (input.find_first_of("\t\n") != std::string::npos || e.output.find_first_of("\t\n") != std::string::npos ||
+        stat(e.output.c_str(), &st) != 0) {
+        return;
+    }
+    e.output_size = static_cast<uint64_t>(st.st_size);
+    e.output_mtime_ns = mtime_ns(st);
+    pthread_mutex_lock(&mutex_);
+    current_[input] = e;
+    pthread_mutex_unlock(&mutex_);
+}
+
+bool Manifest::save() {
+    std::string tmp = path_ + ".gsea-tmp";
+    FILE *f = fopen(tmp.c_str(), "w");
+    if (!f) {
+        log_error("Failed to write manifest '%s': %s", tmp.c_str(), strerror(errno));
+        return false;
+    }
+    if (!key_.empty() && key_tag_.empty()) {
+        key_tag_ = make_key_tag(key_);
+    }
+    fprintf(f, "%s%s%s%s\n", MANIFEST_MAGIC, fingerprint_.c_str(), key_tag_.empty() ? "" : " ", key_tag_.c_str());
+    for (const auto &kv : current_) {
+        const ManifestEntry &e = kv.second;
+        fprintf(f, "%llu %llu %llu %016llx %llu %llu %s\t%s\n", static_cast<unsigned long long>(e.size),
+                static_cast<unsigned long long>(e.mtime_ns), static_cast<unsigned long long>(e.inode),
+                static_cast<unsigned long long>(e.hash), static_cast<unsigned long long>(e.output_size),
+                static_cast<unsigned long long>(e.output_mtime_ns), kv.first.c_str(), e.output.c_str());
+    }
+    bool ok = !ferror(f);
+    ok = (fclose(f) == 0) && ok;
+    if (!ok || rename(tmp.c_str(), path_.c_str()) != 0) {
+        log_error("Failed to write manifest '%s': %s", path_.c_str(), strerror(errno));
+        unlink(tmp.c_str());
+        return false;
+    }
+    return true;
+}
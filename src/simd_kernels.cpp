@@ -0,0 +1,361 @@
+#include "simd_kernels.h"
+
+#include <string.h>
+
+#if defined(__x86_64__) || defined(__i386__)
+#include <immintrin.h>
+#define GSEA_X86 1
+#endif
+
+typedef void (*BytesOp)(uint8_t *, const uint8_t *, size_t);
+typedef size_t (*MatchRunOp)(const uint8_t *, size_t, uint8_t);
+typedef void (*FillRunOp)(uint8_t *, uint8_t, size_t);
+typedef void (*DeltaOp)(uint8_t *, const uint8_t *, size_t, uint8_t);
+
+// ---- Scalar fallbacks ------------------------------------------------------
+
+static void xor_bytes_scalar(uint8_t *dst, const uint8_t *src, size_t len) {
+    for (size_t i = 0; i < len; ++i) {
+        dst[i] ^= src[i];
+    }
+}
+
+static void add_bytes_scalar(uint8_t *dst, const uint8_t *src, size_t len) {
+    for (size_t i = 0; i < len; ++i) {
+        dst[i] = static_cast<uint8_t>(dst[i] + src[i]);
+    }
+}
+
+static void sub_bytes_scalar(uint8_t *dst, const uint8_t *src, size_t len) {
+    for (size_t i = 0; i < len; ++i) {
+        dst[i] = static_cast<uint8_t>(dst[i] - src[i]);
+    }
+}
+
+static size_t match_run_scalar(const uint8_t *p, size_t len, uint8_t value) {
+    size_t i = 0;
+    while (i < len && p[i] == value) {
+        ++i;
+    }
+    return i;
+}
+
+static void fill_run_scalar(uint8_t *dst, uint8_t value, size_t count) {
+    memset(dst, value, count);
+}
+
+static void delta_encode_scalar(uint8_t *dst, const uint8_t *src, size_t len, uint8_t prev) {
+    for (size_t i = 0; i < len; ++i) {
+        dst[i] = static_cast<uint8_t>(src[i] - prev + 128);
+        prev = src[i];
+    }
+}
+
+static void delta_decode_scalar(uint8_t *dst, const uint8_t *src, size_t len, uint8_t prev) {
+    for (size_t i = 0; i < len; ++i) {
+        prev = static_cast<uint8_t>(prev + src[i] - 128);
+        dst[i] = prev;
+    }
+}
+
+#ifdef GSEA_X86
+
+// ---- SSE2: 16 bytes per step -----------------------------------------------
+
+#define GSEA_SSE2_BYTES_OP(name, intrinsic, tail)                                   \
+    __attribute__((target("sse2")))                                                 \
+    static void name(uint8_t *dst, const uint8_t *src, size_t len) {                \
+        size_t i = 0;                                                               \
+        for (; i + 16 <= len; i += 16) {                                            \
+            __m128i a = _mm_loadu_si128(reinterpret_cast<const __m128i*>(dst + i)); \
+            __m128i b = _mm_loadu_si128(reinterpret_cast<const __m128i*>(src + i)); \
+            _mm_storeu_si128(reinterpret_cast<__m128i*>(dst + i), intrinsic(a, b)); \
+        }                                                                           \
+        tail(dst + i, src + i, len - i);                                            \
+    }
+
+GSEA_SSE2_BYTES_OP(xor_bytes_sse2, _mm_xor_si128, xor_bytes_scalar)
+GSEA_SSE2_BYTES_OP(add_bytes_sse2, _mm_add_epi8, add_bytes_scalar)
+GSEA_SSE2_BYTES_OP(sub_bytes_sse2, _mm_sub_epi8, sub_bytes_scalar)
+
+__attribute__((target("sse2")))
+static size_t match_run_sse2(const uint8_t *p, size_t len, uint8_t value) {
+    const __m128i v = _mm_set1_epi8(static_cast<char>(value));
+    size_t i = 0;
+    for (; i + 16 <= len; i += 16) {
+        __m128i x = _mm_loadu_si128(reinterpret_cast<const __m128i*>(p + i));
+        unsigned mask = static_cast<unsigned>(_mm_movemask_epi8(_mm_cmpeq_epi8(x, v)));
+        if (mask != 0xffffu) {
+            return i + static_cast<size_t>(__builtin_ctz(~mask));
+        }
+    }
+    return i + match_run_scalar(p + i, len - i, value);
+}
+
+__attribute__((target("sse2")))
+static void fill_run_sse2(uint8_t *dst, uint8_t value, size_t count) {
+    const __m128i v = _mm_set1_epi8(static_cast<char>(value));
+    for (size_t i = 0; i < count; i += 16) {
+        _mm_storeu_si128(reinterpret_cast<__m128i*>(dst + i), v);
+    }
+}
+
+// The previous byte of every lane is one unaligned load behind the current one
+__attribute__((target("sse2")))
+static void delta_encode_sse2(uint8_t *dst, const uint8_t *src, size_t len, uint8_t prev) {
+    if (len == 0) {
+        return;
+    }
+    const __m128i bias = _mm_set1_epi8(static_cast<char>(0x80));
+    dst[0] = static_cast<uint8_t>(src[0] - prev + 128);
+    size_t i = 1;
+    for (; i + 16 <= len; i += 16) {
+        __m128i cur = _mm_loadu_si128(reinterpret_cast<const __m128i*>(src + i));
+        __m128i before = _mm_loadu_si128(reinterpret_cast<const __m128i*>(src + i - 1));
+        __m128i d = _mm_xor_si128(_mm_sub_epi8(cur, before), bias);
+        _mm_storeu_si128(reinterpret_cast<__m128i*>(dst + i), d);
+    }
+    delta_encode_scalar(dst + i, src + i, len - i, src[i - 1]);
+}
+
+// Inclusive prefix sum of 16 bytes in log2(16) shift-and-add steps, then the
+// running total of everything before the vector is added as a broadcast
+__attribute__((target("sse2")))
+static void delta_decode_sse2(uint8_t *dst, const uint8_t *src, size_t len, uint8_t prev) {
+    const __m128i bias = _mm_set1_epi8(static_cast<char>(0x80));
+    __m128i carry = _mm_set1_epi8(static_cast<char>(prev));
+    size_t i = 0;
+    for (; i + 16 <= len; i += 16) {
+        __m128i x = _mm_xor_si128(_mm_loadu_si128(reinterpret_cast<const __m128i*>(src + i)), bias);
+        x = _mm_add_epi8(x, _mm_slli_si128(x, 1));
+        x = _mm_add_epi8(x, _mm_slli_si128(x, 2));
+        x = _mm_add_epi8(x, _mm_slli_si128(x, 4));
+        x = _mm_add_epi8(x, _mm_slli_si128(x, 8));
+        x = _mm_add_epi8(x, carry);
+        _mm_storeu_si128(reinterpret_cast<__m128i*>(dst + i), x);
+        // Broadcast byte 15 (SSE2 has no byte shuffle)
+        carry = _mm_unpackhi_epi8(x, x);
+        carry = _mm_unpackhi_epi16(carry, carry);
+        carry = _mm_shuffle_epi32(carry, 0xff);
+    }
+    delta_decode_scalar(dst + i, src + i, len - i, static_cast<uint8_t>(_mm_cvtsi128_si32(carry)));
+}
+
+// ---- AVX2: 32 bytes per step, unrolled twice -------------------------------
+
+#define GSEA_AVX2_BYTES_OP(name, intrinsic, tail)                                          \
+    __attribute__((target("avx2")))                                                        \
+    static void name(uint8_t *dst, const uint8_t *src, size_t len) {                       \
+        size_t i = 0;                                                                      \
+        for (; i + 64 <= len; i += 64) {                                                   \
+            __m256i a0 = _mm256_loadu_si256(reinterpret_cast<const __m256i*>(dst + i));     \
+            __m256i a1 = _mm256_loadu_si256(reinterpret_cast<const __m256i*>(dst + i + 32));\
+            __m256i b0 = _mm256_loadu_si256(reinterpret_cast<const __m256i*>(src + i));     \
+            __m256i b1 = _mm256_loadu_si256(reinterpret_cast<const __m256i*>(src + i + 32));\
+            _mm256_storeu_si256(reinterpret_cast<__m256i*>(dst + i), intrinsic(a0, b0));    \
+            _mm256_storeu_si256(reinterpret_cast<__m256i*>(dst + i + 32), intrinsic(a1, b1));\
+        }                                                                                  \
+        for (; i + 32 <= len; i += 32) {                                                   \
+            __m256i a = _mm256_loadu_si256(reinterpret_cast<const __m256i*>(dst + i));      \
+            __m256i b = _mm256_loadu_si256(reinterpret_cast<const __m256i*>(src + i));      \
+            _mm256_storeu_si256(reinterpret_cast<__m256i*>(dst + i), intrinsic(a, b));      \
+        }                                                                                  \
+        tail(dst + i, src + i, len - i);                                                   \
+    }
+
+GSEA_AVX2_BYTES_OP(xor_bytes_avx2, _mm256_xor_si256, xor_bytes_sse2)
+GSEA_AVX2_BYTES_OP(add_bytes_avx2, _mm256_add_epi8, add_bytes_sse2)
+GSEA_AVX2_BYTES_OP(sub_bytes_avx2, _mm256_sub_epi8, sub_bytes_sse2)
+
+__attribute__((target("avx2")))
+static size_t match_run_avx2(const uint8_t *p, size_t len, uint8_t value) {
+    const __m256i v = _mm256_set1_epi8(static_cast<char>(value));
+    size_t i = 0;
+    for (; i + 32 <= len; i += 32) {
+        __m256i x = _mm256_loadu_si256(reinterpret_cast<const __m256i*>(p + i));
+        unsigned mask = static_cast<unsigned>(_mm256_movemask_epi8(_mm256_cmpeq_epi8(x, v)));
+        if (mask != 0xffffffffu) {
+            return i + static_cast<size_t>(__builtin_ctz(~mask));
+        }
+    }
+    return i + match_run_sse2(p + i, len - i, value);
+}
+
+__attribute__((target("avx2")))
+static void fill_run_avx2(uint8_t *dst, uint8_t value, size_t count) {
+    const __m256i v = _mm256_set1_epi8(static_cast<char>(value));
+    for (size_t i = 0; i < count; i += 32) {
+        _mm256_storeu_si256(reinterpret_cast<__m256i*>(dst + i), v);
+    }
+}
+
+__attribute__((target("avx2")))
+static void delta_encode_avx2(uint8_t *dst, const uint8_t *src, size_t len, uint8_t prev) {
+    if (len == 0) {
+        return;
+    }
+    const __m256i bias = _mm256_set1_epi8(static_cast<char>(0x80));
+    dst[0] = static_cast<uint8_t>(src[0] - prev + 128);
+    size_t i = 1;
+    for (; i + 32 <= len; i += 32) {
+        __m256i cur = _mm256_loadu_si256(reinterpret_cast<const __m256i*>(src + i));
+        __m256i before = _mm256_loadu_si256(reinterpret_cast<const __m256i*>(src + i - 1));
+        __m256i d = _mm256_xor_si256(_mm256_sub_epi8(cur, before), bias);
+        _mm256_storeu_si256(reinterpret_cast<__m256i*>(dst + i), d);
+    }
+    delta_encode_sse2(dst + i, src + i, len - i, src[i - 1]);
+}
+
+// Byte shifts work per 128-bit lane, so each lane is summed on its own and
+// the low lane's total is then carried into the high lane
+__attribute__((target("avx2")))
+static void delta_decode_avx2(uint8_t *dst, const uint8_t *src, size_t len, uint8_t prev) {
+    const __m256i bias = _mm256_set1_epi8(static_cast<char>(0x80));
+    const __m256i last_of_lane = _mm256_set1_epi8(15);
+    __m256i carry = _mm256_set1_epi8(static_cast<char>(prev));
+    size_t i = 0;
+    for (; i + 32 <= len; i += 32) {
+        __m256i x = _mm256_xor_si256(_mm256_loadu_si256(reinterpret_cast<const __m256i*>(src + i)), bias);
+        x = _mm256_add_epi8(x, _mm256_slli_si256(x, 1));
+        x = _mm256_add_epi8(x, _mm256_slli_si256(x, 2));
+        x = _mm256_add_epi8(x, _mm256_slli_si256(x, 4));
+        x = _mm256_add_epi8(x, _mm256_slli_si256(x, 8));
+        __m256i lane_totals = _mm256_shuffle_epi8(x, last_of_lane);
+        x = _mm256_add_epi8(x, _mm256_permute2x128_si256(lane_totals, lane_totals, 0x08));
+        x = _mm256_add_epi8(x, carry);
+        _mm256_storeu_si256(reinterpret_cast<__m256i*>(dst + i), x);
+        __m256i totals = _mm256_shuffle_epi8(x, last_of_lane);
+        carry = _mm256_permute2x128_si256(totals, totals, 0x11);
+    }
+    delta_decode_sse2(dst + i, src + i, len - i, i > 0 ? dst[i - 1] : prev);
+}
+
+#endif // GSEA_X86
+
+// ---- Dispatch --------------------------------------------------------------
+
+SimdLevel simd_level() {
+    // Function-local static: initialized once, thread-safe
+    static const SimdLevel level = [] {
+#ifdef GSEA_X86
+        __builtin_cpu_init();
+        if (__builtin_cpu_supports("avx2")) return SIMD_AVX2;
+        if (__builtin_cpu_supports("sse2")) return SIMD_SSE2;
+#endif
+        return SIMD_SCALAR;
+    }();
+    return level;
+}
+
+const char *simd_level_name(SimdLevel level) {
+    switch (level) {
+        case SIMD_AVX2: return "avx2";
+        case SIMD_SSE2: return "sse2";
+        default: return "scalar";
+    }
+}
+
+template <typename Fn>
+static Fn pick(Fn scalar, Fn sse2, Fn avx2) {
+    switch (simd_level()) {
+        case SIMD_AVX2: return avx2;
+        case SIMD_SSE2: return sse2;
+        default: return scalar;
+    }
+}
+
+#ifdef GSEA_X86
+#define GSEA_PICK(op) pick(op##_scalar, op##_sse2, op##_avx2)
+#else
+#define GSEA_PICK(op) pick(op##_scalar, op##_scalar, op##_scalar)
+#endif
+
+void simd_xor_bytes(uint8_t *dst, const uint8_t *src, size_t len) {
+    static const BytesOp fn = GSEA_PICK(xor_bytes);
+    fn(dst, src, len);
+}
+
+void simd_add_bytes(uint8_t *dst, const uint8_t *src, size_t len) {
+    static const BytesOp fn = GSEA_PICK(add_bytes);
+    fn(dst, src, len);
+}
+
+void simd_sub_bytes(uint8_t *dst, const uint8_t *src, size_t len) {
+    static const BytesOp fn = GSEA_PICK(sub_bytes);
+    fn(dst, src, len);
+}
+
+size_t simd_match_run(const uint8_t *p, size_t len, uint8_t value) {
+    static const MatchRunOp fn = GSEA_PICK(match_run);
+    return fn(p, len, value);
+}
+
+void simd_fill_run(uint8_t *dst, uint8_t value, size_t count) {
+    static const FillRunOp fn = GSEA_PICK(fill_run);
+    fn(dst, value, count);
+}
+
+void simd_delta_encode(uint8_t *dst, const uint8_t *src, size_t len, uint8_t prev) {
+    static const DeltaOp fn = GSEA_PICK(delta_encode);
+    fn(dst, src, len, prev);
+}
+
+void simd_delta_decode(uint8_t *dst, const uint8_t *src, size_t len, uint8_t prev) {
+    static const DeltaOp fn = GSEA_PICK(delta_decode);
+    fn(dst, src, len, prev);
+}
+
+// ---- CRC32C ----------------------------------------------------------------
+
+static uint32_t crc32c_table[256];
+
+static void crc32c_init_table() {
+    for (uint32_t i = 0; i < 256; ++i) {
+        uint32_t c = i;
+        for (int k = 0; k < 8; ++k) {
+            c = (c & 1) ? (c >> 1) ^ 0x82f63b78u : c >> 1;
+        }
+        crc32c_table[i] = c;
+    }
+}
+
+static uint32_t crc32c_scalar(uint32_t crc, const uint8_t *p, size_t len) {
+    for (size_t i = 0; i < len; ++i) {
+        crc = crc32c_table[(crc ^ p[i]) & 0xff] ^ (crc >> 8);
+    }
+    return crc;
+}
+
+#if defined(__x86_64__)
+__attribute__((target("sse4.2")))
+static uint32_t crc32c_sse42(uint32_t crc, const uint8_t *p, size_t len) {
+    uint64_t c = crc;
+    size_t i = 0;
+    for (; i + 8 <= len; i += 8) {
+        uint64_t v;
+        memcpy(&v, p + i, 8);
+        c = _mm_crc32_u64(c, v);
+    }
+    uint32_t c32 = static_cast<uint32_t>(c);
+    for (; i < len; ++i) {
+        c32 = _mm_crc32_u8(c32, p[i]);
+    }
+    return c32;
+}
+#endif
+
+uint32_t simd_crc32c(uint32_t crc, const uint8_t *p, size_t len) {
+    typedef uint32_t (*Crc32cOp)(uint32_t, const uint8_t *, size_t);
+    // SSE4.2 is not part of the SimdLevel ladder, so it is probed on its own
+    static const Crc32cOp fn = []() -> Crc32cOp {
+#if defined(__x86_64__)
+        __builtin_cpu_init();
+        if (__builtin_cpu_supports("sse4.2")) {
+            return crc32c_sse42;
+        }
+#endif
+        crc32c_init_table();
+        return crc32c_scalar;
+    }();
+    return ~fn(~crc, p, len);
+}
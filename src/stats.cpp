@@ -0,0 +1,225 @@
+#include "stats.h"
+#include "utils.h"
+
+#include <time.h>
+#include <errno.h>
+#include <string.h>
+
+thread_local FileStats *tls_file_stats = nullptr;
+FileStats *g_run_stats = nullptr;
+
+static const char *const STAGE_NAMES[STAGE_COUNT] = {
+    "read", "compress", "decompress", "encrypt", "decrypt", "dedup", "write"
+};
+
+static const char *const SYSCALL_NAMES[SYS_COUNT] = {
+    "read", "write", "open", "close", "stat", "mmap", "io_uring_enter", "other"
+};
+
+static uint64_t clock_ns(clockid_t clock) {
+    struct timespec ts;
+    clock_gettime(clock, &ts);
+    return static_cast<uint64_t>(ts.tv_sec) * 1000000000ULL + static_cast<uint64_t>(ts.tv_nsec);
+}
+
+uint64_t stats_now_ns() {
+    return clock_ns(CLOCK_MONOTONIC);
+}
+
+uint64_t stats_thread_cpu_ns() {
+    return clock_ns(CLOCK_THREAD_CPUTIME_ID);
+}
+
+void stats_enable(FileStats *run) {
+    g_run_stats = run;
+}
+
+StatsWriter::StatsWriter() {
+    pthread_mutex_init(&mutex_, nullptr);
+}
+
+StatsWriter::~StatsWriter() {
+    if (file_) {
+        fclose(file_);
+    }
+    pthread_mutex_destroy(&mutex_);
+}
+
+StatsWriter::Counts StatsWriter::snapshot(const FileStats &s) {
+    Counts c;
+    for (int i = 0; i < STAGE_COUNT; ++i) {
+        c.stage_wall_ns[i] = s.stage_wall_ns[i].load();
+        c.stage_cpu_ns[i] = s.stage_cpu_ns[i].load();
+    }
+    for (int i = 0; i < SYS_COUNT; ++i) {
+        c.syscalls[i] = s.syscalls[i].load();
+    }
+    c.queue_wait_ns = s.queue_wait_ns;
+    c.wall_ns = s.wall_ns;
+    c.bytes_in = s.bytes_in;
+    c.bytes_out = s.bytes_out;
+    return c;
+}
+
+void StatsWriter::add(Counts &sum, const Counts &c) {
+    for (int i = 0; i < STAGE_COUNT; ++i) {
+        sum.stage_wall_ns[i] += c.stage_wall_ns[i];
+        sum.stage_cpu_ns[i] += c.stage_cpu_ns[i];
+    }
+    for (int i = 0; i < SYS_COUNT; ++i) {
+        sum.syscalls[i] += c.syscalls[i];
+    }
+    sum.queue_wait_ns += c.queue_wait_ns;
+    sum.bytes_in += c.bytes_in;
+    sum.bytes_out += c.bytes_out;
+}
+
+bool StatsWriter::open(const std::string &path, const std::string &format) {
+    path_ = path;
+    csv_ = format == "csv";
+    file_ = fopen(path.c_str(), "w");
+    if (!file_) {
+        log_error("Failed to create stats file '%s': %s", path.c_str(), strerror(errno));
+        return false;
+    }
+    if (csv_) {
+        fputs("kind,input,output,status,bytes_in,bytes_out,queue_wait_ns,wall_ns", file_);
+        for (int i = 0; i < STAGE_COUNT; ++i) {
+            fprintf(file_, ",%s_wall_ns,%s_cpu_ns", STAGE_NAMES[i], STAGE_NAMES[i]);
+        }
+        for (int i = 0; i < SYS_COUNT; ++i) {
+            fprintf(file_, ",sys_%s", SYSCALL_NAMES[i]);
+        }
+        fputs(",files,failed,skipped,buffers_acquired,buffers_reused,peak_buffer_bytes_thread,"
+              "peak_buffer_bytes_total\n", file_);
+    } else {
+        fputs("{\n  \"files\": [", file_);
+    }
+    return true;
+}
+
+// CSV field holding text, quoted only when needed
+void StatsWriter::write_csv_field(const std::string &text) {
+    if (text.find_first_of(",\"\r\n") == std::string::npos) {
+        fputs(text.c_str(), file_);
+        return;
+    }
+    fputc('"', file_);
+    for (char ch : text) {
+        if (ch == '"') {
+            fputc('"', file_);
+        }
+        fputc(ch, file_);
+    }
+    fputc('"', file_);
+}
+
+static void write_json_string(FILE *f, const std::string &text) {
+    fputc('"', f);
+    for (unsigned char ch : text) {
+        if (ch == '"' || ch == '\\') {
+            fprintf(f, "\\%c", ch);
+        } else if (ch < 0x20) {
+            fprintf(f, "\\u%04x", ch);
+        } else {
+            fputc(ch, f);
+        }
+    }
+    fputc('"', f);
+}
+
+// The measurements of a record: CSV columns from bytes_in to the syscalls,
+// or the matching JSON members
+void StatsWriter::write_counts(const Counts &c) {
+    unsigned long long head[4] = {c.bytes_in, c.bytes_out, c.queue_wait_ns, c.wall_ns};
+    if (csv_) {
+        for (unsigned long long v : head) {
+            fprintf(file_, ",%llu", v);
+        }
+        for (int i = 0; i < STAGE_COUNT; ++i) {
+            fprintf(file_, ",%llu,%llu", static_cast<unsigned long long>(c.stage_wall_ns[i]),
+                    static_cast<unsigned long long>(c.stage_cpu_ns[i]));
+        }
+        for (int i = 0; i < SYS_COUNT; ++i) {
+            fprintf(file_, ",%llu", static_cast<unsigned long long>(c.syscalls[i]));
+        }
+        return;
+    }
+    fprintf(file_, "\"bytes_in\": %llu, \"bytes_out\": %llu, \"queue_wait_ns\": %llu, \"wall_ns\": %llu,\n"
+            "     \"stages\": {", head[0], head[1], head[2], head[3]);
+    for (int i = 0; i < STAGE_COUNT; ++i) {
+        fprintf(file_, "%s\"%s\": {\"wall_ns\": %llu, \"cpu_ns\": %llu}", i ? ", " : "", STAGE_NAMES[i],
+                static_cast<unsigned long long>(c.stage_wall_ns[i]), static_cast<unsigned long long>(c.stage_cpu_ns[i]));
+    }
+    fputs("},\n     \"syscalls\": {", file_);
+    for (int i = 0; i < SYS_COUNT; ++i) {
+        fprintf(file_, "%s\"%s\": %llu", i ? ", " : "", SYSCALL_NAMES[i],
+                static_cast<unsigned long long>(c.syscalls[i]));
+    }
+    fputc('}', file_);
+}
+
+void StatsWriter::add_file(const std::string &input, const std::string &output, bool ok, const FileStats &s) {
+    Counts c = snapshot(s);
+    pthread_mutex_lock(&mutex_);
+    add(total_, c);
+    files_++;
+    failed_ += ok ? 0 : 1;
+    if (csv_) {
+        fputs("file,", file_);
+        write_csv_field(input);
+        fputc(',', file_);
+        write_csv_field(output);
+        fputs(ok ? ",ok" : ",failed", file_);
+        write_counts(c);
+        fputs(",,,,,,,\n", file_);
+    } else {
+        fputs(first_file_ ? "\n    {\"input\": " : ",\n    {\"input\": ", file_);
+        write_json_string(file_, input);
+        fputs(", \"output\": ", file_);
+        write_json_string(file_, output);
+        fprintf(file_, ", \"status\": \"%s\",\n     ", ok ? "ok" : "failed");
+        write_counts(c);
+        fputc('}', file_);
+    }
+    first_file_ = false;
+    pthread_mutex_unlock(&mutex_);
+}
+
+bool StatsWriter::finish(const FileStats &run, uint64_t wall_ns, size_t skipped, const PoolStats &pool) {
+    Counts r = snapshot(run);
+    pthread_mutex_lock(&mutex_);
+    add(total_, r);
+    total_.wall_ns = wall_ns;
+    unsigned long long tail[7] = {files_, failed_, skipped, pool.acquired, pool.reused,
+                                  pool.peak_thread, pool.peak_total};
+    if (csv_) {
+        fputs("run,,,", file_);
+        write_counts(r);
+        fputs(",,,,,,,\ntotal,,,", file_);
+        fputs(failed_ ? "failed" : "ok", file_);
+        write_counts(total_);
+        for (unsigned long long v : tail) {
+            fprintf(file_, ",%llu", v);
+        }
+        fputc('\n', file_);
+    } else {
+        fputs(first_file_ ? "],\n  \"run\": {" : "\n  ],\n  \"run\": {", file_);
+        write_counts(r);
+        fprintf(file_, "},\n  \"total\": {\"status\": \"%s\", \"files\": %llu, \"failed\": %llu, \"skipped\": %llu,\n"
+                "     \"buffers_acquired\": %llu, \"buffers_reused\": %llu, \"peak_buffer_bytes_thread\": %llu, "
+                "\"peak_buffer_bytes_total\": %llu,\n     ",
+                failed_ ? "failed" : "ok", tail[0], tail[1], tail[2], tail[3], tail[4], tail[5], tail[6]);
+        write_counts(total_);
+        fputs("}\n}\n", file_);
+    }
+    pthread_mutex_unlock(&mutex_);
+
+    bool ok = !ferror(file_);
+    ok = fclose(file_) == 0 && ok;
+    file_ = nullptr;
+    if (!ok) {
+        log_error("Failed to write stats file '%s': %s", path_.c_str(), strerror(errno));
+    }
+    return ok;
+}
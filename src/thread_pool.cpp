@@ -0,0 +1,269 @@
+#include "thread_pool.h"
+#include "utils.h"
+
+#include <unistd.h>
+#include <string.h>
+#include <iterator>
+
+// Index of the pool worker running on this thread, -1 for outside threads
+static thread_local int tls_worker_index = -1;
+static thread_local ThreadPool *tls_pool = nullptr;
+
+ThreadPool::ThreadPool() {
+    pthread_mutex_init(&mutex_, nullptr);
+    pthread_cond_init(&work_cv_, nullptr);
+    pthread_cond_init(&group_cv_, nullptr);
+    pthread_cond_init(&idle_cv_, nullptr);
+}
+
+ThreadPool::~ThreadPool() {
+    shutdown();
+    for (WorkerQueue *q : queues_) {
+        pthread_mutex_destroy(&q->mutex);
+        delete q;
+    }
+    for (ThreadArg *a : thread_args_) {
+        delete a;
+    }
+    pthread_cond_destroy(&idle_cv_);
+    pthread_cond_destroy(&group_cv_);
+    pthread_cond_destroy(&work_cv_);
+    pthread_mutex_destroy(&mutex_);
+}
+
+size_t ThreadPool::start(size_t num_threads) {
+    // submit() spreads work over the started workers, so there must be one
+    if (num_threads == 0) {
+        num_threads = 1;
+    }
+    // All deques exist before any worker runs, so stealing never races with growth
+    for (size_t i = 0; i < num_threads; ++i) {
+        WorkerQueue *q = new WorkerQueue();
+        pthread_mutex_init(&q->mutex, nullptr);
+        queues_.push_back(q);
+    }
+
+    for (size_t i = 0; i < num_threads; ++i) {
+        ThreadArg *a = new ThreadArg{this, i};
+        pthread_t t;
+        int rc = pthread_create(&t, nullptr, thread_main, a);
+        if (rc != 0) {
+            log_error("Failed to create worker thread %zu of %zu: %s", i + 1, num_threads, strerror(rc));
+            delete a;
+            break;
+        }
+        thread_args_.push_back(a);
+        threads_.push_back(t);
+    }
+    return threads_.size();
+}
+
+void ThreadPool::submit(TaskFn fn, void *arg, void **result, TaskGroup *group) {
+    Task t;
+    t.fn = fn;
+    t.arg = arg;
+    t.result = result;
+    t.group = group;
+
+    if (group) {
+        group->remaining++;
+        group->queued++;
+    }
+    pending_++;
+
+    // Only deques of workers that were actually started may receive work
+    size_t target;
+    if (tls_pool == this && tls_worker_index >= 0) {
+        target = static_cast<size_t>(tls_worker_index);
+    } else {
+        target = next_queue_++ % threads_.size();
+    }
+
+    WorkerQueue *q = queues_[target];
+    pthread_mutex_lock(&q->mutex);
+    q->tasks.push_back(t);
+    pthread_mutex_unlock(&q->mutex);
+    queued_++;
+
+    pthread_mutex_lock(&mutex_);
+    pthread_cond_signal(&work_cv_);
+    if (group) {
+        pthread_cond_broadcast(&group_cv_);
+    }
+    pthread_mutex_unlock(&mutex_);
+}
+
+bool ThreadPool::pop_local(size_t index, Task &out) {
+    WorkerQueue *q = queues_[index];
+    bool found = false;
+    pthread_mutex_lock(&q->mutex);
+    if (!q->tasks.empty()) {
+        out = q->tasks.back();
+        q->tasks.pop_back();
+        found = true;
+    }
+    pthread_mutex_unlock(&q->mutex);
+    return found;
+}
+
+bool ThreadPool::steal(size_t thief, Task &out) {
+    size_t n = threads_.size();
+    for (size_t k = 1; k <= n; ++k) {
+        WorkerQueue *q = queues_[(thief + k) % n];
+        pthread_mutex_lock(&q->mutex);
+        if (!q->tasks.empty()) {
+            out = q->tasks.front();
+            q->tasks.pop_front();
+            pthread_mutex_unlock(&q->mutex);
+            return true;
+        }
+        pthread_mutex_unlock(&q->mutex);
+    }
+    return false;
+}
+
+void ThreadPool::dequeued(const Task &t) {
+    queued_--;
+    if (t.group) {
+        t.group->queued--;
+    }
+}
+
+bool ThreadPool::try_get_task(int index, Task &out) {
+    if (queued_.load() == 0) {
+        return false;
+    }
+    bool found = index >= 0 ? (pop_local(index, out) || steal(index, out))
+                            : steal(0, out);
+    if (found) {
+        dequeued(out);
+    }
+    return found;
+}
+
+// Like try_get_task, but only a task of group: the newest one in our own
+// deque, else the oldest one in any other
+bool ThreadPool::take_group_task(size_t index, const TaskGroup &group, Task &out) {
+    if (group.queued.load() == 0) {
+        return false;
+    }
+    size_t n = threads_.size();
+    for (size_t k = 0; k < n; ++k) {
+        WorkerQueue *q = queues_[(index + k) % n];
+        pthread_mutex_lock(&q->mutex);
+        bool found = false;
+        if (k == 0) {
+            for (auto it = q->tasks.rbegin(); it != q->tasks.rend(); ++it) {
+                if (it->group == &group) {
+                    out = *it;
+                    q->tasks.erase(std::next(it).base());
+                    found = true;
+                    break;
+                }
+            }
+        } else {
+            for (auto it = q->tasks.begin(); it != q->tasks.end(); ++it) {
+                if (it->group == &group) {
+                    out = *it;
+                    q->tasks.erase(it);
+                    found = true;
+                    break;
+                }
+            }
+        }
+        pthread_mutex_unlock(&q->mutex);
+        if (found) {
+            dequeued(out);
+            return true;
+        }
+    }
+    return false;
+}
+
+void ThreadPool::run_task(const Task &t) {
+    void *r = t.fn(t.arg);
+    if (t.result) {
+        *t.result = r;
+    }
+
+    bool group_done = t.group && --t.group->remaining == 0;
+    bool pool_idle = --pending_ == 0;
+    if (group_done || pool_idle) {
+        pthread_mutex_lock(&mutex_);
+        if (group_done) {
+            pthread_cond_broadcast(&group_cv_);
+        }
+        if (pool_idle) {
+            pthread_cond_broadcast(&idle_cv_);
+        }
+        pthread_mutex_unlock(&mutex_);
+    }
+}
+
+void ThreadPool::wait_group(TaskGroup &group) {
+    bool in_pool = tls_pool == this;
+    while (group.remaining.load() > 0) {
+        Task t;
+        if (in_pool && take_group_task(static_cast<size_t>(tls_worker_index), group, t)) {
+            run_task(t);
+            continue;
+        }
+        pthread_mutex_lock(&mutex_);
+        while (group.remaining.load() > 0 && (!in_pool || group.queued.load() == 0)) {
+            pthread_cond_wait(&group_cv_, &mutex_);
+        }
+        pthread_mutex_unlock(&mutex_);
+    }
+}
+
+void ThreadPool::wait_idle() {
+    pthread_mutex_lock(&mutex_);
+    while (pending_.load() > 0) {
+        pthread_cond_wait(&idle_cv_, &mutex_);
+    }
+    pthread_mutex_unlock(&mutex_);
+}
+
+void ThreadPool::shutdown() {
+    pthread_mutex_lock(&mutex_);
+    stopping_ = true;
+    pthread_cond_broadcast(&work_cv_);
+    pthread_mutex_unlock(&mutex_);
+
+    for (pthread_t t : threads_) {
+        pthread_join(t, nullptr);
+    }
+    threads_.clear();
+}
+
+void *ThreadPool::thread_main(void *arg) {
+    ThreadArg *a = static_cast<ThreadArg*>(arg);
+    ThreadPool *pool = a->pool;
+    tls_pool = pool;
+    tls_worker_index = static_cast<int>(a->index);
+
+    for (;;) {
+        Task t;
+        if (pool->try_get_task(tls_worker_index, t)) {
+            pool->run_task(t);
+            continue;
+        }
+
+        pthread_mutex_lock(&pool->mutex_);
+        while (pool->queued_.load() == 0 && !pool->stopping_) {
+            pthread_cond_wait(&pool->work_cv_, &pool->mutex_);
+        }
+        bool done = pool->queued_.load() == 0 && pool->stopping_;
+        pthread_mutex_unlock(&pool->mutex_);
+        if (done) {
+            // Stopping and nothing left to drain
+            break;
+        }
+    }
+    return nullptr;
+}
+
+size_t default_thread_count() {
+    long n = sysconf(_SC_NPROCESSORS_ONLN);
+    return n > 0 ? static_cast<size_t>(n) : 1;
+}
@@ -0,0 +1,199 @@
+#include "uring_io.h"
+#include "stats.h"
+
+#include <sys/mman.h>
+#include <sys/syscall.h>
+#include <unistd.h>
+#include <fcntl.h>
+#include <errno.h>
+#include <string.h>
+
+IoUring::~IoUring() {
+    shutdown();
+}
+
+void IoUring::shutdown() {
+    if (sqes_) {
+        munmap(sqes_, sqes_size_);
+        sqes_ = nullptr;
+    }
+    if (cq_ring_ && cq_ring_ != sq_ring_) {
+        munmap(cq_ring_, cq_ring_size_);
+    }
+    cq_ring_ = nullptr;
+    if (sq_ring_) {
+        munmap(sq_ring_, sq_ring_size_);
+        sq_ring_ = nullptr;
+    }
+    if (ring_fd_ >= 0) {
+        close(ring_fd_);
+        ring_fd_ = -1;
+    }
+}
+
+bool IoUring::init(unsigned entries) {
+    struct io_uring_params p;
+    memset(&p, 0, sizeof(p));
+    int fd = static_cast<int>(syscall(__NR_io_uring_setup, entries, &p));
+    if (fd < 0) {
+        return false;
+    }
+    ring_fd_ = fd;
+    // A half set-up ring is torn down again so ready() stays false
+    auto fail = [this]() {
+        int err = errno;
+        shutdown();
+        errno = err;
+        return false;
+    };
+    sq_entries_ = p.sq_entries;
+
+    sq_ring_size_ = p.sq_off.array + p.sq_entries * sizeof(unsigned);
+    cq_ring_size_ = p.cq_off.cqes + p.cq_entries * sizeof(io_uring_cqe);
+    bool single_mmap = (p.features & IORING_FEAT_SINGLE_MMAP) != 0;
+    if (single_mmap && cq_ring_size_ > sq_ring_size_) {
+        sq_ring_size_ = cq_ring_size_;
+    }
+
+    sq_ring_ = mmap(nullptr, sq_ring_size_, PROT_READ | PROT_WRITE, MAP_SHARED | MAP_POPULATE,
+                    fd, IORING_OFF_SQ_RING);
+    if (sq_ring_ == MAP_FAILED) {
+        sq_ring_ = nullptr;
+        return fail();
+    }
+    if (single_mmap) {
+        cq_ring_ = sq_ring_;
+    } else {
+        cq_ring_ = mmap(nullptr, cq_ring_size_, PROT_READ | PROT_WRITE, MAP_SHARED | MAP_POPULATE,
+                        fd, IORING_OFF_CQ_RING);
+        if (cq_ring_ == MAP_FAILED) {
+            cq_ring_ = nullptr;
+            return fail();
+        }
+    }
+    sqes_size_ = p.sq_entries * sizeof(io_uring_sqe);
+    void *sqes = mmap(nullptr, sqes_size_, PROT_READ | PROT_WRITE, MAP_SHARED | MAP_POPULATE,
+                      fd, IORING_OFF_SQES);
+    if (sqes == MAP_FAILED) {
+        return fail();
+    }
+    sqes_ = static_cast<io_uring_sqe*>(sqes);
+
+    char *sq = static_cast<char*>(sq_ring_);
+    sq_head_ = reinterpret_cast<unsigned*>(sq + p.sq_off.head);
+    sq_tail_ = reinterpret_cast<unsigned*>(sq + p.sq_off.tail);
+    sq_mask_ = reinterpret_cast<unsigned*>(sq + p.sq_off.ring_mask);
+    sq_array_ = reinterpret_cast<unsigned*>(sq + p.sq_off.array);
+
+    char *cq = static_cast<char*>(cq_ring_);
+    cq_head_ = reinterpret_cast<unsigned*>(cq + p.cq_off.head);
+    cq_tail_ = reinterpret_cast<unsigned*>(cq + p.cq_off.tail);
+    cq_mask_ = reinterpret_cast<unsigned*>(cq + p.cq_off.ring_mask);
+    cqes_ = reinterpret_cast<io_uring_cqe*>(cq + p.cq_off.cqes);
+
+    sqe_tail_ = sqe_submitted_ = *sq_tail_;
+    return true;
+}
+
+io_uring_sqe *IoUring::get_sqe() {
+    unsigned head = __atomic_load_n(sq_head_, __ATOMIC_ACQUIRE);
+    if (sqe_tail_ - head >= sq_entries_) {
+        return nullptr;
+    }
+    io_uring_sqe *sqe = &sqes_[sqe_tail_ & *sq_mask_];
+    sqe_tail_++;
+    memset(sqe, 0, sizeof(*sqe));
+    return sqe;
+}
+
+int IoUring::submit_and_wait(unsigned wait_nr) {
+    unsigned to_submit = sqe_tail_ - sqe_submitted_;
+    for (unsigned i = sqe_submitted_; i != sqe_tail_; ++i) {
+        sq_array_[i & *sq_mask_] = i & *sq_mask_;
+    }
+    // Publish the new entries before the kernel can observe the tail
+    __atomic_store_n(sq_tail_, sqe_tail_, __ATOMIC_RELEASE);
+    sqe_submitted_ = sqe_tail_;
+    return enter(to_submit, wait_nr);
+}
+
+int IoUring::wait(unsigned wait_nr) {
+    int r = enter(0, wait_nr);
+    return r < 0 ? r : 0;
+}
+
+unsigned IoUring::unconsumed() const {
+    return sqe_tail_ - __atomic_load_n(sq_head_, __ATOMIC_ACQUIRE);
+}
+
+int IoUring::enter(unsigned to_submit, unsigned wait_nr) {
+    unsigned flags = wait_nr > 0 ? IORING_ENTER_GETEVENTS : 0;
+    for (;;) {
+        stats_syscall(SYS_URING);
+        long r = syscall(__NR_io_uring_enter, ring_fd_, to_submit, wait_nr, flags, nullptr, 0);
+        if (r >= 0) {
+            return static_cast<int>(r);
+        }
+        if (errno != EINTR) {
+            return -errno;
+        }
+        // Interrupted: the entries were consumed already, only keep waiting
+        to_submit = 0;
+    }
+}
+
+io_uring_cqe *IoUring::peek_cqe() {
+    unsigned head = *cq_head_;
+    unsigned tail = __atomic_load_n(cq_tail_, __ATOMIC_ACQUIRE);
+    if (head == tail) {
+        return nullptr;
+    }
+    return &cqes_[head & *cq_mask_];
+}
+
+void IoUring::cqe_seen() {
+    __atomic_store_n(cq_head_, *cq_head_ + 1, __ATOMIC_RELEASE);
+}
+
+void IoUring::prep_openat(io_uring_sqe *sqe, const char *path, int flags, mode_t mode, uint64_t user_data) {
+    sqe->opcode = IORING_OP_OPENAT;
+    sqe->fd = AT_FDCWD;
+    sqe->addr = reinterpret_cast<uint64_t>(path);
+    sqe->len = mode;
+    sqe->open_flags = static_cast<uint32_t>(flags);
+    sqe->user_data = user_data;
+}
+
+void IoUring::prep_statx(io_uring_sqe *sqe, const char *path, struct statx *buf, uint64_t user_data) {
+    sqe->opcode = IORING_OP_STATX;
+    sqe->fd = AT_FDCWD;
+    sqe->addr = reinterpret_cast<uint64_t>(path);
+    sqe->len = STATX_TYPE | STATX_SIZE;
+    sqe->off = reinterpret_cast<uint64_t>(buf);
+    sqe->statx_flags = 0;
+    sqe->user_data = user_data;
+}
+
+void IoUring::prep_read(io_uring_sqe *sqe, int fd, void *buf, unsigned len, uint64_t offset, uint64_t user_data) {
+    sqe->opcode = IORING_OP_READ;
+    sqe->fd = fd;
+    sqe->addr = reinterpret_cast<uint64_t>(buf);
+    sqe->len = len;
+    sqe->off = offset;
+    sqe->user_data = user_data;
+}
+
+void IoUring::prep_write(io_uring_sqe *sqe, int fd, const void *buf, unsigned len, uint64_t offset, uint64_t user_data) {
+    sqe->opcode = IORING_OP_WRITE;
+    sqe->fd = fd;
+    sqe->addr = reinterpret_cast<uint64_t>(buf);
+    sqe->len = len;
+    sqe->off = offset;
+    sqe->user_data = user_data;
+}
+
+void IoUring::prep_close(io_uring_sqe *sqe, int fd, uint64_t user_data) {
+    sqe->opcode = IORING_OP_CLOSE;
+    sqe->fd = fd;
+    sqe->user_data = user_data;
+}
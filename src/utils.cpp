@@ -1,40 +1,369 @@
 #include "utils.h"
+#include "stats.h"
 
+#include <algorithm>
+#include <atomic>
 #include <pthread.h>
+#include <sched.h>
 #include <stdio.h>
 #include <stdarg.h>
+#include <stdlib.h>
 #include <string.h>
+#include <strings.h>
+#include <time.h>
 #include <unistd.h>
+#include <sys/random.h>
 #include <sys/stat.h>
 #include <sys/types.h>
 #include <errno.h>
 
-static pthread_mutex_t log_mutex = PTHREAD_MUTEX_INITIALIZER;
+// Logging: each thread formats its messages into a ring of its own, without
+// locks, and a background thread drains every ring, restores the order in
+// which the messages were produced and writes them out in batches (one
+// write() per stream and pass). A message is held back while one produced
+// before it is still being copied into its ring, so the output follows the
+// production order across passes too. Until init_logging() starts that
+// thread, and after shutdown_logging() stops it, messages are written
+// directly.
 
-void init_logging() {
-    // nothing for now; mutex already initialized
+static const size_t LOG_RING_SIZE = 64 * 1024;      // Per thread, power of two
+static const size_t LOG_MAX_MESSAGE = 16 * 1024;    // Longer messages are cut
+static const int LOG_DRAIN_INTERVAL_MS = 20;        // Idle drainer wakes this often
+static const uint64_t LOG_NO_CLAIM = UINT64_MAX;
+
+struct LogRecordHeader {
+    uint64_t seq;
+    uint32_t len;
+    uint32_t level;
+};
+
+// Single producer (the owning thread), single consumer (the drainer)
+struct LogRing {
+    char data[LOG_RING_SIZE];
+    std::atomic<uint64_t> head{0};     // Bytes published by the producer
+    std::atomic<uint64_t> tail{0};     // Bytes consumed by the drainer
+    std::atomic<bool> in_use{true};    // Owned by a live thread
+    // While the producer copies a record in: a lower bound of its sequence
+    // number. LOG_NO_CLAIM otherwise.
+    std::atomic<uint64_t> claim{LOG_NO_CLAIM};
+    LogRing *next = nullptr;
+};
+
+static std::atomic<int> log_level{LOG_INFO};
+static std::atomic<uint64_t> log_seq{0};
+static std::atomic<LogRing*> log_rings{nullptr}; // Never shrinks; free rings are reused
+static std::atomic<bool> log_async{false};
+static std::atomic<bool> log_wake{false};
+static bool log_stop = false;
+static pthread_t log_thread;
+static pthread_mutex_t log_mutex = PTHREAD_MUTEX_INITIALIZER; // Drainer sleep and direct writes
+static pthread_cond_t log_cv = PTHREAD_COND_INITIALIZER;
+
+static const char *const LOG_PREFIX[] = {"[ERROR] ", "[WARN] ", "[INFO] ", "[DEBUG] "};
+
+static int log_stream(int level) {
+    return level <= LOG_WARN ? STDERR_FILENO : STDOUT_FILENO;
 }
 
-void log_info(const char *fmt, ...) {
+// Not safe_write_loop: the logger's own writes are not part of --stats
+static void log_write_all(int fd, const char *p, size_t n) {
+    while (n > 0) {
+        ssize_t w = write(fd, p, n);
+        if (w < 0 && errno == EINTR) continue;
+        if (w <= 0) return;
+        p += w;
+        n -= static_cast<size_t>(w);
+    }
+}
+
+// Releases the thread's ring for reuse when the thread exits
+struct LogRingOwner {
+    LogRing *ring = nullptr;
+    ~LogRingOwner() {
+        if (ring) {
+            ring->in_use.store(false, std::memory_order_release);
+        }
+    }
+};
+static thread_local LogRingOwner tls_log_ring;
+
+static LogRing *acquire_log_ring() {
+    for (LogRing *r = log_rings.load(std::memory_order_acquire); r; r = r->next) {
+        bool free_ring = false;
+        if (r->in_use.compare_exchange_strong(free_ring, true, std::memory_order_acq_rel)) {
+            return r;
+        }
+    }
+    LogRing *r = new LogRing();
+    r->next = log_rings.load(std::memory_order_relaxed);
+    while (!log_rings.compare_exchange_weak(r->next, r, std::memory_order_release, std::memory_order_relaxed)) {
+    }
+    return r;
+}
+
+static void wake_drainer() {
+    if (!log_wake.exchange(true)) {
+        pthread_mutex_lock(&log_mutex);
+        pthread_cond_signal(&log_cv);
+        pthread_mutex_unlock(&log_mutex);
+    }
+}
+
+static void ring_copy_in(LogRing *r, uint64_t pos, const void *src, size_t n) {
+    size_t at = static_cast<size_t>(pos & (LOG_RING_SIZE - 1));
+    size_t first = n < LOG_RING_SIZE - at ? n : LOG_RING_SIZE - at;
+    memcpy(r->data + at, src, first);
+    memcpy(r->data, static_cast<const char*>(src) + first, n - first);
+}
+
+static void ring_copy_out(const LogRing *r, uint64_t pos, void *dst, size_t n) {
+    size_t at = static_cast<size_t>(pos & (LOG_RING_SIZE - 1));
+    size_t first = n < LOG_RING_SIZE - at ? n : LOG_RING_SIZE - at;
+    memcpy(dst, r->data + at, first);
+    memcpy(static_cast<char*>(dst) + first, r->data, n - first);
+}
+
+// Append one record to this thread's ring, waiting for the drainer while the
+// ring is full. Returns false when the drainer is not running.
+static bool log_enqueue(int level, const char *msg, size_t len) {
+    if (!log_async.load(std::memory_order_acquire)) {
+        return false;
+    }
+    LogRing *r = tls_log_ring.ring;
+    if (!r) {
+        r = tls_log_ring.ring = acquire_log_ring();
+    }
+    LogRecordHeader h;
+    // The claim is set before the number is drawn (both sequentially
+    // consistent), so the drainer never misses a record being written
+    r->claim.store(log_seq.load());
+    h.seq = log_seq.fetch_add(1);
+    h.len = static_cast<uint32_t>(len);
+    h.level = static_cast<uint32_t>(level);
+    size_t need = sizeof(h) + len;
+    uint64_t head = r->head.load(std::memory_order_relaxed);
+    while (head + need - r->tail.load(std::memory_order_acquire) > LOG_RING_SIZE) {
+        if (!log_async.load(std::memory_order_acquire)) {
+            r->claim.store(LOG_NO_CLAIM);
+            return false;
+        }
+        wake_drainer();
+        sched_yield();
+    }
+    ring_copy_in(r, head, &h, sizeof(h));
+    ring_copy_in(r, head + sizeof(h), msg, len);
+    r->head.store(head + need, std::memory_order_release);
+    r->claim.store(LOG_NO_CLAIM);
+    // Errors go out promptly; otherwise the drainer is only woken early when
+    // the ring fills up
+    if (level == LOG_ERROR || head + need - r->tail.load(std::memory_order_relaxed) > LOG_RING_SIZE / 2) {
+        wake_drainer();
+    }
+    return true;
+}
+
+struct LogPending {
+    uint64_t seq;
+    int level;
+    size_t offset;   // Into the drainer's text buffer
+    size_t len;
+};
+
+// Move everything published so far out of the rings and write it in
+// production order. Messages numbered at or above the lowest claim still
+// held are kept in pending for a later pass, unless this is the final one.
+// Only the drainer calls this. Returns whether anything was written.
+static bool drain_log_rings(std::vector<LogPending> &pending, std::string &text, std::string &out,
+                            bool final_pass) {
+    // Every message numbered below ready is published by the time its ring
+    // is read below
+    uint64_t ready = final_pass ? LOG_NO_CLAIM : log_seq.load();
+    for (LogRing *r = log_rings.load(std::memory_order_acquire); r; r = r->next) {
+        uint64_t claim = r->claim.load();
+        ready = claim < ready ? claim : ready;
+    }
+    for (LogRing *r = log_rings.load(std::memory_order_acquire); r; r = r->next) {
+        uint64_t tail = r->tail.load(std::memory_order_relaxed);
+        uint64_t head = r->head.load(std::memory_order_acquire);
+        while (tail < head) {
+            LogRecordHeader h;
+            ring_copy_out(r, tail, &h, sizeof(h));
+            size_t at = text.size();
+            text.resize(at + h.len);
+            ring_copy_out(r, tail + sizeof(h), &text[at], h.len);
+            pending.push_back(LogPending{h.seq, static_cast<int>(h.level), at, h.len});
+            tail += sizeof(h) + h.len;
+        }
+        r->tail.store(tail, std::memory_order_release);
+    }
+    std::sort(pending.begin(), pending.end(),
+              [](const LogPending &a, const LogPending &b) { return a.seq < b.seq; });
+    size_t n = 0;
+    while (n < pending.size() && pending[n].seq < ready) {
+        ++n;
+    }
+    if (n == 0) {
+        return false;
+    }
+
+    // Consecutive lines for the same stream become one write
+    out.clear();
+    int fd = log_stream(pending.front().level);
+    for (size_t i = 0; i < n; ++i) {
+        const LogPending &p = pending[i];
+        if (log_stream(p.level) != fd) {
+            log_write_all(fd, out.data(), out.size());
+            out.clear();
+            fd = log_stream(p.level);
+        }
+        out += LOG_PREFIX[p.level];
+        out.append(text, p.offset, p.len);
+        out += '\n';
+    }
+    log_write_all(fd, out.data(), out.size());
+
+    // Keep the held-back messages, compacted to the front of text
+    std::string rest;
+    for (size_t i = n; i < pending.size(); ++i) {
+        LogPending &p = pending[i];
+        size_t at = rest.size();
+        rest.append(text, p.offset, p.len);
+        p.offset = at;
+    }
+    pending.erase(pending.begin(), pending.begin() + static_cast<ptrdiff_t>(n));
+    text.swap(rest);
+    return true;
+}
+
+static void *log_drainer(void *) {
+    std::vector<LogPending> pending;
+    std::string text, out;
+    for (;;) {
+        log_wake.store(false);
+        if (drain_log_rings(pending, text, out, false)) {
+            continue;
+        }
+        pthread_mutex_lock(&log_mutex);
+        if (log_stop) {
+            pthread_mutex_unlock(&log_mutex);
+            break;
+        }
+        if (!log_wake.load()) {
+            struct timespec until;
+            clock_gettime(CLOCK_REALTIME, &until);
+            until.tv_nsec += LOG_DRAIN_INTERVAL_MS * 1000000L;
+            if (until.tv_nsec >= 1000000000L) {
+                until.tv_sec++;
+                until.tv_nsec -= 1000000000L;
+            }
+            pthread_cond_timedwait(&log_cv, &log_mutex, &until);
+        }
+        pthread_mutex_unlock(&log_mutex);
+    }
+    // Producers may have published after the last empty pass. New messages
+    // are written directly by now; let those already being queued finish.
+    for (LogRing *r = log_rings.load(std::memory_order_acquire); r; r = r->next) {
+        while (r->claim.load() != LOG_NO_CLAIM) {
+            sched_yield();
+        }
+    }
+    drain_log_rings(pending, text, out, true);
+    return nullptr;
+}
+
+bool parse_log_level(const char *name, LogLevel &level) {
+    static const char *const names[] = {"error", "warn", "info", "debug"};
+    for (int i = LOG_ERROR; i <= LOG_DEBUG; ++i) {
+        if (strcasecmp(name, names[i]) == 0) {
+            level = static_cast<LogLevel>(i);
+            return true;
+        }
+    }
+    return false;
+}
+
+void init_logging(LogLevel level) {
+    log_level.store(level);
+    if (log_async.load()) {
+        return;
+    }
+    log_stop = false;
+    if (pthread_create(&log_thread, nullptr, log_drainer, nullptr) != 0) {
+        return; // Keep writing directly
+    }
+    log_async.store(true, std::memory_order_release);
+    atexit(shutdown_logging);
+}
+
+void shutdown_logging() {
+    if (!log_async.exchange(false)) {
+        return;
+    }
+    pthread_mutex_lock(&log_mutex);
+    log_stop = true;
+    pthread_cond_signal(&log_cv);
+    pthread_mutex_unlock(&log_mutex);
+    pthread_join(log_thread, nullptr);
+}
+
+static void log_message(int level, const char *fmt, va_list ap) {
+    if (level > log_level.load(std::memory_order_relaxed)) {
+        return;
+    }
+    char small[1024];
+    std::string large;
+    va_list copy;
+    va_copy(copy, ap);
+    int n = vsnprintf(small, sizeof(small), fmt, copy);
+    va_end(copy);
+    if (n < 0) {
+        return;
+    }
+    const char *msg = small;
+    size_t len = static_cast<size_t>(n);
+    if (len >= sizeof(small)) {
+        len = len < LOG_MAX_MESSAGE ? len : LOG_MAX_MESSAGE;
+        large.resize(len + 1);
+        vsnprintf(&large[0], len + 1, fmt, ap);
+        msg = large.data();
+    }
+    if (log_enqueue(level, msg, len)) {
+        return;
+    }
+    std::string line = LOG_PREFIX[level];
+    line.append(msg, len);
+    line += '\n';
     pthread_mutex_lock(&log_mutex);
+    log_write_all(log_stream(level), line.data(), line.size());
+    pthread_mutex_unlock(&log_mutex);
+}
+
+void log_error(const char *fmt, ...) {
     va_list ap;
     va_start(ap, fmt);
-    fprintf(stdout, "[INFO] ");
-    vfprintf(stdout, fmt, ap);
-    fprintf(stdout, "\n");
+    log_message(LOG_ERROR, fmt, ap);
     va_end(ap);
-    pthread_mutex_unlock(&log_mutex);
 }
 
-void log_error(const char *fmt, ...) {
-    pthread_mutex_lock(&log_mutex);
+void log_warn(const char *fmt, ...) {
     va_list ap;
     va_start(ap, fmt);
-    fprintf(stderr, "[ERROR] ");
-    vfprintf(stderr, fmt, ap);
-    fprintf(stderr, "\n");
+    log_message(LOG_WARN, fmt, ap);
+    va_end(ap);
+}
+
+void log_info(const char *fmt, ...) {
+    va_list ap;
+    va_start(ap, fmt);
+    log_message(LOG_INFO, fmt, ap);
+    va_end(ap);
+}
+
+void log_debug(const char *fmt, ...) {
+    va_list ap;
+    va_start(ap, fmt);
+    log_message(LOG_DEBUG, fmt, ap);
     va_end(ap);
-    pthread_mutex_unlock(&log_mutex);
 }
 
 std::string path_join(const std::string &a, const std::string &b) {
@@ -89,9 +418,11 @@ bool create_directory_recursive(const std::string &path) {
 }
 
 ssize_t safe_read_loop(int fd, void *buf, size_t count) {
+    StageTimer timer(STAGE_READ);
     ssize_t total = 0;
     char *p = static_cast<char*>(buf);
     while ((size_t)total < count) {
+        stats_syscall(SYS_READ);
         ssize_t r = read(fd, p + total, count - total);
         if (r < 0) return r;
         if (r == 0) break;
@@ -101,12 +432,161 @@ ssize_t safe_read_loop(int fd, void *buf, size_t count) {
 }
 
 ssize_t safe_write_loop(int fd, const void *buf, size_t count) {
+    StageTimer timer(STAGE_WRITE);
     ssize_t total = 0;
     const char *p = static_cast<const char*>(buf);
     while ((size_t)total < count) {
+        stats_syscall(SYS_WRITE);
         ssize_t w = write(fd, p + total, count - total);
         if (w < 0) return w;
         total += w;
     }
     return total;
 }
+
+ssize_t safe_pread_loop(int fd, void *buf, size_t count, off_t offset) {
+    StageTimer timer(STAGE_READ);
+    ssize_t total = 0;
+    char *p = static_cast<char*>(buf);
+    while ((size_t)total < count) {
+        stats_syscall(SYS_READ);
+        ssize_t r = pread(fd, p + total, count - total, offset + total);
+        if (r < 0) {
+            if (errno == EINTR) continue;
+            return r;
+        }
+        if (r == 0) break;
+        total += r;
+    }
+    return total;
+}
+
+ssize_t safe_pwrite_loop(int fd, const void *buf, size_t count, off_t offset) {
+    StageTimer timer(STAGE_WRITE);
+    ssize_t total = 0;
+    const char *p = static_cast<const char*>(buf);
+    while ((size_t)total < count) {
+        stats_syscall(SYS_WRITE);
+        ssize_t w = pwrite(fd, p + total, count - total, offset + total);
+        if (w < 0) {
+            if (errno == EINTR) continue;
+            return w;
+        }
+        total += w;
+    }
+    return total;
+}
+
+// XXH64 primes
+static const uint64_t XXH_P1 = 0x9E3779B185EBCA87ULL;
+static const uint64_t XXH_P2 = 0xC2B2AE3D27D4EB4FULL;
+static const uint64_t XXH_P3 = 0x165667B19E3779F9ULL;
+static const uint64_t XXH_P4 = 0x85EBCA77C2B2AE63ULL;
+static const uint64_t XXH_P5 = 0x27D4EB2F165667C5ULL;
+
+static uint64_t rotl64(uint64_t x, int r) {
+    return (x << r) | (x >> (64 - r));
+}
+
+static uint64_t load64(const uint8_t *p) {
+    uint64_t v;
+    memcpy(&v, p, 8);
+    return v;
+}
+
+static uint32_t load32(const uint8_t *p) {
+    uint32_t v;
+    memcpy(&v, p, 4);
+    return v;
+}
+
+static uint64_t xxh_round(uint64_t acc, uint64_t input) {
+    acc += input * XXH_P2;
+    acc = rotl64(acc, 31);
+    return acc * XXH_P1;
+}
+
+static uint64_t xxh_merge(uint64_t acc, uint64_t val) {
+    acc ^= xxh_round(0, val);
+    return acc * XXH_P1 + XXH_P4;
+}
+
+uint64_t hash64(const void *data, size_t len, uint64_t seed) {
+    const uint8_t *p = static_cast<const uint8_t*>(data);
+    const uint8_t *end = p + len;
+    uint64_t h;
+    if (len >= 32) {
+        uint64_t v1 = seed + XXH_P1 + XXH_P2, v2 = seed + XXH_P2, v3 = seed, v4 = seed - XXH_P1;
+        const uint8_t *limit = end - 32;
+        do {
+            v1 = xxh_round(v1, load64(p));
+            v2 = xxh_round(v2, load64(p + 8));
+            v3 = xxh_round(v3, load64(p + 16));
+            v4 = xxh_round(v4, load64(p + 24));
+            p += 32;
+        } while (p <= limit);
+        h = rotl64(v1, 1) + rotl64(v2, 7) + rotl64(v3, 12) + rotl64(v4, 18);
+        h = xxh_merge(h, v1);
+        h = xxh_merge(h, v2);
+        h = xxh_merge(h, v3);
+        h = xxh_merge(h, v4);
+    } else {
+        h = seed + XXH_P5;
+    }
+    h += len;
+    for (; p + 8 <= end; p += 8) {
+        h ^= xxh_round(0, load64(p));
+        h = rotl64(h, 27) * XXH_P1 + XXH_P4;
+    }
+    if (p + 4 <= end) {
+        h ^= static_cast<uint64_t>(load32(p)) * XXH_P1;
+        h = rotl64(h, 23) * XXH_P2 + XXH_P3;
+        p += 4;
+    }
+    for (; p < end; ++p) {
+        h ^= *p * XXH_P5;
+        h = rotl64(h, 11) * XXH_P1;
+    }
+    h ^= h >> 33;
+    h *= XXH_P2;
+    h ^= h >> 29;
+    h *= XXH_P3;
+    h ^= h >> 32;
+    return h;
+}
+
+uint64_t random_u64() {
+    uint64_t v = 0;
+    if (getrandom(&v, sizeof(v), 0) != static_cast<ssize_t>(sizeof(v))) {
+        // No getrandom(): the clock still tells salts and identifiers apart
+        struct timespec ts;
+        clock_gettime(CLOCK_REALTIME, &ts);
+        v = hash64(&ts, sizeof(ts), static_cast<uint64_t>(getpid()));
+    }
+    return v;
+}
+
+// Enough rounds that testing a guessed key takes milliseconds, not nanoseconds
+static const unsigned KEY_TAG_ROUNDS = 1u << 20;
+
+static std::string key_tag_with_salt(const std::string &key, uint64_t salt) {
+    uint64_t h = salt;
+    for (unsigned i = 0; i < KEY_TAG_ROUNDS; ++i) {
+        h = hash64(key.data(), key.size(), h);
+    }
+    char tag[34];
+    snprintf(tag, sizeof(tag), "%016llx.%016llx", static_cast<unsigned long long>(salt),
+             static_cast<unsigned long long>(h));
+    return tag;
+}
+
+std::string make_key_tag(const std::string &key) {
+    return key_tag_with_salt(key, random_u64());
+}
+
+bool key_tag_matches(const std::string &tag, const std::string &key) {
+    if (tag.size() != 33 || tag[16] != '.') {
+        return false;
+    }
+    return key_tag_with_salt(key, strtoull(tag.substr(0, 16).c_str(), nullptr, 16)) == tag;
+}
@@ -1,286 +1,1137 @@
 #include "worker.h"
 #include "file_manager.h"
 #include "utils.h"
+#include "thread_pool.h"
+#include "uring_io.h"
+#include "simd_kernels.h"
+#include "container.h"
+#include "codec.h"
+#include "buffer_pool.h"
+#include "chunk_store.h"
+#include "stats.h"
 
+#include <algorithm>
+#include <atomic>
 #include <vector>
 #include <iostream>
 #include <sys/stat.h>
+#include <fcntl.h>
+#include <unistd.h>
 #include <errno.h>
+#include <stdio.h>
 #include <string.h>
 #include <stdexcept>
 
-// RLE Compression: encode sequences as [count][byte] pairs
-// Handles runs > 255 by splitting into multiple runs
-static std::vector<uint8_t> compress_rle(const std::vector<uint8_t> &in) {
-    if (in.empty()) {
-        return in;
+// Files at least this large are split into chunks that idle pool workers can
+// steal. Chunk size is even so RLE [count][byte] pairs never straddle chunks.
+static const size_t PARALLEL_CHUNK_SIZE = 4 * 1024 * 1024;
+static const uint64_t PARALLEL_MIN_FILE_SIZE = 2 * PARALLEL_CHUNK_SIZE;
+
+// Compress and/or encrypt write a container; every other operation decodes.
+static bool is_encoding(const Options &opts) {
+    return opts.do_compress || (opts.do_encrypt && !opts.do_decompress);
+}
+
+// Only a cipher (or nothing) runs: the data keeps its size, so it can be
+// transformed in the buffer it was read into
+static bool is_cipher_only(const Options &opts) {
+    return !opts.do_compress && !opts.do_decompress;
+}
+
+// Whether the requested operation can be computed on independent input chunks.
+// Only headerless inputs from older versions are decoded here: differential
+// decoding is a running sum over the output and framed codecs do not line up
+// with fixed input offsets, so only CODEC_CHUNKABLE decoders are split.
+static bool operation_is_chunkable(const Options &opts) {
+    if (opts.do_decompress && !opts.do_compress) {
+        return opts.pipeline.codec->has(CODEC_CHUNKABLE);
     }
-    
-    std::vector<uint8_t> out;
-    out.reserve(in.size()); // Reserve space, may grow if compression is effective
-    
-    uint8_t prev = in[0];
-    unsigned int run = 1;
-    
-    for (size_t i = 1; i < in.size(); ++i) {
-        uint8_t current = in[i];
-        
-        if (current == prev && run < 255) {
-            // Continue the run
-            ++run;
-        } else {
-            // Write the current run and start a new one
-            // Split runs > 255 into multiple runs of 255
-            while (run > 255) {
-                out.push_back(255);
-                out.push_back(prev);
-                run -= 255;
-            }
-            if (run > 0) {
-                out.push_back(static_cast<uint8_t>(run));
-                out.push_back(prev);
+    return true;
+}
+
+// Builds the container around the stored chunks of one output file. On disk
+// the header is written first with placeholder sizes and rewritten once the
+// index is known.
+struct ContainerWriter {
+    ContainerHeader header;
+    std::vector<ChunkEntry> chunks;
+    uint64_t pos = 0; // Output bytes so far, header included
+};
+
+static void container_init(const Options &opts, ContainerWriter &cw) {
+    if (opts.do_compress) {
+        cw.header.flags |= CONTAINER_COMPRESSED;
+        cw.header.comp_alg = opts.pipeline.codec->name();
+    }
+    if (opts.do_encrypt) {
+        cw.header.flags |= CONTAINER_ENCRYPTED;
+        cw.header.enc_alg = opts.pipeline.cipher->name();
+    }
+    cw.pos = container_header_size(cw.header);
+}
+
+// crc is the CRC32C of the original bytes, taken before any in-place stage
+static void container_add_chunk(ContainerWriter &cw, size_t stored_len, size_t original_len, uint32_t crc) {
+    ChunkEntry c;
+    c.stored_len = static_cast<uint32_t>(stored_len);
+    c.original_len = static_cast<uint32_t>(original_len);
+    c.crc = crc;
+    c.stored_offset = cw.pos;
+    c.original_offset = cw.header.original_size;
+    cw.chunks.push_back(c);
+    cw.pos += stored_len;
+    cw.header.original_size += original_len;
+}
+
+// Fill in the header fields that depend on the chunks
+static void container_seal(ContainerWriter &cw) {
+    cw.header.index_offset = cw.pos;
+    cw.header.chunk_count = static_cast<uint32_t>(cw.chunks.size());
+}
+
+static bool container_begin(OutputStream &out, const ContainerWriter &cw) {
+    std::vector<uint8_t> bytes;
+    serialize_header(cw.header, bytes);
+    return write_block(out, bytes.data(), bytes.size());
+}
+
+// Append the index and write the final header over the placeholder
+static bool container_finish(OutputStream &out, ContainerWriter &cw) {
+    container_seal(cw);
+    std::vector<uint8_t> bytes;
+    serialize_index(cw.chunks, bytes);
+    if (!write_block(out, bytes.data(), bytes.size())) {
+        return false;
+    }
+    bytes.clear();
+    serialize_header(cw.header, bytes);
+    return write_block_at(out, bytes.data(), bytes.size(), 0);
+}
+
+// Header and index of a container input, with the stages it names
+struct ContainerReader {
+    ContainerHeader header;
+    size_t header_size = 0;
+    std::vector<ChunkEntry> chunks;
+    std::shared_ptr<const Codec> codec;   // Set when CONTAINER_COMPRESSED
+    std::shared_ptr<const Cipher> cipher; // Set when CONTAINER_ENCRYPTED
+    int store_fd = -1;                    // Chunk store of a CONTAINER_DEDUP container
+
+    ContainerReader() = default;
+    ContainerReader(const ContainerReader &) = delete;
+    ContainerReader &operator=(const ContainerReader &) = delete;
+    ~ContainerReader() {
+        if (store_fd >= 0) {
+            stats_syscall(SYS_CLOSE);
+            close(store_fd);
+        }
+    }
+};
+
+// Read and verify the header and index, from memory when mapped is set and
+// through fd otherwise, and check that this run can undo every stage.
+static bool load_container(const WorkerArgs *w, const uint8_t *mapped, int fd, uint64_t file_size,
+                           ContainerReader &cr) {
+    const char *file = w->input_file.c_str();
+    std::string err;
+
+    std::vector<uint8_t> buf;
+    size_t head_len = file_size < CONTAINER_MAX_HEADER ? static_cast<size_t>(file_size) : CONTAINER_MAX_HEADER;
+    const uint8_t *head = mapped;
+    if (!mapped) {
+        buf.resize(head_len);
+        ssize_t r = safe_pread_loop(fd, buf.data(), head_len, 0);
+        if (r < 0 || static_cast<size_t>(r) != head_len) {
+            log_error("File '%s': Failed to read container header: %s", file, r < 0 ? strerror(errno) : "short read");
+            return false;
+        }
+        head = buf.data();
+    }
+    if (!parse_header(head, head_len, cr.header, cr.header_size, err)) {
+        log_error("File '%s': Invalid container: %s", file, err.c_str());
+        return false;
+    }
+
+    const ContainerHeader &h = cr.header;
+    size_t index_len = container_index_size(h.chunk_count);
+    if (h.index_offset > file_size || file_size - h.index_offset != index_len) {
+        log_error("File '%s': Invalid container: file is truncated or has trailing data", file);
+        return false;
+    }
+    const uint8_t *index = mapped ? mapped + h.index_offset : nullptr;
+    if (!mapped) {
+        buf.resize(index_len);
+        ssize_t r = safe_pread_loop(fd, buf.data(), index_len, static_cast<off_t>(h.index_offset));
+        if (r < 0 || static_cast<size_t>(r) != index_len) {
+            log_error("File '%s': Failed to read container index: %s", file, r < 0 ? strerror(errno) : "short read");
+            return false;
+        }
+        index = buf.data();
+    }
+    if (!parse_index(index, index_len, h, cr.header_size, cr.chunks, err)) {
+        log_error("File '%s': Invalid container: %s", file, err.c_str());
+        return false;
+    }
+
+    if (h.flags & CONTAINER_COMPRESSED) {
+        cr.codec = make_codec(h.comp_alg, w->opts.lz_window, err);
+        if (!cr.codec) {
+            log_error("File '%s': Container uses unknown compression algorithm '%s'", file, h.comp_alg.c_str());
+            return false;
+        }
+    }
+    if (h.flags & CONTAINER_ENCRYPTED) {
+        if (w->key.empty()) {
+            log_error("File '%s': Container is encrypted (%s); decryption requires a key (-k option)",
+                     file, h.enc_alg.c_str());
+            return false;
+        }
+        cr.cipher = make_cipher(h.enc_alg, w->key, err);
+        if (!cr.cipher) {
+            log_error("File '%s': Container uses unknown encryption algorithm '%s'", file, h.enc_alg.c_str());
+            return false;
+        }
+    }
+    if (h.flags & CONTAINER_DEDUP) {
+        std::string store = find_chunk_store(w->input_file, w->opts.chunk_store_path);
+        if (store.empty()) {
+            log_error("File '%s': Deduplicated container and no chunk store found next to it (use --chunk-store)",
+                     file);
+            return false;
+        }
+        cr.store_fd = open_chunk_store(store, err);
+        if (cr.store_fd < 0) {
+            log_error("File '%s': Failed to open chunk store '%s': %s", file, store.c_str(), err.c_str());
+            return false;
+        }
+    }
+    return true;
+}
+
+// A deduplicated container holds a reference in place of each chunk: read the
+// stored bytes it names from the chunk store into buf and describe them in c
+// and key_pos as decode_chunk expects.
+static bool fetch_stored_chunk(const WorkerArgs *w, const ContainerReader &cr, const uint8_t *ref_bytes,
+                               ChunkEntry &c, uint64_t &key_pos, std::vector<uint8_t> &buf) {
+    ChunkRef ref = parse_chunk_ref(ref_bytes);
+    buf.resize(ref.stored_len);
+    ssize_t r = safe_pread_loop(cr.store_fd, buf.data(), ref.stored_len, static_cast<off_t>(ref.offset));
+    if (r < 0 || static_cast<size_t>(r) != ref.stored_len) {
+        log_error("File '%s': Failed to read chunk at store offset %llu: %s", w->input_file.c_str(),
+                 static_cast<unsigned long long>(ref.offset), r < 0 ? strerror(errno) : "chunk store is truncated");
+        return false;
+    }
+    c.stored_len = ref.stored_len;
+    key_pos = ref.offset;
+    return true;
+}
+
+// Undo every stage recorded in the header for one chunk and verify the result
+// against the index. Chunks share no state, so any chunk decodes on its own.
+// stored_mut is stored itself when the caller's copy may be decrypted in
+// place, null otherwise; stored may also already be out (cipher-only
+// containers read straight into the output buffer). key_pos is the key
+// position of the stored bytes: their offset within the data section, or in
+// the chunk store for a deduplicated container.
+static bool decode_chunk(const WorkerArgs *w, const ContainerReader &cr, const ChunkEntry &c, uint64_t key_pos,
+                         const uint8_t *stored, uint8_t *stored_mut, std::vector<uint8_t> &out) {
+    const ContainerHeader &h = cr.header;
+    const uint8_t *data = stored;
+    PooledBuffer copy;
+    if (h.flags & CONTAINER_ENCRYPTED) {
+        uint8_t *buf = stored_mut;
+        if (!(h.flags & CONTAINER_COMPRESSED)) {
+            if (stored != out.data()) {
+                out.assign(stored, stored + c.stored_len);
             }
-            prev = current;
-            run = 1;
+            buf = out.data();
+        } else if (!buf) {
+            copy->assign(stored, stored + c.stored_len);
+            buf = copy->data();
         }
+        StageTimer timer(STAGE_DECRYPT);
+        cr.cipher->decrypt(buf, c.stored_len, key_pos);
+        data = buf;
     }
-    
-    // Write the final run
-    while (run > 255) {
-        out.push_back(255);
-        out.push_back(prev);
-        run -= 255;
+    if (h.flags & CONTAINER_COMPRESSED) {
+        DecodeState ds;
+        bool decoded;
+        {
+            StageTimer timer(STAGE_DECOMPRESS);
+            decoded = cr.codec->decode(data, c.stored_len, ds, out);
+        }
+        if (!decoded || !ds.idle()) {
+            log_error("File '%s': Decompression failed for chunk at offset %llu (corrupt data or wrong key)",
+                     w->input_file.c_str(), static_cast<unsigned long long>(c.original_offset));
+            return false;
+        }
+    } else if (data != out.data()) {
+        out.assign(data, data + c.stored_len);
     }
-    if (run > 0) {
-        out.push_back(static_cast<uint8_t>(run));
-        out.push_back(prev);
+
+    if (out.size() != c.original_len || simd_crc32c(0, out.data(), out.size()) != c.crc) {
+        log_error("File '%s': Checksum mismatch for chunk at offset %llu (corrupt data or wrong key)",
+                 w->input_file.c_str(), static_cast<unsigned long long>(c.original_offset));
+        return false;
     }
-    
-    return out;
+    return true;
 }
 
-// RLE Decompression: read [count][byte] pairs and expand
-static std::vector<uint8_t> decompress_rle(const std::vector<uint8_t> &in) {
-    if (in.empty()) {
-        return in;
+// stored is the number of stored bytes decoded, which for a deduplicated
+// container were read from the chunk store
+static void log_container_summary(const WorkerArgs *w, const ContainerReader &cr, size_t chunks,
+                                  uint64_t stored_bytes, uint64_t original_bytes) {
+    const ContainerHeader &h = cr.header;
+    unsigned long long stored = stored_bytes;
+    if (h.flags & CONTAINER_DEDUP) {
+        log_info("File '%s': Read %zu chunk(s) from the chunk store", w->input_file.c_str(), chunks);
     }
-    
-    // RLE format requires pairs, so input must be even length
-    if (in.size() % 2 != 0) {
-        log_error("Invalid RLE data: odd number of bytes");
-        return std::vector<uint8_t>();
+    if (h.flags & CONTAINER_ENCRYPTED) {
+        log_info("File '%s': Decrypted %llu bytes using %s cipher", 
+                w->input_file.c_str(), stored, h.enc_alg.c_str());
     }
-    
-    std::vector<uint8_t> out;
-    // Estimate output size (may be larger if compression was effective)
-    out.reserve(in.size() * 2);
-    
-    for (size_t i = 0; i < in.size(); i += 2) {
-        uint8_t count = in[i];
-        uint8_t value = in[i + 1];
-        
-        // Expand: write 'count' copies of 'value'
-        out.insert(out.end(), count, value);
+    if (h.flags & CONTAINER_COMPRESSED) {
+        log_info("File '%s': Decompressed %llu bytes to %llu bytes (%s)", w->input_file.c_str(),
+                stored, static_cast<unsigned long long>(original_bytes), h.comp_alg.c_str());
     }
-    
-    return out;
 }
 
-// Differential Encoding Compression: store differences between consecutive bytes
-// First byte is stored as-is, subsequent bytes store the difference from previous byte
-// Differences are encoded as signed values in range [-128, +127] stored in 1 byte
-static std::vector<uint8_t> compress_differential(const std::vector<uint8_t> &in) {
-    if (in.empty()) {
-        return in;
+// Whether the file at path starts with the container magic
+static bool input_is_container(const std::string &path) {
+    stats_syscall(SYS_OPEN);
+    int fd = open(path.c_str(), O_RDONLY | O_CLOEXEC);
+    if (fd < 0) {
+        return false;
     }
-    
-    std::vector<uint8_t> out;
-    out.reserve(in.size());
-    
-    // First byte is stored as-is
-    out.push_back(in[0]);
-    
-    // For each subsequent byte, store the difference from the previous byte
-    for (size_t i = 1; i < in.size(); ++i) {
-        int diff = static_cast<int>(in[i]) - static_cast<int>(in[i - 1]);
-        
-        // Clamp difference to [-128, +127] range
-        // If difference is outside range, we need to handle it
-        // For simplicity, we'll clamp it (this may cause some loss for extreme cases)
-        if (diff < -128) diff = -128;
-        if (diff > 127) diff = 127;
-        
-        // Convert signed difference to unsigned byte: add 128 to shift range to [0, 255]
-        uint8_t encoded_diff = static_cast<uint8_t>(diff + 128);
-        out.push_back(encoded_diff);
+    uint8_t magic[CONTAINER_MIN_HEADER];
+    ssize_t r = safe_pread_loop(fd, magic, sizeof(magic), 0);
+    stats_syscall(SYS_CLOSE);
+    close(fd);
+    return r > 0 && is_container(magic, static_cast<size_t>(r));
+}
+
+// Consecutive chunks of a container decoded by one task: runs of about
+// PARALLEL_CHUNK_SIZE original bytes, so containers of small chunks do not
+// pay a task per chunk and large files still spread over the pool.
+struct ContainerDecodeJob {
+    const WorkerArgs *w = nullptr;
+    const ContainerReader *cr = nullptr;
+    const uint8_t *mapped = nullptr; // Whole container when mmap'ed, else chunks are pread from fd
+    int fd = -1;
+    OutputStream *out = nullptr;
+    size_t first = 0;                // Chunks [first, last) of the index
+    size_t last = 0;
+    uint64_t range_start = 0;        // Part of the original bytes to write, at
+    uint64_t range_end = 0;          // output offset 0 onwards (--range)
+    std::atomic<bool> *failed = nullptr; // Shared: set by the first job to fail, stops the others
+    uint64_t stored_bytes = 0;
+    bool ok = false;
+};
+
+// Decode a run of chunks and write each one at its offset in the output,
+// which the index gives, so jobs may finish in any order. Chunks at the ends
+// of a --range are cut to it.
+static void *container_decode_task(void *arg) {
+    ContainerDecodeJob *job = static_cast<ContainerDecodeJob*>(arg);
+    const WorkerArgs *w = job->w;
+    const ContainerReader &cr = *job->cr;
+    StatsScope scope(w->stats);
+
+    // Without compression the chunk is decrypted where it is read. Chunks of
+    // a deduplicated container are read from the store, never from the map.
+    PooledBuffer result_buf, stored_buf;
+    size_t max_stored = 0, max_original = 0;
+    for (size_t i = job->first; i < job->last; ++i) {
+        const ChunkEntry &c = cr.chunks[i];
+        max_stored = c.stored_len > max_stored ? c.stored_len : max_stored;
+        max_original = c.original_len > max_original ? c.original_len : max_original;
     }
-    
-    return out;
+    bool compressed = cr.header.flags & CONTAINER_COMPRESSED;
+    bool dedup = cr.header.flags & CONTAINER_DEDUP;
+    result_buf.reserve(max_original);
+    if (compressed && (!job->mapped || dedup)) {
+        stored_buf.reserve(dedup ? max_original : max_stored);
+    }
+    std::vector<uint8_t> &result = *result_buf;
+    std::vector<uint8_t> &stored = compressed ? *stored_buf : result;
+    try {
+        for (size_t i = job->first; i < job->last; ++i) {
+            if (job->failed->load(std::memory_order_relaxed)) {
+                return nullptr;
+            }
+            ChunkEntry c = cr.chunks[i];
+            uint64_t key_pos = c.stored_offset - cr.header_size;
+            const uint8_t *p = job->mapped ? job->mapped + c.stored_offset : nullptr;
+            if (!job->mapped) {
+                stored.resize(c.stored_len);
+                ssize_t r = safe_pread_loop(job->fd, stored.data(), c.stored_len, static_cast<off_t>(c.stored_offset));
+                if (r < 0 || static_cast<size_t>(r) != c.stored_len) {
+                    log_error("File '%s': Failed to read chunk at offset %llu: %s", w->input_file.c_str(),
+                             static_cast<unsigned long long>(c.stored_offset), r < 0 ? strerror(errno) : "short read");
+                    job->failed->store(true);
+                    return nullptr;
+                }
+                p = stored.data();
+            }
+            uint8_t *p_mut = job->mapped ? nullptr : stored.data();
+            if (dedup) {
+                if (!fetch_stored_chunk(w, cr, p, c, key_pos, stored)) {
+                    job->failed->store(true);
+                    return nullptr;
+                }
+                p = p_mut = stored.data();
+            }
+            job->stored_bytes += c.stored_len;
+            if (!decode_chunk(w, cr, c, key_pos, p, p_mut, result)) {
+                job->failed->store(true);
+                return nullptr;
+            }
+            uint64_t chunk_end = c.original_offset + c.original_len;
+            uint64_t from = c.original_offset > job->range_start ? c.original_offset : job->range_start;
+            uint64_t to = chunk_end < job->range_end ? chunk_end : job->range_end;
+            if (!write_block_at(*job->out, result.data() + (from - c.original_offset), static_cast<size_t>(to - from),
+                                from - job->range_start)) {
+                job->failed->store(true);
+                return nullptr;
+            }
+        }
+    } catch (const std::exception &e) {
+        log_error("File '%s': Exception during processing: %s", w->input_file.c_str(), e.what());
+        job->failed->store(true);
+        return nullptr;
+    }
+    job->ok = true;
+    return nullptr;
 }
 
-// Differential Encoding Decompression: reconstruct original data from differences
-static std::vector<uint8_t> decompress_differential(const std::vector<uint8_t> &in) {
-    if (in.empty()) {
-        return in;
+// Decode a container, or with --range only the chunks that overlap the
+// range. The output size is known from the header, so the output file is
+// reserved up front and every chunk is written straight to its final offset;
+// runs of chunks are decoded in parallel on the pool.
+static bool process_container(WorkerArgs *w, uint64_t file_size) {
+    MappedFile map;
+    bool use_map = w->opts.io_mode == "mmap" && map_input_file(w->input_file, map);
+    if (use_map && map.size != file_size) {
+        unmap_input_file(map);
+        use_map = false;
     }
-    
-    if (in.size() < 1) {
-        log_error("Invalid differential data: too short");
-        return std::vector<uint8_t>();
+    InputStream in;
+    if (!use_map && !open_input_stream(w->input_file, in)) {
+        return false;
     }
-    
-    std::vector<uint8_t> out;
-    out.reserve(in.size());
-    
-    // First byte is stored as-is
-    out.push_back(in[0]);
-    uint8_t prev = in[0];
-    
-    // Reconstruct subsequent bytes from differences
-    for (size_t i = 1; i < in.size(); ++i) {
-        // Convert encoded difference back to signed: subtract 128
-        int diff = static_cast<int>(in[i]) - 128;
-        
-        // Reconstruct current byte: previous + difference
-        int current = static_cast<int>(prev) + diff;
-        
-        // Handle wraparound (modulo 256)
-        if (current < 0) current += 256;
-        if (current > 255) current -= 256;
-        
-        uint8_t byte = static_cast<uint8_t>(current);
-        out.push_back(byte);
-        prev = byte;
+
+    ContainerReader cr;
+    if (!load_container(w, map.data, in.fd, file_size, cr)) {
+        unmap_input_file(map);
+        close_input_stream(in);
+        return false;
     }
-    
-    return out;
+    uint64_t range_start = 0, range_end = cr.header.original_size;
+    if (w->opts.range) {
+        if (w->opts.range_offset > cr.header.original_size) {
+            log_error("File '%s': Range starts at %llu, past the end of its %llu bytes", w->input_file.c_str(),
+                     static_cast<unsigned long long>(w->opts.range_offset),
+                     static_cast<unsigned long long>(cr.header.original_size));
+            unmap_input_file(map);
+            close_input_stream(in);
+            return false;
+        }
+        uint64_t left = cr.header.original_size - w->opts.range_offset;
+        range_start = w->opts.range_offset;
+        range_end = range_start + (w->opts.range_length < left ? w->opts.range_length : left);
+    }
+    OutputStream out;
+    if (!open_output_stream(w->output_file, out)) {
+        unmap_input_file(map);
+        close_input_stream(in);
+        return false;
+    }
+    preallocate_output_stream(out, range_end - range_start);
+
+    // Chunks [first, last) overlap the range; chunks are in original order
+    size_t first = std::upper_bound(cr.chunks.begin(), cr.chunks.end(), range_start,
+                                    [](uint64_t pos, const ChunkEntry &c) {
+                                        return pos < c.original_offset + c.original_len;
+                                    }) - cr.chunks.begin();
+    size_t last = first;
+    while (last < cr.chunks.size() && cr.chunks[last].original_offset < range_end) {
+        last++;
+    }
+
+    std::atomic<bool> failed{false};
+    std::vector<ContainerDecodeJob> jobs;
+    for (size_t i = first; i < last;) {
+        ContainerDecodeJob job;
+        job.w = w;
+        job.cr = &cr;
+        job.mapped = map.data;
+        job.fd = in.fd;
+        job.out = &out;
+        job.failed = &failed;
+        job.range_start = range_start;
+        job.range_end = range_end;
+        job.first = i;
+        uint64_t bytes = 0;
+        while (i < last && (i == job.first || bytes + cr.chunks[i].original_len <= PARALLEL_CHUNK_SIZE)) {
+            bytes += cr.chunks[i++].original_len;
+        }
+        job.last = i;
+        jobs.push_back(job);
+    }
+
+    if (w->pool && w->pool->size() > 1 && jobs.size() > 1) {
+        log_info("File '%s': Decoding %zu chunk(s) as %zu parallel tasks", w->input_file.c_str(),
+                last - first, jobs.size());
+        TaskGroup group;
+        for (ContainerDecodeJob &job : jobs) {
+            w->pool->submit(container_decode_task, &job, nullptr, &group);
+        }
+        w->pool->wait_group(group);
+    } else {
+        for (ContainerDecodeJob &job : jobs) {
+            container_decode_task(&job);
+        }
+    }
+    bool ok = true;
+    uint64_t stored_total = 0;
+    for (const ContainerDecodeJob &job : jobs) {
+        ok = ok && job.ok;
+        stored_total += job.stored_bytes;
+    }
+    unmap_input_file(map);
+    close_input_stream(in);
+
+    if (!ok) {
+        abort_output_stream(out);
+        return false;
+    }
+    if (!commit_output_stream(out)) {
+        return false;
+    }
+    uint64_t decoded_bytes = 0;
+    for (size_t i = first; i < last; ++i) {
+        decoded_bytes += cr.chunks[i].original_len;
+    }
+    log_container_summary(w, cr, last - first, stored_total, decoded_bytes);
+    if (w->opts.range) {
+        log_info("File '%s': Extracted %llu bytes at offset %llu (%zu of %u chunk(s) decoded)", w->input_file.c_str(),
+                static_cast<unsigned long long>(range_end - range_start),
+                static_cast<unsigned long long>(range_start), last - first, cr.header.chunk_count);
+    }
+    return true;
 }
 
-// Vigenère encryption: add key byte to data byte modulo 256
-static std::vector<uint8_t> encrypt_vigenere(const std::vector<uint8_t> &data, const std::string &key) {
-    std::vector<uint8_t> out;
-    out.reserve(data.size());
-    
-    for (size_t i = 0; i < data.size(); ++i) {
-        uint8_t key_byte = static_cast<uint8_t>(key[i % key.length()]);
-        uint8_t encrypted = (data[i] + key_byte) % 256;
-        out.push_back(encrypted);
+struct ChunkJob {
+    const WorkerArgs *w = nullptr;
+    int fd = -1;
+    const uint8_t *mapped = nullptr; // Whole input when mmap'ed, else chunks are pread
+    uint64_t offset = 0;     // Position of the chunk in the input file
+    size_t length = 0;
+    uint64_t out_offset = 0; // Position of out in the output stream
+    PooledBuffer out;
+    uint32_t crc = 0;        // CRC32C of the input chunk, for the container index
+    bool ok = false;
+};
+
+// Phase 1: read the chunk and apply every stage whose state depends only on the
+// input position (compress, decrypt+decompress, encrypt-only, decrypt-only).
+static void *chunk_transform_task(void *arg) {
+    ChunkJob *job = static_cast<ChunkJob*>(arg);
+    const WorkerArgs *w = job->w;
+    const Options &opts = w->opts;
+    StatsScope scope(w->stats);
+
+    // A cipher-only chunk is read straight into its output and transformed
+    // there; otherwise reads go to a pooled buffer, which the
+    // decrypt+decompress path may then decrypt in place
+    bool cipher_only = is_cipher_only(opts);
+    std::vector<uint8_t> &out = *job->out;
+    PooledBuffer input;
+    std::vector<uint8_t> &buf = cipher_only ? out : *input;
+    const uint8_t *data;
+    uint8_t *data_mut = nullptr;
+    size_t len = job->length;
+    if (job->mapped) {
+        data = job->mapped + job->offset;
+    } else {
+        if (!cipher_only) {
+            input.reserve(len);
+        }
+        buf.resize(len);
+        ssize_t r = safe_pread_loop(job->fd, buf.data(), len, static_cast<off_t>(job->offset));
+        if (r < 0 || static_cast<size_t>(r) != len) {
+            log_error("File '%s': Failed to read chunk at offset %llu: %s", w->input_file.c_str(),
+                     static_cast<unsigned long long>(job->offset), r < 0 ? strerror(errno) : "short read");
+            return nullptr;
+        }
+        data = data_mut = buf.data();
     }
-    
-    return out;
+
+    const Pipeline &p = opts.pipeline;
+    bool ok = true;
+    if (is_encoding(opts)) {
+        job->crc = simd_crc32c(0, data, len);
+    }
+    if (opts.do_compress) {
+        StageTimer timer(STAGE_COMPRESS);
+        p.codec->encode(data, len, out);
+    } else if (opts.do_decompress) {
+        DecodeState ds;
+        if (opts.do_decrypt) {
+            if (!data_mut) {
+                input->assign(data, data + len);
+                data = data_mut = input->data();
+            }
+            StageTimer timer(STAGE_DECRYPT);
+            p.cipher->decrypt(data_mut, len, job->offset);
+        }
+        StageTimer timer(STAGE_DECOMPRESS);
+        ok = p.codec->decode(data, len, ds, out);
+    } else {
+        if (data != out.data()) {
+            out.assign(data, data + len);
+        }
+        if (opts.do_encrypt) {
+            StageTimer timer(STAGE_ENCRYPT);
+            p.cipher->encrypt(out.data(), len, job->offset);
+        } else if (opts.do_decrypt) {
+            StageTimer timer(STAGE_DECRYPT);
+            p.cipher->decrypt(out.data(), len, job->offset);
+        }
+    }
+
+    if (!ok || out.empty()) {
+        log_error("File '%s': Processing failed for chunk at offset %llu", w->input_file.c_str(),
+                 static_cast<unsigned long long>(job->offset));
+        return nullptr;
+    }
+    job->ok = true;
+    return nullptr;
 }
 
-// Vigenère decryption: subtract key byte from data byte modulo 256
-static std::vector<uint8_t> decrypt_vigenere(const std::vector<uint8_t> &data, const std::string &key) {
-    std::vector<uint8_t> out;
-    out.reserve(data.size());
-    
-    for (size_t i = 0; i < data.size(); ++i) {
-        uint8_t key_byte = static_cast<uint8_t>(key[i % key.length()]);
-        // Add 256 before modulo to handle negative values correctly
-        uint8_t decrypted = (data[i] - key_byte + 256) % 256;
-        out.push_back(decrypted);
+// Phase 2 (compress + encrypt only): the key position of each compressed chunk
+// is known once every chunk's compressed size is.
+static void *chunk_encrypt_task(void *arg) {
+    ChunkJob *job = static_cast<ChunkJob*>(arg);
+    StatsScope scope(job->w->stats);
+    StageTimer timer(STAGE_ENCRYPT);
+    job->w->opts.pipeline.cipher->encrypt(job->out->data(), job->out->size(), job->out_offset);
+    return nullptr;
+}
+
+// Process one large file as independent chunks scheduled on the worker pool.
+// Chunks are dispatched in windows of a few per worker and each window is
+// written in order before the next is read, which bounds memory per file.
+// When encoding, every chunk becomes one entry of the container index.
+static bool process_file_chunked(WorkerArgs *w, uint64_t file_size) {
+    InputStream in;
+    if (!open_input_stream(w->input_file, in)) {
+        return false;
     }
-    
-    return out;
+    OutputStream out;
+    if (!open_output_stream(w->output_file, out)) {
+        close_input_stream(in);
+        return false;
+    }
+    MappedFile map;
+    if (w->opts.io_mode == "mmap" && map_input_file(w->input_file, map) && map.size != file_size) {
+        // File changed size since stat(); fall back to pread on the descriptor
+        unmap_input_file(map);
+    }
+
+    size_t num_chunks = static_cast<size_t>((file_size + PARALLEL_CHUNK_SIZE - 1) / PARALLEL_CHUNK_SIZE);
+    size_t window = 2 * w->pool->size();
+    log_info("File '%s': Processing %llu bytes as %zu parallel chunks", w->input_file.c_str(),
+            static_cast<unsigned long long>(file_size), num_chunks);
+
+    bool encoding = is_encoding(w->opts);
+    ContainerWriter cw;
+    container_init(w->opts, cw);
+    bool ok = !encoding || container_begin(out, cw);
+    uint64_t total_out = 0;
+    std::vector<ChunkJob> jobs;
+    for (size_t first = 0; ok && first < num_chunks; first += window) {
+        size_t count = num_chunks - first < window ? num_chunks - first : window;
+        // Jobs, and the pooled output buffers they hold, are reused from
+        // window to window
+        jobs.resize(count);
+
+        TaskGroup group;
+        for (size_t i = 0; i < count; ++i) {
+            jobs[i].ok = false;
+            jobs[i].w = w;
+            jobs[i].fd = in.fd;
+            jobs[i].mapped = map.data;
+            jobs[i].offset = static_cast<uint64_t>(first + i) * PARALLEL_CHUNK_SIZE;
+            uint64_t remaining = file_size - jobs[i].offset;
+            jobs[i].length = remaining < PARALLEL_CHUNK_SIZE ? static_cast<size_t>(remaining) : PARALLEL_CHUNK_SIZE;
+            jobs[i].out.reserve(jobs[i].length);
+            w->pool->submit(chunk_transform_task, &jobs[i], nullptr, &group);
+        }
+        w->pool->wait_group(group);
+        for (const ChunkJob &job : jobs) {
+            ok = ok && job.ok;
+        }
+
+        if (ok && w->opts.do_compress && w->opts.do_encrypt) {
+            uint64_t pos = total_out;
+            for (ChunkJob &job : jobs) {
+                job.out_offset = pos;
+                pos += job.out->size();
+                w->pool->submit(chunk_encrypt_task, &job, nullptr, &group);
+            }
+            w->pool->wait_group(group);
+        }
+
+        for (size_t i = 0; ok && i < count; ++i) {
+            const std::vector<uint8_t> &data = *jobs[i].out;
+            ok = write_block(out, data.data(), data.size());
+            total_out += data.size();
+            if (encoding) {
+                container_add_chunk(cw, data.size(), jobs[i].length, jobs[i].crc);
+            }
+        }
+    }
+    ok = ok && (!encoding || container_finish(out, cw));
+    unmap_input_file(map);
+    close_input_stream(in);
+
+    if (!ok) {
+        abort_output_stream(out);
+        return false;
+    }
+    if (!commit_output_stream(out)) {
+        return false;
+    }
+
+    log_info("File '%s': Wrote %llu bytes from %zu chunks", w->input_file.c_str(),
+            static_cast<unsigned long long>(total_out), num_chunks);
+    return true;
 }
 
-// XOR encryption: simple XOR with key
-static std::vector<uint8_t> encrypt_xor(const std::vector<uint8_t> &data, const std::string &key) {
-    std::vector<uint8_t> out;
-    out.reserve(data.size());
-    
-    for (size_t i = 0; i < data.size(); ++i) {
-        uint8_t key_byte = static_cast<uint8_t>(key[i % key.length()]);
-        out.push_back(data[i] ^ key_byte);
+// Block size of the serial streaming pipeline. Even, so RLE pairs stay whole.
+static const size_t STREAM_BLOCK_SIZE = 1024 * 1024;
+
+// Position of a streaming pipeline between two blocks.
+struct StreamState {
+    uint64_t in_pos = 0;   // Bytes consumed from the input
+    uint64_t out_pos = 0;  // Bytes produced to the output
+    uint64_t mid_pos = 0;  // Bytes between the two stages of a combined operation
+    DecodeState decode;    // Decompressor state between blocks
+};
+
+// Apply the requested stages to one block of the stream, carrying the state
+// (key position, previous byte) that lets the next block continue seamlessly.
+// When encoding, the output is one self-contained container chunk.
+// in_mut is in itself when the caller's buffer may be decrypted in place,
+// null otherwise. For cipher-only operations in may already be out.data(), in
+// which case the block is transformed without any copy.
+static bool transform_block(const WorkerArgs *w, StreamState &state, const uint8_t *in, uint8_t *in_mut,
+                            size_t len, std::vector<uint8_t> &out) {
+    const Options &opts = w->opts;
+    const Pipeline &p = opts.pipeline;
+
+    if (opts.do_compress) {
+        {
+            StageTimer timer(STAGE_COMPRESS);
+            p.codec->encode(in, len, out);
+        }
+        if (out.empty()) {
+            log_error("File '%s': Compression failed (empty output)", w->input_file.c_str());
+            return false;
+        }
+        state.mid_pos += out.size();
+        if (opts.do_encrypt) {
+            StageTimer timer(STAGE_ENCRYPT);
+            p.cipher->encrypt(out.data(), out.size(), state.out_pos);
+        }
+    } else if (opts.do_decompress) {
+        PooledBuffer copy;
+        if (opts.do_decrypt) {
+            if (!in_mut) {
+                copy->assign(in, in + len);
+                in_mut = copy->data();
+            }
+            StageTimer timer(STAGE_DECRYPT);
+            p.cipher->decrypt(in_mut, len, state.in_pos);
+            state.mid_pos += len;
+            in = in_mut;
+        }
+        bool decoded;
+        {
+            StageTimer timer(STAGE_DECOMPRESS);
+            decoded = p.codec->decode(in, len, state.decode, out);
+        }
+        if (!decoded) {
+            log_error("File '%s': Decompression failed (invalid compressed data or empty output)", 
+                     w->input_file.c_str());
+            return false;
+        }
+    } else {
+        if (in == out.data()) {
+            out.resize(len);
+        } else {
+            out.assign(in, in + len);
+        }
+        if (opts.do_encrypt) {
+            StageTimer timer(STAGE_ENCRYPT);
+            p.cipher->encrypt(out.data(), len, state.in_pos);
+        } else if (opts.do_decrypt) {
+            StageTimer timer(STAGE_DECRYPT);
+            p.cipher->decrypt(out.data(), len, state.in_pos);
+        }
     }
-    
-    return out;
+
+    state.in_pos += len;
+    state.out_pos += out.size();
+    return true;
 }
 
-// XOR decryption: symmetric (XOR is its own inverse)
-static std::vector<uint8_t> decrypt_xor(const std::vector<uint8_t> &data, const std::string &key) {
-    return encrypt_xor(data, key); // XOR is symmetric
+// Called after the last block: a decoder must not be left mid-frame
+static bool finish_stream(const WorkerArgs *w, const StreamState &state) {
+    if (!state.decode.idle()) {
+        log_error("File '%s': Decompression failed (truncated compressed data)", w->input_file.c_str());
+        return false;
+    }
+    return true;
 }
 
-// Select encryption algorithm based on algorithm name
-static std::vector<uint8_t> encrypt_data(const std::vector<uint8_t> &data, const std::string &key, const std::string &algorithm) {
-    std::string alg = algorithm;
-    // Convert to lowercase for case-insensitive comparison
-    for (char &c : alg) {
-        if (c >= 'A' && c <= 'Z') {
-            c = c - 'A' + 'a';
+// Per-stage byte counts once a file has gone through the pipeline
+static void log_stream_summary(const WorkerArgs *w, const StreamState &state) {
+    const Options &opts = w->opts;
+    unsigned long long in_bytes = state.in_pos, mid_bytes = state.mid_pos, out_bytes = state.out_pos;
+    if (state.in_pos == 0) {
+        log_info("File '%s' is empty, skipping processing", w->input_file.c_str());
+    } else if (opts.do_compress) {
+        log_info("File '%s': Compressed %llu bytes to %llu bytes (%s)", 
+                w->input_file.c_str(), in_bytes, mid_bytes, opts.comp_alg.c_str());
+        if (opts.do_encrypt) {
+            log_info("File '%s': Encrypted %llu bytes using %s cipher", 
+                    w->input_file.c_str(), mid_bytes, opts.enc_alg.c_str());
+        }
+    } else if (opts.do_decompress) {
+        if (opts.do_decrypt) {
+            log_info("File '%s': Decrypted %llu bytes using %s cipher", 
+                    w->input_file.c_str(), in_bytes, opts.enc_alg.c_str());
+            in_bytes = mid_bytes;
         }
+        log_info("File '%s': Decompressed %llu bytes to %llu bytes (%s)", 
+                w->input_file.c_str(), in_bytes, out_bytes, opts.comp_alg.c_str());
+    } else if (opts.do_encrypt) {
+        log_info("File '%s': Encrypted %llu bytes using %s cipher", 
+                w->input_file.c_str(), in_bytes, opts.enc_alg.c_str());
+    } else if (opts.do_decrypt) {
+        log_info("File '%s': Decrypted %llu bytes using %s cipher", 
+                w->input_file.c_str(), in_bytes, opts.enc_alg.c_str());
     }
-    
-    if (alg.empty() || alg == "vigenere") {
-        return encrypt_vigenere(data, key);
-    } else if (alg == "xor") {
-        return encrypt_xor(data, key);
-    } else {
-        // Unknown algorithm - return empty vector (error will be handled by caller)
-        return std::vector<uint8_t>();
+}
+
+// Transform one block and append it to the output, recording it as a
+// container chunk when encoding (cw set)
+static bool stream_block(const WorkerArgs *w, StreamState &state, ContainerWriter *cw, OutputStream &out,
+                         const uint8_t *in, uint8_t *in_mut, size_t len, std::vector<uint8_t> &result) {
+    uint32_t crc = cw ? simd_crc32c(0, in, len) : 0;
+    if (!transform_block(w, state, in, in_mut, len, result)) {
+        return false;
+    }
+    if (cw) {
+        container_add_chunk(*cw, result.size(), len, crc);
     }
+    return write_block(out, result.data(), result.size());
 }
 
-// Select decryption algorithm based on algorithm name
-static std::vector<uint8_t> decrypt_data(const std::vector<uint8_t> &data, const std::string &key, const std::string &algorithm) {
-    std::string alg = algorithm;
-    // Convert to lowercase for case-insensitive comparison
-    for (char &c : alg) {
-        if (c >= 'A' && c <= 'Z') {
-            c = c - 'A' + 'a';
+// Serial pipeline: read -> compress/decrypt -> encrypt/decompress -> write on
+// fixed-size blocks, so memory per worker does not depend on the file size.
+// In mmap mode the blocks are slices of the mapping and are never copied;
+// files that cannot be mapped fall back to read() into a block buffer (the
+// output buffer itself for cipher-only operations, which then run in place).
+// Both buffers come from this thread's pool.
+static bool process_file_streaming(WorkerArgs *w) {
+    MappedFile map;
+    bool use_map = w->opts.io_mode == "mmap" && map_input_file(w->input_file, map);
+
+    InputStream in;
+    if (!use_map && !open_input_stream(w->input_file, in)) {
+        return false;
+    }
+    OutputStream out;
+    if (!open_output_stream(w->output_file, out)) {
+        unmap_input_file(map);
+        close_input_stream(in);
+        return false;
+    }
+
+    bool cipher_only = is_cipher_only(w->opts);
+    PooledBuffer result_buf, block_buf;
+    result_buf.reserve(STREAM_BLOCK_SIZE);
+    if (!use_map && !cipher_only) {
+        block_buf.reserve(STREAM_BLOCK_SIZE);
+    }
+    std::vector<uint8_t> &result = *result_buf;
+    std::vector<uint8_t> &block = cipher_only ? result : *block_buf;
+    StreamState state;
+    ContainerWriter container;
+    ContainerWriter *cw = is_encoding(w->opts) ? &container : nullptr;
+    if (cw) {
+        container_init(w->opts, container);
+    }
+    bool ok = !cw || container_begin(out, container);
+
+    try {
+        for (size_t pos = 0; ok && use_map && pos < map.size; pos += STREAM_BLOCK_SIZE) {
+            size_t len = map.size - pos < STREAM_BLOCK_SIZE ? map.size - pos : STREAM_BLOCK_SIZE;
+            if (!stream_block(w, state, cw, out, map.data + pos, nullptr, len, result)) {
+                ok = false;
+                break;
+            }
         }
+        while (ok && !use_map) {
+            block.resize(STREAM_BLOCK_SIZE);
+            ssize_t r = read_block(in, block.data(), STREAM_BLOCK_SIZE);
+            if (r < 0) {
+                ok = false;
+                break;
+            }
+            if (r == 0) {
+                break;
+            }
+            if (!stream_block(w, state, cw, out, block.data(), block.data(), static_cast<size_t>(r), result)) {
+                ok = false;
+                break;
+            }
+            if (static_cast<size_t>(r) < STREAM_BLOCK_SIZE) {
+                break;
+            }
+        }
+        ok = ok && finish_stream(w, state) && (!cw || container_finish(out, container));
+    } catch (const std::exception &e) {
+        log_error("File '%s': Exception during processing: %s", w->input_file.c_str(), e.what());
+        ok = false;
+    } catch (...) {
+        log_error("File '%s': Unknown exception during processing", w->input_file.c_str());
+        ok = false;
     }
-    
-    if (alg.empty() || alg == "vigenere") {
-        return decrypt_vigenere(data, key);
-    } else if (alg == "xor") {
-        return decrypt_xor(data, key);
-    } else {
-        // Unknown algorithm - return empty vector (error will be handled by caller)
-        return std::vector<uint8_t>();
+    unmap_input_file(map);
+    close_input_stream(in);
+
+    if (!ok) {
+        abort_output_stream(out);
+        return false;
     }
+    if (!commit_output_stream(out)) {
+        log_error("File '%s': Failed to write output to '%s'", 
+                 w->input_file.c_str(), w->output_file.c_str());
+        return false;
+    }
+
+    log_stream_summary(w, state);
+    return true;
 }
 
-// Select compression algorithm based on algorithm name
-static std::vector<uint8_t> compress_data(const std::vector<uint8_t> &data, const std::string &algorithm) {
-    std::string alg = algorithm;
-    // Convert to lowercase for case-insensitive comparison
-    for (char &c : alg) {
-        if (c >= 'A' && c <= 'Z') {
-            c = c - 'A' + 'a';
+// Chunk references are written out in runs of about this many bytes
+static const size_t DEDUP_REF_FLUSH = 64 * 1024;
+
+// What one file contributed to the chunk store
+struct DedupCounts {
+    size_t chunks = 0;
+    size_t added = 0;        // Chunks this file stored first
+    uint64_t added_bytes = 0;
+};
+
+// Reference one content-defined chunk from the container, storing it first if
+// the store does not hold it yet. Only new chunks are compressed and
+// encrypted; the key position of an encrypted chunk is its store offset.
+static bool dedup_chunk(const WorkerArgs *w, ContainerWriter &cw, const uint8_t *data, size_t len,
+                        std::vector<uint8_t> &stored, std::vector<uint8_t> &refs, DedupCounts &counts) {
+    const Pipeline &p = w->opts.pipeline;
+    uint32_t crc;
+    ChunkKey key;
+    ChunkRef ref;
+    bool found;
+    {
+        StageTimer timer(STAGE_DEDUP);
+        crc = simd_crc32c(0, data, len);
+        key = make_chunk_key(data, len, crc);
+        found = w->store->find(key, ref);
+    }
+    if (!found) {
+        if (w->opts.do_compress) {
+            StageTimer timer(STAGE_COMPRESS);
+            p.codec->encode(data, len, stored);
+            if (stored.empty()) {
+                log_error("File '%s': Compression failed (empty output)", w->input_file.c_str());
+                return false;
+            }
+        } else {
+            stored.assign(data, data + len);
+        }
+        if (w->store->reserve(key, static_cast<uint32_t>(stored.size()), ref)) {
+            if (w->opts.do_encrypt) {
+                StageTimer timer(STAGE_ENCRYPT);
+                p.cipher->encrypt(stored.data(), stored.size(), ref.offset);
+            }
+            if (!w->store->write(key, ref, stored.data())) {
+                return false;
+            }
+            counts.added++;
+            counts.added_bytes += stored.size();
         }
     }
-    
-    if (alg.empty() || alg == "rle") {
-        return compress_rle(data);
-    } else if (alg == "diff") {
-        return compress_differential(data);
-    } else {
-        // Unknown algorithm - return empty vector (error will be handled by caller)
-        return std::vector<uint8_t>();
+    serialize_chunk_ref(ref, refs);
+    container_add_chunk(cw, CONTAINER_CHUNK_REF_SIZE, len, crc);
+    counts.chunks++;
+    return true;
+}
+
+// --dedup: cut the input into content-defined chunks and keep each distinct
+// chunk once in the shared chunk store. The output is a container whose data
+// section references the store in place of every chunk. Unmapped inputs are
+// read in blocks, carrying over the tail that may not yet hold a whole chunk
+// so the boundaries are the same as for a mapped input.
+static bool process_file_dedup(WorkerArgs *w) {
+    MappedFile map;
+    bool use_map = w->opts.io_mode == "mmap" && map_input_file(w->input_file, map);
+    InputStream in;
+    if (!use_map && !open_input_stream(w->input_file, in)) {
+        return false;
+    }
+    OutputStream out;
+    if (!open_output_stream(w->output_file, out)) {
+        unmap_input_file(map);
+        close_input_stream(in);
+        return false;
+    }
+
+    PooledBuffer block_buf, stored_buf, refs_buf;
+    stored_buf.reserve(CDC_MAX_SIZE);
+    refs_buf.reserve(DEDUP_REF_FLUSH + CONTAINER_CHUNK_REF_SIZE);
+    if (!use_map) {
+        block_buf.reserve(STREAM_BLOCK_SIZE);
     }
+    std::vector<uint8_t> &block = *block_buf;
+    std::vector<uint8_t> &refs = *refs_buf;
+    const uint8_t *data = map.data;
+    size_t avail = map.size, pos = 0;
+    bool eof = use_map;
+
+    ContainerWriter cw;
+    container_init(w->opts, cw);
+    cw.header.flags |= CONTAINER_DEDUP;
+    DedupCounts counts;
+    bool ok = container_begin(out, cw);
+    try {
+        while (ok) {
+            if (!eof && avail - pos < CDC_MAX_SIZE) {
+                block.erase(block.begin(), block.begin() + static_cast<ptrdiff_t>(pos));
+                size_t have = block.size();
+                block.resize(STREAM_BLOCK_SIZE);
+                ssize_t r = read_block(in, block.data() + have, STREAM_BLOCK_SIZE - have);
+                if (r < 0) {
+                    ok = false;
+                    break;
+                }
+                eof = static_cast<size_t>(r) < STREAM_BLOCK_SIZE - have;
+                block.resize(have + static_cast<size_t>(r));
+                data = block.data();
+                avail = block.size();
+                pos = 0;
+            }
+            if (pos == avail) {
+                break;
+            }
+            size_t len;
+            {
+                StageTimer timer(STAGE_DEDUP);
+                len = cdc_next_boundary(data + pos, avail - pos);
+            }
+            ok = dedup_chunk(w, cw, data + pos, len, *stored_buf, refs, counts);
+            pos += len;
+            if (ok && refs.size() >= DEDUP_REF_FLUSH) {
+                ok = write_block(out, refs.data(), refs.size());
+                refs.clear();
+            }
+        }
+        ok = ok && write_block(out, refs.data(), refs.size()) && container_finish(out, cw);
+    } catch (const std::exception &e) {
+        log_error("File '%s': Exception during processing: %s", w->input_file.c_str(), e.what());
+        ok = false;
+    }
+    unmap_input_file(map);
+    close_input_stream(in);
+
+    // The chunks it references must outlive a crash before the container is
+    // moved into place
+    if (!ok || !w->store->sync()) {
+        abort_output_stream(out);
+        return false;
+    }
+    if (!commit_output_stream(out)) {
+        log_error("File '%s': Failed to write output to '%s'",
+                 w->input_file.c_str(), w->output_file.c_str());
+        return false;
+    }
+    log_info("File '%s': %zu chunk(s), %zu new (%llu bytes added to the chunk store)", w->input_file.c_str(),
+            counts.chunks, counts.added, static_cast<unsigned long long>(counts.added_bytes));
+    return true;
 }
 
-// Select decompression algorithm based on algorithm name
-static std::vector<uint8_t> decompress_data(const std::vector<uint8_t> &data, const std::string &algorithm) {
-    std::string alg = algorithm;
-    // Convert to lowercase for case-insensitive comparison
-    for (char &c : alg) {
-        if (c >= 'A' && c <= 'Z') {
-            c = c - 'A' + 'a';
+// --comp-alg auto samples this many evenly spaced slices of larger files
+static const size_t AUTO_SAMPLE_SLICES = 4;
+
+// --comp-alg auto: choose the codec of this file from a sample of its bytes
+// and store it in the file's own options, so the container header records
+// the choice. data is the whole input when it is already in memory;
+// otherwise the sample is read from the file.
+static bool choose_file_codec(WorkerArgs *w, const uint8_t *data, uint64_t size) {
+    size_t slices = size <= CODEC_SAMPLE_SIZE ? 1 : AUTO_SAMPLE_SLICES;
+    size_t slice = size <= CODEC_SAMPLE_SIZE ? static_cast<size_t>(size) : CODEC_SAMPLE_SIZE / AUTO_SAMPLE_SLICES;
+    PooledBuffer sample_buf(slices * slice);
+    std::vector<uint8_t> &sample = *sample_buf;
+
+    int fd = -1;
+    if (!data && !sample.empty()) {
+        stats_syscall(SYS_OPEN);
+        fd = open(w->input_file.c_str(), O_RDONLY | O_CLOEXEC);
+        if (fd < 0) {
+            log_error("File '%s': Failed to open file for sampling: %s", w->input_file.c_str(), strerror(errno));
+            return false;
         }
     }
-    
-    if (alg.empty() || alg == "rle") {
-        return decompress_rle(data);
-    } else if (alg == "diff") {
-        return decompress_differential(data);
-    } else {
-        // Unknown algorithm - return empty vector (error will be handled by caller)
-        return std::vector<uint8_t>();
+    for (size_t i = 0; i < slices && slice > 0; ++i) {
+        uint64_t offset = slices == 1 ? 0 : (size - slice) * i / (slices - 1);
+        if (data) {
+            memcpy(sample.data() + i * slice, data + offset, slice);
+            continue;
+        }
+        ssize_t r = safe_pread_loop(fd, sample.data() + i * slice, slice, static_cast<off_t>(offset));
+        if (r < 0 || static_cast<size_t>(r) != slice) {
+            log_error("File '%s': Failed to read sample: %s", w->input_file.c_str(),
+                     r < 0 ? strerror(errno) : "short read");
+            stats_syscall(SYS_CLOSE);
+            close(fd);
+            return false;
+        }
+    }
+    if (fd >= 0) {
+        stats_syscall(SYS_CLOSE);
+        close(fd);
+    }
+
+    w->opts.pipeline.codec = choose_codec(sample.data(), sample.size(), w->opts.lz_window);
+    w->opts.comp_alg = w->opts.pipeline.codec->name();
+    log_info("File '%s': auto selected %s", w->input_file.c_str(), w->opts.comp_alg.c_str());
+    return true;
+}
+
+// Headerless inputs are decoded with the command-line codec, which auto does
+// not name
+static bool can_decode_headerless(const WorkerArgs *w) {
+    if (w->opts.do_decompress && !w->opts.pipeline.codec) {
+        log_error("File '%s': No container header; --comp-alg auto can only decode GSEA containers",
+                 w->input_file.c_str());
+        return false;
     }
+    return true;
 }
 
 void *worker_entry(void *arg) {
@@ -289,11 +1140,13 @@ void *worker_entry(void *arg) {
         log_error("worker_entry: received null argument");
         return reinterpret_cast<void*>(1); // Return error code
     }
+    StatsScope scope(w->stats);
 
-    log_info("Worker starting for file: %s", w->input_file.c_str());
+    log_debug("Worker starting for file: %s", w->input_file.c_str());
 
     // Validate input file exists and is accessible
     struct stat st;
+    stats_syscall(SYS_STAT);
     if (stat(w->input_file.c_str(), &st) != 0) {
         log_error("Input file '%s' does not exist or is not accessible: %s", 
                  w->input_file.c_str(), strerror(errno));
@@ -305,155 +1158,503 @@ void *worker_entry(void *arg) {
         return reinterpret_cast<void*>(1);
     }
 
-    // Validate compression algorithm
-    if (w->opts.do_compress || w->opts.do_decompress) {
-        std::string comp_alg = w->opts.comp_alg;
-        for (char &c : comp_alg) {
-            if (c >= 'A' && c <= 'Z') {
-                c = c - 'A' + 'a';
+    // Containers say how they were made; older headerless files are decoded
+    // with the algorithms given on the command line
+    if (!is_encoding(w->opts)) {
+        if (input_is_container(w->input_file)) {
+            if (!process_container(w, static_cast<uint64_t>(st.st_size))) {
+                return reinterpret_cast<void*>(1);
             }
+            log_info("File '%s': Successfully processed and written to '%s'", 
+                    w->input_file.c_str(), w->output_file.c_str());
+            return reinterpret_cast<void*>(0);
         }
-        
-        if (!comp_alg.empty() && comp_alg != "rle" && comp_alg != "diff") {
-            log_error("File '%s': Unknown compression algorithm '%s'. Supported: rle, diff", 
-                     w->input_file.c_str(), w->opts.comp_alg.c_str());
+        if (w->opts.range) {
+            log_error("File '%s': --range needs a GSEA container; the file has no header", w->input_file.c_str());
             return reinterpret_cast<void*>(1);
         }
-    }
-    
-    // Validate key for encryption/decryption
-    if (w->opts.do_encrypt || w->opts.do_decrypt) {
-        if (w->key.empty() || w->key.length() == 0) {
-            log_error("File '%s': Encryption/decryption requires a key (-k option)", 
-                     w->input_file.c_str());
+        if (!can_decode_headerless(w)) {
             return reinterpret_cast<void*>(1);
         }
-        
-        // Validate encryption algorithm
-        std::string alg = w->opts.enc_alg;
-        for (char &c : alg) {
-            if (c >= 'A' && c <= 'Z') {
-                c = c - 'A' + 'a';
-            }
+        if (st.st_size > 0) {
+            log_info("File '%s': No container header, decoding with the command-line algorithms",
+                    w->input_file.c_str());
         }
-        
-        if (!alg.empty() && alg != "vigenere" && alg != "xor") {
-            log_error("File '%s': Unknown encryption algorithm '%s'. Supported: vigenere, xor", 
-                     w->input_file.c_str(), w->opts.enc_alg.c_str());
+    } else if (w->opts.do_compress && w->opts.pipeline.auto_codec &&
+               !choose_file_codec(w, nullptr, static_cast<uint64_t>(st.st_size))) {
+        return reinterpret_cast<void*>(1);
+    }
+
+    if (w->store && is_encoding(w->opts)) {
+        if (!process_file_dedup(w)) {
+            return reinterpret_cast<void*>(1);
+        }
+        log_info("File '%s': Successfully processed and written to '%s'", 
+                w->input_file.c_str(), w->output_file.c_str());
+        return reinterpret_cast<void*>(0);
+    }
+
+    // Large inputs are fanned out across the pool so one big file does not pin a single core
+    if (w->pool && static_cast<uint64_t>(st.st_size) >= PARALLEL_MIN_FILE_SIZE && operation_is_chunkable(w->opts)) {
+        if (!process_file_chunked(w, static_cast<uint64_t>(st.st_size))) {
             return reinterpret_cast<void*>(1);
         }
+        log_info("File '%s': Successfully processed and written to '%s'", 
+                w->input_file.c_str(), w->output_file.c_str());
+        return reinterpret_cast<void*>(0);
     }
 
-    std::vector<uint8_t> data;
-    if (!read_entire_file(w->input_file, data)) {
-        log_error("File '%s': Failed to read file", w->input_file.c_str());
+    if (!process_file_streaming(w)) {
         return reinterpret_cast<void*>(1);
     }
 
-    if (data.empty()) {
-        log_info("File '%s' is empty, skipping processing", w->input_file.c_str());
-        // Still write empty file
-        data.clear();
+    log_info("File '%s': Successfully processed and written to '%s'", 
+            w->input_file.c_str(), w->output_file.c_str());
+    return reinterpret_cast<void*>(0); // Return success code
+}
+
+// Request kinds encoded in the low byte of io_uring user_data
+enum UringOp : uint64_t {
+    URING_OPEN_IN = 1,
+    URING_STATX,
+    URING_READ,
+    URING_OPEN_OUT,
+    URING_WRITE,
+    URING_CLOSE_IN,
+    URING_CLOSE_OUT,
+};
+
+static const unsigned URING_QUEUE_DEPTH = 4 * WORKER_BATCH_MAX_FILES;
+
+// Progress of one file through the batched io_uring path
+struct UringFile {
+    WorkerArgs *w = nullptr;
+    std::string tmp_path;
+    struct statx stx;
+    int in_fd = -1;
+    int out_fd = -1;
+    int inflight = 0;
+    int meta_pending = 0;    // Open + statx of the input still outstanding
+    PooledBuffer data;
+    size_t read_done = 0;
+    PooledBuffer out;
+    size_t written = 0;
+    bool read_complete = false;
+    bool transformed = false;
+    bool out_created = false;
+    bool failed = false;
+    bool fallback = false;   // Hand over to worker_entry (large file, unsupported op)
+    bool committed = false;
+};
+
+static thread_local IoUring tls_ring;
+static thread_local bool tls_ring_tried = false;
+static std::atomic<bool> uring_unavailable_logged{false};
+
+static io_uring_sqe *next_sqe(IoUring &ring) {
+    io_uring_sqe *sqe = ring.get_sqe();
+    while (!sqe) {
+        // Submission queue full: hand what we have to the kernel to free slots
+        ring.submit_and_wait(0);
+        sqe = ring.get_sqe();
+    }
+    return sqe;
+}
+
+static uint64_t uring_tag(size_t index, UringOp op) {
+    return (static_cast<uint64_t>(index) << 8) | op;
+}
+
+static void uring_fail(UringFile &f, const char *what, int res) {
+    if (res == -EINVAL || res == -EOPNOTSUPP) {
+        // Kernel lacks this opcode: redo the file on the POSIX path
+        f.fallback = true;
+        return;
     }
+    log_error("File '%s': %s: %s", f.w->input_file.c_str(), what, strerror(-res));
+    f.failed = true;
+}
 
-    std::vector<uint8_t> out;
-    
+static void uring_submit_read(IoUring &ring, UringFile &f, size_t index) {
+    IoUring::prep_read(next_sqe(ring), f.in_fd, f.data->data() + f.read_done,
+                       static_cast<unsigned>(f.data->size() - f.read_done), f.read_done,
+                       uring_tag(index, URING_READ));
+    f.inflight++;
+}
+
+static void uring_submit_write(IoUring &ring, UringFile &f, size_t index) {
+    IoUring::prep_write(next_sqe(ring), f.out_fd, f.out->data() + f.written,
+                        static_cast<unsigned>(f.out->size() - f.written), f.written,
+                        uring_tag(index, URING_WRITE));
+    f.inflight++;
+}
+
+static void uring_submit_close(IoUring &ring, UringFile &f, size_t index, bool input) {
+    int &fd = input ? f.in_fd : f.out_fd;
+    IoUring::prep_close(next_sqe(ring), fd, uring_tag(index, input ? URING_CLOSE_IN : URING_CLOSE_OUT));
+    fd = -1;
+    f.inflight++;
+}
+
+// The whole file is in memory: decode every chunk of a container into f.out
+static bool uring_decode_container(UringFile &f) {
+    ContainerReader cr;
+    if (!load_container(f.w, f.data->data(), -1, f.data->size(), cr)) {
+        return false;
+    }
+    f.out.reserve(static_cast<size_t>(cr.header.original_size));
+    // The container bytes are ours, so encrypted chunks decrypt in place;
+    // chunks of a deduplicated container are read from the store
+    PooledBuffer result(f.data->size()), fetched;
+    uint64_t stored_total = 0;
+    for (const ChunkEntry &entry : cr.chunks) {
+        ChunkEntry c = entry;
+        uint64_t key_pos = c.stored_offset - cr.header_size;
+        uint8_t *stored = f.data->data() + c.stored_offset;
+        if (cr.header.flags & CONTAINER_DEDUP) {
+            if (!fetch_stored_chunk(f.w, cr, stored, c, key_pos, *fetched)) {
+                return false;
+            }
+            stored = fetched->data();
+        }
+        stored_total += c.stored_len;
+        if (!decode_chunk(f.w, cr, c, key_pos, stored, stored, *result)) {
+            return false;
+        }
+        f.out->insert(f.out->end(), result->begin(), result->end());
+    }
+    log_container_summary(f.w, cr, cr.chunks.size(), stored_total, cr.header.original_size);
+    return true;
+}
+
+// Turn the transformed bytes in f.out into a one-chunk container of the
+// original_len input bytes whose CRC32C is crc
+static void uring_wrap_container(UringFile &f, size_t original_len, uint32_t crc) {
+    ContainerWriter cw;
+    container_init(f.w->opts, cw);
+    if (original_len > 0) {
+        container_add_chunk(cw, f.out->size(), original_len, crc);
+    }
+    container_seal(cw);
+    PooledBuffer bytes;
+    bytes.reserve(container_header_size(cw.header) + f.out->size() + container_index_size(cw.header.chunk_count));
+    serialize_header(cw.header, *bytes);
+    bytes->insert(bytes->end(), f.out->begin(), f.out->end());
+    serialize_index(cw.chunks, *bytes);
+    f.out = std::move(bytes);
+}
+
+// Once the input is fully read and the output is open, transform on this
+// thread while the other files' requests keep progressing in the kernel.
+static void uring_try_transform(IoUring &ring, UringFile &f, size_t index) {
+    if (f.failed || f.fallback || f.transformed || !f.read_complete || f.out_fd < 0) {
+        return;
+    }
+    f.transformed = true;
+
+    bool encoding = is_encoding(f.w->opts);
     try {
-        // Handle operations in correct order:
-        // For compression + encryption: compress first, then encrypt
-        // For decryption + decompression: decrypt first, then decompress
-        
-        if (w->opts.do_compress) {
-            std::string comp_alg = w->opts.comp_alg.empty() ? "rle" : w->opts.comp_alg;
-            out = compress_data(data, comp_alg);
-            if (out.empty() && !data.empty()) {
-                log_error("File '%s': Compression failed (empty output)", w->input_file.c_str());
-                return reinterpret_cast<void*>(1);
+        if (!encoding && is_container(f.data->data(), f.data->size())) {
+            // A small container may stand for a large file (chunk references
+            // of a deduplicated one above all): worker_entry decodes those in
+            // parallel and straight to the output instead of in memory
+            ContainerHeader h;
+            size_t header_size;
+            std::string err;
+            if (parse_header(f.data->data(), f.data->size(), h, header_size, err) &&
+                h.original_size > STREAM_BLOCK_SIZE) {
+                f.fallback = true;
+                f.data.release();
+                return;
             }
-            log_info("File '%s': Compressed %zu bytes to %zu bytes (%s)", 
-                    w->input_file.c_str(), data.size(), out.size(), comp_alg.c_str());
-            
-            // If also encrypting, encrypt the compressed data
-            if (w->opts.do_encrypt) {
-                std::string alg = w->opts.enc_alg.empty() ? "vigenere" : w->opts.enc_alg;
-                std::vector<uint8_t> encrypted = encrypt_data(out, w->key, alg);
-                if (encrypted.empty() && !out.empty()) {
-                    log_error("File '%s': Encryption failed", w->input_file.c_str());
-                    return reinterpret_cast<void*>(1);
-                }
-                log_info("File '%s': Encrypted %zu bytes using %s cipher", 
-                        w->input_file.c_str(), out.size(), alg.c_str());
-                out = encrypted;
-            }
-        } else if (w->opts.do_decompress) {
-            // If also decrypting, decrypt first, then decompress
-            if (w->opts.do_decrypt) {
-                std::string alg = w->opts.enc_alg.empty() ? "vigenere" : w->opts.enc_alg;
-                std::vector<uint8_t> decrypted = decrypt_data(data, w->key, alg);
-                if (decrypted.empty() && !data.empty()) {
-                    log_error("File '%s': Decryption failed", w->input_file.c_str());
-                    return reinterpret_cast<void*>(1);
-                }
-                log_info("File '%s': Decrypted %zu bytes using %s cipher", 
-                        w->input_file.c_str(), data.size(), alg.c_str());
-                
-                std::string comp_alg = w->opts.comp_alg.empty() ? "rle" : w->opts.comp_alg;
-                out = decompress_data(decrypted, comp_alg);
-                if (out.empty() && !decrypted.empty()) {
-                    log_error("File '%s': Decompression failed (invalid compressed data or empty output)", 
-                             w->input_file.c_str());
-                    return reinterpret_cast<void*>(1);
-                }
-                log_info("File '%s': Decompressed %zu bytes to %zu bytes (%s)", 
-                        w->input_file.c_str(), decrypted.size(), out.size(), comp_alg.c_str());
+            if (!uring_decode_container(f)) {
+                f.failed = true;
+                return;
+            }
+        } else {
+            const Options &opts = f.w->opts;
+            if (encoding ? opts.do_compress && opts.pipeline.auto_codec &&
+                           !choose_file_codec(f.w, f.data->data(), f.data->size())
+                         : !can_decode_headerless(f.w)) {
+                f.failed = true;
+                return;
+            }
+            // The input buffer is ours: cipher-only operations take it over
+            // as the output and run in place
+            size_t len = f.data->size();
+            uint32_t crc = encoding ? simd_crc32c(0, f.data->data(), len) : 0;
+            if (is_cipher_only(opts)) {
+                f.out = std::move(f.data);
             } else {
-                std::string comp_alg = w->opts.comp_alg.empty() ? "rle" : w->opts.comp_alg;
-                out = decompress_data(data, comp_alg);
-                if (out.empty() && !data.empty()) {
-                    log_error("File '%s': Decompression failed (invalid compressed data or empty output)", 
-                             w->input_file.c_str());
-                    return reinterpret_cast<void*>(1);
-                }
-                log_info("File '%s': Decompressed %zu bytes to %zu bytes (%s)", 
-                        w->input_file.c_str(), data.size(), out.size(), comp_alg.c_str());
-            }
-        } else if (w->opts.do_encrypt) {
-            std::string alg = w->opts.enc_alg.empty() ? "vigenere" : w->opts.enc_alg;
-            out = encrypt_data(data, w->key, alg);
-            if (out.empty() && !data.empty()) {
-                log_error("File '%s': Encryption failed", w->input_file.c_str());
-                return reinterpret_cast<void*>(1);
+                f.out.reserve(len);
             }
-            log_info("File '%s': Encrypted %zu bytes using %s cipher", 
-                    w->input_file.c_str(), data.size(), alg.c_str());
-        } else if (w->opts.do_decrypt) {
-            std::string alg = w->opts.enc_alg.empty() ? "vigenere" : w->opts.enc_alg;
-            out = decrypt_data(data, w->key, alg);
-            if (out.empty() && !data.empty()) {
-                log_error("File '%s': Decryption failed", w->input_file.c_str());
-                return reinterpret_cast<void*>(1);
+            uint8_t *in = is_cipher_only(opts) ? f.out->data() : f.data->data();
+            StreamState state;
+            if (len > 0 && (!transform_block(f.w, state, in, in, len, *f.out) || !finish_stream(f.w, state))) {
+                f.failed = true;
+                return;
             }
-            log_info("File '%s': Decrypted %zu bytes using %s cipher", 
-                    w->input_file.c_str(), data.size(), alg.c_str());
-        } else {
-            // no-op: copy
-            out = data;
+            if (encoding) {
+                uring_wrap_container(f, len, crc);
+            }
+            log_stream_summary(f.w, state);
         }
     } catch (const std::exception &e) {
-        log_error("File '%s': Exception during processing: %s", w->input_file.c_str(), e.what());
-        return reinterpret_cast<void*>(1);
-    } catch (...) {
-        log_error("File '%s': Unknown exception during processing", w->input_file.c_str());
-        return reinterpret_cast<void*>(1);
+        log_error("File '%s': Exception during processing: %s", f.w->input_file.c_str(), e.what());
+        f.failed = true;
+        return;
     }
+    f.data.release();
 
-    if (!write_entire_file(w->output_file, out)) {
-        log_error("File '%s': Failed to write output to '%s'", 
-                 w->input_file.c_str(), w->output_file.c_str());
+    if (f.out->empty()) {
+        uring_submit_close(ring, f, index, false);
+    } else {
+        uring_submit_write(ring, f, index);
+    }
+}
+
+// Input opened and sized: small regular files continue on the ring
+static void uring_start_transfer(IoUring &ring, UringFile &f, size_t index) {
+    if (f.failed || f.fallback) {
+        return;
+    }
+    if (!S_ISREG(f.stx.stx_mode)) {
+        log_error("Input path '%s' is not a regular file", f.w->input_file.c_str());
+        f.failed = true;
+        return;
+    }
+    // Larger inputs go through the streaming/chunked pipeline instead; zero
+    // sizes may be pseudo-files whose length is only known by reading them
+    if (f.stx.stx_size > STREAM_BLOCK_SIZE || f.stx.stx_size == 0) {
+        f.fallback = true;
+        return;
+    }
+
+    log_debug("Worker starting for file: %s", f.w->input_file.c_str());
+    f.data.reserve(static_cast<size_t>(f.stx.stx_size));
+    f.data->resize(static_cast<size_t>(f.stx.stx_size));
+    uring_submit_read(ring, f, index);
+
+    IoUring::prep_openat(next_sqe(ring), f.tmp_path.c_str(), O_WRONLY | O_CREAT | O_TRUNC | O_CLOEXEC, 0644,
+                         uring_tag(index, URING_OPEN_OUT));
+    f.inflight++;
+}
+
+static void uring_handle_completion(IoUring &ring, UringFile &f, size_t index, UringOp op, int res) {
+    StatsScope scope(f.w->stats);
+    f.inflight--;
+    switch (op) {
+        case URING_OPEN_IN:
+            if (res < 0) {
+                uring_fail(f, "Failed to open file for reading", res);
+            } else {
+                f.in_fd = res;
+            }
+            if (--f.meta_pending == 0) {
+                uring_start_transfer(ring, f, index);
+            }
+            break;
+        case URING_STATX:
+            if (res < 0) {
+                uring_fail(f, "Failed to stat file", res);
+            }
+            if (--f.meta_pending == 0) {
+                uring_start_transfer(ring, f, index);
+            }
+            break;
+        case URING_READ:
+            if (res < 0) {
+                uring_fail(f, "Failed to read file", res);
+                break;
+            }
+            f.read_done += static_cast<size_t>(res);
+            if (res > 0 && f.read_done < f.data->size() && !f.failed) {
+                uring_submit_read(ring, f, index);
+                break;
+            }
+            // res == 0 before the expected size: the file shrank since statx
+            f.data->resize(f.read_done);
+            f.read_complete = true;
+            uring_submit_close(ring, f, index, true);
+            uring_try_transform(ring, f, index);
+            break;
+        case URING_OPEN_OUT:
+            if (res < 0) {
+                uring_fail(f, "Failed to open output for writing", res);
+                break;
+            }
+            f.out_fd = res;
+            f.out_created = true;
+            uring_try_transform(ring, f, index);
+            break;
+        case URING_WRITE:
+            if (res < 0) {
+                uring_fail(f, "Failed to write output", res);
+                break;
+            }
+            f.written += static_cast<size_t>(res);
+            if (f.written < f.out->size() && !f.failed) {
+                uring_submit_write(ring, f, index);
+            } else {
+                uring_submit_close(ring, f, index, false);
+            }
+            break;
+        case URING_CLOSE_IN:
+            break;
+        case URING_CLOSE_OUT:
+            if (res < 0) {
+                uring_fail(f, "Failed to close output", res);
+                break;
+            }
+            if (!f.failed && !f.fallback) {
+                stats_syscall(SYS_OTHER);
+                if (rename(f.tmp_path.c_str(), f.w->output_file.c_str()) != 0) {
+                    log_error("Failed to move '%s' into place as '%s': %s", f.tmp_path.c_str(),
+                             f.w->output_file.c_str(), strerror(errno));
+                    f.failed = true;
+                } else {
+                    f.committed = true;
+                }
+            }
+            break;
+    }
+}
+
+// The ring failed mid-batch. Requests the kernel took may still read or write
+// our buffers and use our fds, so wait for them before anything is released,
+// then close the ring: entries it never took would otherwise be submitted with
+// the next batch. Later batches of this thread use POSIX I/O.
+static void uring_abort_batch(IoUring &ring, std::vector<UringFile> &files, int inflight) {
+    int outstanding = inflight - static_cast<int>(ring.unconsumed());
+    while (outstanding > 0) {
+        int r = ring.wait(1);
+        if (r < 0) {
+            // Cannot wait: closing the ring cancels what is left
+            log_error("io_uring wait failed: %s", strerror(-r));
+            break;
+        }
+        io_uring_cqe *cqe;
+        while ((cqe = ring.peek_cqe()) != nullptr) {
+            UringFile &f = files[static_cast<size_t>(cqe->user_data >> 8)];
+            UringOp op = static_cast<UringOp>(cqe->user_data & 0xff);
+            int res = cqe->res;
+            ring.cqe_seen();
+            f.inflight--;
+            outstanding--;
+            // Record fds the kernel opened so they are closed below
+            if (op == URING_OPEN_IN && res >= 0) {
+                f.in_fd = res;
+            } else if (op == URING_OPEN_OUT && res >= 0) {
+                f.out_fd = res;
+                f.out_created = true;
+            }
+        }
+    }
+    ring.shutdown();
+}
+
+// Drive every file of the batch through open/statx -> read -> transform ->
+// write -> close on a single ring, reaping completions in any order.
+static void uring_run_batch(IoUring &ring, std::vector<UringFile> &files) {
+    int inflight = 0;
+    for (size_t i = 0; i < files.size(); ++i) {
+        UringFile &f = files[i];
+        if (f.failed) {
+            continue;
+        }
+        IoUring::prep_openat(next_sqe(ring), f.w->input_file.c_str(), O_RDONLY | O_CLOEXEC, 0,
+                             uring_tag(i, URING_OPEN_IN));
+        IoUring::prep_statx(next_sqe(ring), f.w->input_file.c_str(), &f.stx, uring_tag(i, URING_STATX));
+        f.inflight += 2;
+        f.meta_pending = 2;
+    }
+    for (const UringFile &f : files) {
+        inflight += f.inflight;
+    }
+
+    while (inflight > 0) {
+        int r = ring.submit_and_wait(1);
+        if (r < 0) {
+            log_error("io_uring submission failed: %s", strerror(-r));
+            uring_abort_batch(ring, files, inflight);
+            break;
+        }
+        io_uring_cqe *cqe;
+        while ((cqe = ring.peek_cqe()) != nullptr) {
+            size_t index = static_cast<size_t>(cqe->user_data >> 8);
+            UringOp op = static_cast<UringOp>(cqe->user_data & 0xff);
+            int res = cqe->res;
+            ring.cqe_seen();
+            uring_handle_completion(ring, files[index], index, op, res);
+        }
+        inflight = 0;
+        for (const UringFile &f : files) {
+            inflight += f.inflight;
+        }
+    }
+
+    // Every request has completed (or the ring broke): release what is left
+    for (UringFile &f : files) {
+        StatsScope scope(f.w->stats);
+        if (inflight > 0 && !f.committed) {
+            f.failed = true;
+        }
+        if (f.in_fd >= 0) {
+            stats_syscall(SYS_CLOSE);
+            close(f.in_fd);
+            f.in_fd = -1;
+        }
+        if (f.out_fd >= 0) {
+            stats_syscall(SYS_CLOSE);
+            close(f.out_fd);
+            f.out_fd = -1;
+        }
+        if (f.out_created && !f.committed) {
+            stats_syscall(SYS_OTHER);
+            unlink(f.tmp_path.c_str());
+        }
+    }
+}
+
+void *worker_batch_entry(void *arg) {
+    WorkerBatch *batch = static_cast<WorkerBatch*>(arg);
+    if (!batch) {
+        log_error("worker_batch_entry: received null argument");
         return reinterpret_cast<void*>(1);
     }
 
-    log_info("File '%s': Successfully processed and written to '%s'", 
-            w->input_file.c_str(), w->output_file.c_str());
-    return reinterpret_cast<void*>(0); // Return success code
+    if (!tls_ring_tried) {
+        tls_ring_tried = true;
+        if (!tls_ring.init(URING_QUEUE_DEPTH) && !uring_unavailable_logged.exchange(true)) {
+            log_warn("io_uring unavailable (%s); using POSIX I/O", strerror(errno));
+        }
+    }
+
+    std::vector<UringFile> files(batch->items.size());
+    for (size_t i = 0; i < files.size(); ++i) {
+        UringFile &f = files[i];
+        f.w = batch->items[i];
+        f.tmp_path = f.w->output_file + ".gsea-tmp";
+        if (!tls_ring.ready()) {
+            f.fallback = true;
+        }
+    }
+
+    if (tls_ring.ready()) {
+        uring_run_batch(tls_ring, files);
+    }
+
+    for (size_t i = 0; i < files.size(); ++i) {
+        UringFile &f = files[i];
+        if (f.fallback && !f.failed) {
+            batch->results[i] = worker_entry(f.w);
+        } else if (f.committed) {
+            log_info("File '%s': Successfully processed and written to '%s'", 
+                    f.w->input_file.c_str(), f.w->output_file.c_str());
+            batch->results[i] = reinterpret_cast<void*>(0);
+        } else {
+            batch->results[i] = reinterpret_cast<void*>(1);
+        }
+    }
+    return nullptr;
 }
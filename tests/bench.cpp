@@ -0,0 +1,436 @@
+// Benchmark harness for `make bench`.
+//
+// Codecs and ciphers are timed in-process on synthetic corpora, block by block
+// as the streaming pipeline feeds them, and every encode is checked by
+// decoding it again. End-to-end throughput runs bin/gsea over a generated
+// directory of small files at several thread counts.
+//
+//   gsea_bench [--size MiB] [--reps N] [--files N] [--threads 1,2,4]
+//              [--codecs-only | --e2e-only] [--csv] [--gsea PATH]
+#include "codec.h"
+#include "thread_pool.h"
+#include "utils.h"
+
+#include <algorithm>
+#include <string>
+#include <vector>
+#include <getopt.h>
+#include <ftw.h>
+#include <spawn.h>
+#include <fcntl.h>
+#include <unistd.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+#include <sys/wait.h>
+
+extern char **environ;
+
+// Same block size as the streaming pipeline (worker.cpp)
+static const size_t BENCH_BLOCK_SIZE = 1024 * 1024;
+
+static const char *const BENCH_CODECS[] = {
+    "store", "rle", "rle2", "diff", "lz", "lzhc", "huff", "lz+huff", "diff+lz+huff",
+};
+static const char *const BENCH_CIPHERS[] = {"vigenere", "xor"};
+
+struct BenchOptions {
+    size_t size = 16 * 1024 * 1024; // Bytes per corpus
+    int reps = 3;                   // Best of this many runs is reported
+    size_t files = 2000;            // Files in the end-to-end directory
+    std::vector<size_t> threads;    // End-to-end thread counts
+    bool codecs = true;
+    bool e2e = true;
+    bool csv = false;
+    std::string gsea = "bin/gsea";
+};
+
+static double now_seconds() {
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return static_cast<double>(ts.tv_sec) + static_cast<double>(ts.tv_nsec) / 1e9;
+}
+
+// Deterministic generator so every run measures the same bytes
+struct Rng {
+    uint64_t s;
+    explicit Rng(uint64_t seed) : s(seed) {}
+    uint64_t next() {
+        s += 0x9E3779B97F4A7C15ULL;
+        uint64_t z = s;
+        z = (z ^ (z >> 30)) * 0xBF58476D1CE4E5B9ULL;
+        z = (z ^ (z >> 27)) * 0x94D049BB133111EBULL;
+        return z ^ (z >> 31);
+    }
+};
+
+// Log-like text: words from a fixed vocabulary with a skewed distribution,
+// numbers and line breaks
+static void make_text(std::vector<uint8_t> &out, size_t size, uint64_t seed) {
+    Rng rng(seed);
+    std::vector<std::string> words;
+    for (int i = 0; i < 2000; ++i) {
+        std::string w;
+        size_t len = 2 + rng.next() % 9;
+        for (size_t j = 0; j < len; ++j) {
+            w += static_cast<char>('a' + rng.next() % 26);
+        }
+        words.push_back(w);
+    }
+    out.clear();
+    while (out.size() < size) {
+        uint64_t r = rng.next();
+        if (r % 12 == 0) {
+            std::string n = std::to_string(r % 100000);
+            out.insert(out.end(), n.begin(), n.end());
+        } else {
+            // Squaring skews towards the front of the vocabulary
+            size_t i = static_cast<size_t>((r >> 8) % 2000) * static_cast<size_t>((r >> 24) % 2000) / 2000;
+            out.insert(out.end(), words[i].begin(), words[i].end());
+        }
+        out.push_back(r % 9 == 0 ? '\n' : ' ');
+    }
+    out.resize(size);
+}
+
+// 16-bit samples of a slowly drifting signal with a little noise, as written
+// by a sensor logger
+static void make_sensor(std::vector<uint8_t> &out, size_t size, uint64_t seed) {
+    Rng rng(seed);
+    out.resize(size);
+    int value = 20000;
+    for (size_t i = 0; i + 1 < size; i += 2) {
+        value += static_cast<int>(rng.next() % 7) - 3;
+        value = std::min(std::max(value, 0), 65535);
+        out[i] = static_cast<uint8_t>(value);
+        out[i + 1] = static_cast<uint8_t>(value >> 8);
+    }
+}
+
+static void make_random(std::vector<uint8_t> &out, size_t size, uint64_t seed) {
+    Rng rng(seed);
+    out.resize(size);
+    for (size_t i = 0; i < size; i += 8) {
+        uint64_t r = rng.next();
+        memcpy(out.data() + i, &r, std::min<size_t>(8, size - i));
+    }
+}
+
+struct Corpus {
+    const char *name;
+    std::vector<uint8_t> data;
+};
+
+static std::vector<Corpus> make_corpora(size_t size) {
+    std::vector<Corpus> corpora(4);
+    corpora[0].name = "zeros";
+    corpora[0].data.assign(size, 0);
+    corpora[1].name = "text";
+    make_text(corpora[1].data, size, 1);
+    corpora[2].name = "random";
+    make_random(corpora[2].data, size, 2);
+    corpora[3].name = "sensor";
+    make_sensor(corpora[3].data, size, 3);
+    return corpora;
+}
+
+static void print_header(const BenchOptions &o, const char *csv, const char *table) {
+    printf("%s\n", o.csv ? csv : table);
+}
+
+static double mb_per_s(size_t bytes, double seconds) {
+    return seconds > 0 ? static_cast<double>(bytes) / seconds / 1e6 : 0.0;
+}
+
+static double ns_per_byte(size_t bytes, double seconds) {
+    return bytes > 0 ? seconds * 1e9 / static_cast<double>(bytes) : 0.0;
+}
+
+// Encode the corpus block by block, then decode each block on its own as a
+// container chunk is. Returns false when the round trip does not reproduce
+// the input.
+static bool bench_codec(const BenchOptions &o, const Codec &codec, const Corpus &c) {
+    size_t n = c.data.size();
+    std::vector<std::vector<uint8_t>> blocks((n + BENCH_BLOCK_SIZE - 1) / BENCH_BLOCK_SIZE);
+    std::vector<uint8_t> decoded;
+    decoded.reserve(n);
+    double enc = 0, dec = 0;
+    size_t stored = 0;
+    for (int rep = 0; rep < o.reps; ++rep) {
+        double t0 = now_seconds();
+        for (size_t i = 0; i < blocks.size(); ++i) {
+            size_t len = std::min(BENCH_BLOCK_SIZE, n - i * BENCH_BLOCK_SIZE);
+            codec.encode(c.data.data() + i * BENCH_BLOCK_SIZE, len, blocks[i]);
+        }
+        double t1 = now_seconds();
+        std::vector<uint8_t> out;
+        decoded.clear();
+        for (const std::vector<uint8_t> &b : blocks) {
+            DecodeState ds;
+            if (!codec.decode(b.data(), b.size(), ds, out) || !ds.idle()) {
+                return false;
+            }
+            decoded.insert(decoded.end(), out.begin(), out.end());
+        }
+        double t2 = now_seconds();
+        enc = rep == 0 ? t1 - t0 : std::min(enc, t1 - t0);
+        dec = rep == 0 ? t2 - t1 : std::min(dec, t2 - t1);
+    }
+    if (decoded != c.data) {
+        return false;
+    }
+    for (const std::vector<uint8_t> &b : blocks) {
+        stored += b.size();
+    }
+
+    double ratio = static_cast<double>(stored) / static_cast<double>(n);
+    if (o.csv) {
+        printf("codec,%s,%s,%zu,%.1f,%.3f,%.1f,%.3f,%.4f\n", codec.name().c_str(), c.name, n,
+               mb_per_s(n, enc), ns_per_byte(n, enc), mb_per_s(n, dec), ns_per_byte(n, dec), ratio);
+    } else {
+        printf("%-14s %-7s %10.1f %9.3f %10.1f %9.3f %8.4f\n", codec.name().c_str(), c.name,
+               mb_per_s(n, enc), ns_per_byte(n, enc), mb_per_s(n, dec), ns_per_byte(n, dec), ratio);
+    }
+    return true;
+}
+
+static bool bench_cipher(const BenchOptions &o, const Cipher &cipher, const Corpus &c) {
+    std::vector<uint8_t> buf = c.data;
+    size_t n = buf.size();
+    double enc = 0, dec = 0;
+    for (int rep = 0; rep < o.reps; ++rep) {
+        double t0 = now_seconds();
+        for (size_t pos = 0; pos < n; pos += BENCH_BLOCK_SIZE) {
+            cipher.encrypt(buf.data() + pos, std::min(BENCH_BLOCK_SIZE, n - pos), pos);
+        }
+        double t1 = now_seconds();
+        for (size_t pos = 0; pos < n; pos += BENCH_BLOCK_SIZE) {
+            cipher.decrypt(buf.data() + pos, std::min(BENCH_BLOCK_SIZE, n - pos), pos);
+        }
+        double t2 = now_seconds();
+        enc = rep == 0 ? t1 - t0 : std::min(enc, t1 - t0);
+        dec = rep == 0 ? t2 - t1 : std::min(dec, t2 - t1);
+    }
+    if (buf != c.data) {
+        return false;
+    }
+    if (o.csv) {
+        printf("cipher,%s,%s,%zu,%.1f,%.3f,%.1f,%.3f,1.0000\n", cipher.name().c_str(), c.name, n,
+               mb_per_s(n, enc), ns_per_byte(n, enc), mb_per_s(n, dec), ns_per_byte(n, dec));
+    } else {
+        printf("%-14s %-7s %10.1f %9.3f %10.1f %9.3f %8s\n", cipher.name().c_str(), c.name,
+               mb_per_s(n, enc), ns_per_byte(n, enc), mb_per_s(n, dec), ns_per_byte(n, dec), "-");
+    }
+    return true;
+}
+
+static bool run_codec_benchmarks(const BenchOptions &o) {
+    std::vector<Corpus> corpora = make_corpora(o.size);
+    print_header(o, "kind,name,corpus,bytes,enc_mb_s,enc_ns_byte,dec_mb_s,dec_ns_byte,ratio",
+                 "algorithm      corpus   enc MB/s  enc ns/B   dec MB/s  dec ns/B    ratio");
+    bool ok = true;
+    std::string err;
+    for (const char *name : BENCH_CODECS) {
+        std::shared_ptr<const Codec> codec = make_codec(name, 65536, err);
+        for (const Corpus &c : corpora) {
+            if (!codec || !bench_codec(o, *codec, c)) {
+                fprintf(stderr, "bench: %s round trip failed on %s\n", name, c.name);
+                ok = false;
+            }
+        }
+    }
+    for (const char *name : BENCH_CIPHERS) {
+        std::shared_ptr<const Cipher> cipher = make_cipher(name, "benchmark-key", err);
+        for (const Corpus &c : corpora) {
+            if (!cipher || !bench_cipher(o, *cipher, c)) {
+                fprintf(stderr, "bench: %s round trip failed on %s\n", name, c.name);
+                ok = false;
+            }
+        }
+    }
+    return ok;
+}
+
+static int remove_entry(const char *path, const struct stat *, int, struct FTW *) {
+    return remove(path);
+}
+
+static void remove_tree(const std::string &path) {
+    nftw(path.c_str(), remove_entry, 16, FTW_DEPTH | FTW_PHYS);
+}
+
+// Directory of o.files text files of 1-64 KiB in 20 subdirectories, like a
+// tree of logs. Returns the total size.
+static size_t make_tree(const BenchOptions &o, const std::string &root) {
+    std::vector<uint8_t> text;
+    make_text(text, 4 * 1024 * 1024, 4);
+    Rng rng(5);
+    size_t total = 0;
+    for (size_t i = 0; i < o.files; ++i) {
+        std::string dir = root + "/d" + std::to_string(i % 20);
+        create_directory_recursive(dir);
+        size_t len = 1024 + static_cast<size_t>(rng.next() % (63 * 1024));
+        size_t off = static_cast<size_t>(rng.next() % (text.size() - len));
+        std::vector<uint8_t> data(text.begin() + static_cast<ptrdiff_t>(off),
+                                  text.begin() + static_cast<ptrdiff_t>(off + len));
+        std::string path = dir + "/f" + std::to_string(i) + ".log";
+        int fd = open(path.c_str(), O_WRONLY | O_CREAT | O_TRUNC | O_CLOEXEC, 0644);
+        if (fd >= 0) {
+            safe_write_loop(fd, data.data(), data.size());
+            close(fd);
+        }
+        total += len;
+    }
+    return total;
+}
+
+// Run gsea with its output discarded; returns the wall time, or -1 on failure
+static double run_gsea(const BenchOptions &o, const std::vector<std::string> &args) {
+    std::vector<char*> argv;
+    argv.push_back(const_cast<char*>(o.gsea.c_str()));
+    for (const std::string &a : args) {
+        argv.push_back(const_cast<char*>(a.c_str()));
+    }
+    argv.push_back(nullptr);
+
+    posix_spawn_file_actions_t actions;
+    posix_spawn_file_actions_init(&actions);
+    posix_spawn_file_actions_addopen(&actions, STDOUT_FILENO, "/dev/null", O_WRONLY, 0);
+    posix_spawn_file_actions_addopen(&actions, STDERR_FILENO, "/dev/null", O_WRONLY, 0);
+    double t0 = now_seconds();
+    pid_t pid;
+    int rc = posix_spawn(&pid, o.gsea.c_str(), &actions, nullptr, argv.data(), environ);
+    posix_spawn_file_actions_destroy(&actions);
+    int status = 0;
+    if (rc != 0 || waitpid(pid, &status, 0) < 0) {
+        return -1;
+    }
+    double t = now_seconds() - t0;
+    return WIFEXITED(status) && WEXITSTATUS(status) == 0 ? t : -1;
+}
+
+// Files/s for compress+encrypt of the whole tree at each thread count, best
+// of o.reps runs after one warm-up run
+static bool run_e2e_benchmarks(const BenchOptions &o) {
+    char tmpl[] = "/tmp/gsea_bench_XXXXXX";
+    if (!mkdtemp(tmpl)) {
+        perror("bench: mkdtemp");
+        return false;
+    }
+    std::string root = tmpl;
+    size_t bytes = make_tree(o, root + "/in");
+
+    print_header(o, "kind,io_mode,threads,files,bytes,seconds,files_s,mb_s",
+                 "\nend-to-end     io_mode threads  files    seconds    files/s      MB/s");
+    bool ok = true;
+    for (const char *mode : {"mmap", "uring"}) {
+        for (size_t threads : o.threads) {
+            std::vector<std::string> args = {"-ce", "--comp-alg", "lz", "--key", "benchmark-key",
+                                             "--io-mode", mode, "--threads", std::to_string(threads),
+                                             "--input", root + "/in", "--output", root + "/out/"};
+            double best = -1;
+            for (int rep = 0; rep <= o.reps && ok; ++rep) {
+                remove_tree(root + "/out");
+                double t = run_gsea(o, args);
+                if (t < 0) {
+                    fprintf(stderr, "bench: %s failed (%s, %zu threads)\n", o.gsea.c_str(), mode, threads);
+                    ok = false;
+                } else if (rep > 0) {
+                    best = best < 0 ? t : std::min(best, t);
+                }
+            }
+            if (!ok) {
+                break;
+            }
+            if (o.csv) {
+                printf("e2e,%s,%zu,%zu,%zu,%.4f,%.1f,%.1f\n", mode, threads, o.files, bytes, best,
+                       static_cast<double>(o.files) / best, mb_per_s(bytes, best));
+            } else {
+                printf("%-14s %-7s %7zu %6zu %10.4f %10.1f %9.1f\n", "ce lz", mode, threads, o.files, best,
+                       static_cast<double>(o.files) / best, mb_per_s(bytes, best));
+            }
+        }
+    }
+    remove_tree(root);
+    return ok;
+}
+
+static bool parse_threads(const char *arg, std::vector<size_t> &out) {
+    out.clear();
+    std::string s = arg;
+    size_t pos = 0;
+    while (pos <= s.size()) {
+        size_t comma = s.find(',', pos);
+        std::string item = s.substr(pos, comma == std::string::npos ? std::string::npos : comma - pos);
+        char *end;
+        unsigned long n = strtoul(item.c_str(), &end, 10);
+        if (item.empty() || *end != '\0' || n == 0) {
+            return false;
+        }
+        out.push_back(n);
+        if (comma == std::string::npos) {
+            break;
+        }
+        pos = comma + 1;
+    }
+    return !out.empty();
+}
+
+int main(int argc, char **argv) {
+    BenchOptions o;
+    static struct option long_options[] = {
+        {"size", required_argument, nullptr, 's'},
+        {"reps", required_argument, nullptr, 'r'},
+        {"files", required_argument, nullptr, 'n'},
+        {"threads", required_argument, nullptr, 't'},
+        {"codecs-only", no_argument, nullptr, 'C'},
+        {"e2e-only", no_argument, nullptr, 'E'},
+        {"csv", no_argument, nullptr, 'v'},
+        {"gsea", required_argument, nullptr, 'g'},
+        {0, 0, 0, 0}
+    };
+    int opt;
+    while ((opt = getopt_long(argc, argv, "s:r:n:t:CEvg:", long_options, nullptr)) != -1) {
+        switch (opt) {
+            case 's': o.size = strtoul(optarg, nullptr, 10) * 1024 * 1024; break;
+            case 'r': o.reps = atoi(optarg); break;
+            case 'n': o.files = strtoul(optarg, nullptr, 10); break;
+            case 't':
+                if (!parse_threads(optarg, o.threads)) {
+                    fprintf(stderr, "bench: --threads takes a list such as 1,2,4\n");
+                    return 1;
+                }
+                break;
+            case 'C': o.e2e = false; break;
+            case 'E': o.codecs = false; break;
+            case 'v': o.csv = true; break;
+            case 'g': o.gsea = optarg; break;
+            default:
+                fprintf(stderr, "usage: gsea_bench [--size MiB] [--reps N] [--files N] [--threads 1,2,4] "
+                                "[--codecs-only | --e2e-only] [--csv] [--gsea PATH]\n");
+                return 1;
+        }
+    }
+    if (o.size == 0 || o.reps <= 0 || o.files == 0) {
+        fprintf(stderr, "bench: --size, --reps and --files must be positive\n");
+        return 1;
+    }
+    if (o.threads.empty()) {
+        // Powers of two up to the number of CPUs, and the CPU count itself
+        size_t cpus = default_thread_count();
+        for (size_t t = 1; t < cpus; t *= 2) {
+            o.threads.push_back(t);
+        }
+        o.threads.push_back(cpus);
+    }
+
+    bool ok = true;
+    if (o.codecs) {
+        ok = run_codec_benchmarks(o) && ok;
+    }
+    if (o.e2e) {
+        ok = run_e2e_benchmarks(o) && ok;
+    }
+    return ok ? 0 : 1;
+}
@@ -165,6 +165,312 @@ else
 fi
 echo ""
 
+# PRUEBA 7b: Pool de hilos acotado (--threads)
+echo "=========================================="
+print_info "PRUEBA 7b: Directorio con más archivos que hilos (--threads 2)"
+mkdir -p tests/data/dir_pool
+for n in $(seq 1 20); do
+    echo "Archivo $n con contenido repetido AAAAAAAA" > tests/data/dir_pool/f$n.txt
+done
+run_test "Compresión con pool de 2 hilos" "./bin/gsea --compress --threads 2 --input tests/data/dir_pool/ --output tests/data/dir_pool_c/"
+run_test "Descompresión con pool de 2 hilos" "./bin/gsea --decompress --threads 2 --input tests/data/dir_pool_c/ --output tests/data/dir_pool_r/"
+run_test "Verificación pool (diff -r)" "diff -r tests/data/dir_pool tests/data/dir_pool_r"
+run_test "Rechazo de --threads inválido" "! ./bin/gsea --compress --threads 0 --input tests/data/test.txt --output tests/data/test_threads.rle 2>/dev/null"
+rm -rf tests/data/dir_pool tests/data/dir_pool_c tests/data/dir_pool_r tests/data/test_threads.rle
+echo ""
+
+# PRUEBA 7c: Archivo grande dividido en bloques paralelos
+echo "=========================================="
+print_info "PRUEBA 7c: Archivo grande procesado en bloques por varios hilos"
+yes "registro de log con espacios      y ceros 000000" | head -c 10000000 > tests/data/big.txt
+run_test "Compresión + Encriptación por bloques" "./bin/gsea --compress --encrypt --key 'clave' --threads 4 --input tests/data/big.txt --output tests/data/big.ce"
+run_test "Desencriptación + Descompresión por bloques" "./bin/gsea --decrypt --decompress --key 'clave' --threads 4 --input tests/data/big.ce --output tests/data/big_restored.txt"
+run_test "Verificación archivo grande (cmp)" "cmp tests/data/big.txt tests/data/big_restored.txt"
+run_test "Compresión Differential en streaming (varios bloques)" "./bin/gsea --compress --comp-alg diff --input tests/data/big.txt --output tests/data/big.diff"
+run_test "Descompresión Differential en streaming" "./bin/gsea --decompress --comp-alg diff --input tests/data/big.diff --output tests/data/big_restored_diff.txt"
+run_test "Verificación Differential en streaming (cmp)" "cmp tests/data/big.txt tests/data/big_restored_diff.txt"
+printf 'abc' > tests/data/odd.rle
+run_test "Datos inválidos no dejan salida parcial" "! ./bin/gsea --decompress --input tests/data/odd.rle --output tests/data/odd_out.txt 2>/dev/null && [ ! -e tests/data/odd_out.txt ] && [ ! -e tests/data/odd_out.txt.gsea-tmp ]"
+head -c 3000000 /dev/zero > tests/data/zeros.bin
+run_test "Compresión RLE de runs largas (ceros)" "./bin/gsea --compress --input tests/data/zeros.bin --output tests/data/zeros.rle"
+run_test "Descompresión RLE de runs largas" "./bin/gsea --decompress --input tests/data/zeros.rle --output tests/data/zeros_restored.bin"
+run_test "Verificación runs largas (cmp)" "cmp tests/data/zeros.bin tests/data/zeros_restored.bin"
+rm -f tests/data/zeros.bin tests/data/zeros.rle tests/data/zeros_restored.bin
+LONG_KEY=$(printf 'k%.0s' $(seq 1 700))
+run_test "Encriptación XOR con clave larga (vectorizada)" "./bin/gsea --encrypt --enc-alg xor --key '$LONG_KEY' --input tests/data/big.txt --output tests/data/big.xor"
+run_test "Desencriptación XOR con clave larga" "./bin/gsea --decrypt --enc-alg xor --key '$LONG_KEY' --input tests/data/big.xor --output tests/data/big_restored_xor.txt"
+run_test "Verificación XOR clave larga (cmp)" "cmp tests/data/big.txt tests/data/big_restored_xor.txt"
+rm -f tests/data/big.xor tests/data/big_restored_xor.txt
+rm -f tests/data/big.txt tests/data/big.ce tests/data/big_restored.txt tests/data/big.diff tests/data/big_restored_diff.txt tests/data/odd.rle
+echo ""
+
+# PRUEBA 7d: Backends de E/S (mmap, read e io_uring)
+echo "=========================================="
+print_info "PRUEBA 7d: E/S con mmap (por defecto), read() e io_uring"
+run_test "Compresión + Encriptación con --io-mode read" "./bin/gsea --compress --encrypt --key 'clave' --io-mode read --input tests/data/test.txt --output tests/data/test_io.ce"
+run_test "Desencriptación + Descompresión con --io-mode mmap" "./bin/gsea --decrypt --decompress --key 'clave' --io-mode mmap --input tests/data/test_io.ce --output tests/data/test_io.txt"
+run_test "Verificación backends de lectura (diff)" "diff tests/data/test.txt tests/data/test_io.txt"
+mkdir -p tests/data/dir_uring
+for n in $(seq 1 40); do
+    echo "Archivo pequeño $n BBBBBBBB" > tests/data/dir_uring/f$n.txt
+done
+: > tests/data/dir_uring/vacio.txt
+run_test "Compresión + Encriptación de directorio con --io-mode uring" "./bin/gsea --compress --encrypt --key 'clave' --io-mode uring --threads 3 --input tests/data/dir_uring/ --output tests/data/dir_uring_c/"
+run_test "Desencriptación + Descompresión con --io-mode uring" "./bin/gsea --decrypt --decompress --key 'clave' --io-mode uring --input tests/data/dir_uring_c/ --output tests/data/dir_uring_r/"
+run_test "Verificación io_uring (diff -r)" "diff -r tests/data/dir_uring tests/data/dir_uring_r"
+rm -rf tests/data/dir_uring tests/data/dir_uring_c tests/data/dir_uring_r
+run_test "Rechazo de --io-mode desconocido" "! ./bin/gsea --compress --io-mode foo --input tests/data/test.txt --output tests/data/test_io.rle 2>/dev/null"
+rm -f tests/data/test_io.ce tests/data/test_io.txt tests/data/test_io.rle
+echo ""
+
+# PRUEBA 7e: RLE2 (nunca expande datos incompresibles)
+echo "=========================================="
+print_info "PRUEBA 7e: RLE2 con datos aleatorios y de texto"
+head -c 3000000 /dev/urandom > tests/data/random.bin
+run_test "Compresión RLE2 de datos aleatorios" "./bin/gsea --compress --comp-alg rle2 --input tests/data/random.bin --output tests/data/random.rle2"
+run_test "RLE2 no expande datos aleatorios (9 bytes por bloque + cabecera)" "[ \$(stat -c%s tests/data/random.rle2) -le \$((3000000 + 9 * 3 + 128)) ]"
+run_test "Descompresión RLE2 de datos aleatorios" "./bin/gsea --decompress --comp-alg rle2 --input tests/data/random.rle2 --output tests/data/random_restored.bin"
+run_test "Verificación RLE2 aleatorio (cmp)" "cmp tests/data/random.bin tests/data/random_restored.bin"
+run_test "Compresión RLE2 + Encriptación XOR" "./bin/gsea --compress --encrypt --comp-alg rle2 --enc-alg xor --key 'clave' --input tests/data/test.txt --output tests/data/test_rle2.ce"
+run_test "Desencriptación + Descompresión RLE2" "./bin/gsea --decrypt --decompress --comp-alg rle2 --enc-alg xor --key 'clave' --input tests/data/test_rle2.ce --output tests/data/test_rle2.txt"
+run_test "Verificación RLE2 + XOR (diff)" "diff tests/data/test.txt tests/data/test_rle2.txt"
+head -c 1000 tests/data/random.rle2 > tests/data/trunc.rle2
+run_test "RLE2 truncado se rechaza" "! ./bin/gsea --decompress --comp-alg rle2 --input tests/data/trunc.rle2 --output tests/data/trunc_out.bin 2>/dev/null && [ ! -e tests/data/trunc_out.bin ]"
+rm -f tests/data/random.bin tests/data/random.rle2 tests/data/random_restored.bin tests/data/trunc.rle2
+rm -f tests/data/test_rle2.ce tests/data/test_rle2.txt
+echo ""
+
+# PRUEBA 7f: Differential sin pérdidas y encadenado con RLE
+echo "=========================================="
+print_info "PRUEBA 7f: Differential exacto (módulo 256) y cadenas diff+rle"
+head -c 2000000 /dev/urandom > tests/data/random.bin
+run_test "Compresión Differential de datos aleatorios" "./bin/gsea --compress --comp-alg diff --input tests/data/random.bin --output tests/data/random.diff"
+run_test "Descompresión Differential de datos aleatorios" "./bin/gsea --decompress --comp-alg diff --input tests/data/random.diff --output tests/data/random_restored.bin"
+run_test "Verificación Differential aleatorio (cmp)" "cmp tests/data/random.bin tests/data/random_restored.bin"
+for n in $(seq 0 40000); do printf '%04d\n' $((n % 10000)); done > tests/data/sensor.txt
+run_test "Compresión diff+rle2 de datos de sensor" "./bin/gsea --compress --comp-alg diff+rle2 --input tests/data/sensor.txt --output tests/data/sensor.dr"
+run_test "Descompresión diff+rle2" "./bin/gsea --decompress --comp-alg diff+rle2 --input tests/data/sensor.dr --output tests/data/sensor_restored.txt"
+run_test "Verificación diff+rle2 (cmp)" "cmp tests/data/sensor.txt tests/data/sensor_restored.txt"
+run_test "Compresión diff+rle + Encriptación" "./bin/gsea --compress --encrypt --comp-alg diff+rle --key 'clave' --input tests/data/sensor.txt --output tests/data/sensor.ce"
+run_test "Desencriptación + Descompresión diff+rle" "./bin/gsea --decrypt --decompress --comp-alg diff+rle --key 'clave' --input tests/data/sensor.ce --output tests/data/sensor_restored2.txt"
+run_test "Verificación diff+rle (cmp)" "cmp tests/data/sensor.txt tests/data/sensor_restored2.txt"
+run_test "Rechazo de cadena no soportada (rle+diff)" "! ./bin/gsea --compress --comp-alg rle+diff --input tests/data/sensor.txt --output tests/data/sensor.bad 2>/dev/null"
+rm -f tests/data/random.bin tests/data/random.diff tests/data/random_restored.bin
+rm -f tests/data/sensor.txt tests/data/sensor.dr tests/data/sensor_restored.txt tests/data/sensor.ce tests/data/sensor_restored2.txt tests/data/sensor.bad
+echo ""
+
+# PRUEBA 7g: Contenedor autodescriptivo (cabecera, índice y CRC32C)
+echo "=========================================="
+print_info "PRUEBA 7g: Cabecera con algoritmos, índice de bloques y checksums"
+yes "lectura 0012 0013 0014 0015" | head -c 3000000 > tests/data/cont.txt
+run_test "Compresión RLE2 + Encriptación XOR con contenedor" "./bin/gsea --compress --encrypt --comp-alg rle2 --enc-alg xor --key 'clave' --input tests/data/cont.txt --output tests/data/cont.gsea"
+run_test "Descompresión sin --comp-alg ni --enc-alg" "./bin/gsea --decrypt --decompress --key 'clave' --input tests/data/cont.gsea --output tests/data/cont_restored.txt"
+run_test "Verificación contenedor (cmp)" "cmp tests/data/cont.txt tests/data/cont_restored.txt"
+run_test "Clave incorrecta detectada por checksum" "! ./bin/gsea --decrypt --decompress --key 'otra' --input tests/data/cont.gsea --output tests/data/cont_bad.txt 2>/dev/null && [ ! -e tests/data/cont_bad.txt ]"
+cp tests/data/cont.gsea tests/data/cont_corrupt.gsea
+printf 'X' | dd of=tests/data/cont_corrupt.gsea bs=1 seek=2000 conv=notrunc 2>/dev/null
+run_test "Bloque dañado detectado por checksum" "! ./bin/gsea --decrypt --decompress --key 'clave' --input tests/data/cont_corrupt.gsea --output tests/data/cont_bad.txt 2>/dev/null && [ ! -e tests/data/cont_bad.txt ]"
+head -c 5000 tests/data/cont.gsea > tests/data/cont_trunc.gsea
+run_test "Contenedor truncado se rechaza" "! ./bin/gsea --decrypt --decompress --key 'clave' --input tests/data/cont_trunc.gsea --output tests/data/cont_bad.txt 2>/dev/null"
+rm -f tests/data/cont.txt tests/data/cont.gsea tests/data/cont_restored.txt tests/data/cont_corrupt.gsea tests/data/cont_trunc.gsea tests/data/cont_bad.txt
+echo ""
+
+# PRUEBA 7h: Compresor de diccionario LZ77 (lz rápido, lzhc alta razón)
+echo "=========================================="
+print_info "PRUEBA 7h: Compresión LZ77 (lz, lzhc, --lz-window)"
+for n in $(seq 1 3000); do echo "2026-01-01 10:00:$((n % 60)) [INFO] worker-$((n % 7)): request $n processed in $((n % 97))ms"; done > tests/data/log.txt
+run_test "Compresión lz" "./bin/gsea --compress --comp-alg lz --input tests/data/log.txt --output tests/data/log.lz"
+run_test "Descompresión lz" "./bin/gsea --decompress --input tests/data/log.lz --output tests/data/log_lz.txt"
+run_test "Verificación lz (cmp)" "cmp tests/data/log.txt tests/data/log_lz.txt"
+run_test "Compresión lzhc + Encriptación con ventana de 4 KiB" "./bin/gsea --compress --encrypt --comp-alg lzhc --lz-window 4096 --key 'clave' --input tests/data/log.txt --output tests/data/log.lzhc"
+run_test "Desencriptación + Descompresión lzhc" "./bin/gsea --decrypt --decompress --key 'clave' --input tests/data/log.lzhc --output tests/data/log_lzhc.txt"
+run_test "Verificación lzhc (cmp)" "cmp tests/data/log.txt tests/data/log_lzhc.txt"
+run_test "lz reduce el log a menos de la mitad" "[ \$(stat -c%s tests/data/log.lz) -lt \$((\$(stat -c%s tests/data/log.txt) / 2)) ]"
+run_test "lzhc comprime al menos tanto como lz" "[ \$(stat -c%s tests/data/log.lzhc) -le \$(stat -c%s tests/data/log.lz) ]"
+run_test "Rechazo de --lz-window que no es potencia de dos" "! ./bin/gsea --compress --comp-alg lz --lz-window 3000 --input tests/data/log.txt --output tests/data/log.bad 2>/dev/null"
+rm -f tests/data/log.txt tests/data/log.lz tests/data/log_lz.txt tests/data/log.lzhc tests/data/log_lzhc.txt tests/data/log.bad
+echo ""
+
+# PRUEBA 7i: Etapa de entropía Huffman y cadenas de tres etapas
+echo "=========================================="
+print_info "PRUEBA 7i: Compresión Huffman (huff, diff+huff, lz+huff)"
+python3 -c "import sys; sys.stdout.buffer.write(bytes(int(128 + 60 * ((i * 7919) % 1000) / 1000.0 * ((-1) ** (i // 500))) & 255 for i in range(200000)))" > tests/data/ramp.bin
+for n in $(seq 1 3000); do echo "2026-01-01 10:00:$((n % 60)) [INFO] worker-$((n % 7)): request $n processed in $((n % 97))ms"; done > tests/data/log.txt
+run_test "Compresión huff" "./bin/gsea --compress --comp-alg huff --input tests/data/log.txt --output tests/data/log.huff"
+run_test "Descompresión huff" "./bin/gsea --decompress --input tests/data/log.huff --output tests/data/log_huff.txt"
+run_test "Verificación huff (cmp)" "cmp tests/data/log.txt tests/data/log_huff.txt"
+run_test "Compresión lz+huff + Encriptación" "./bin/gsea --compress --encrypt --comp-alg lz+huff --key 'clave' --input tests/data/log.txt --output tests/data/log.lzh"
+run_test "Desencriptación + Descompresión lz+huff" "./bin/gsea --decrypt --decompress --key 'clave' --input tests/data/log.lzh --output tests/data/log_lzh.txt"
+run_test "Verificación lz+huff (cmp)" "cmp tests/data/log.txt tests/data/log_lzh.txt"
+run_test "Compresión diff+lz+huff" "./bin/gsea --compress --comp-alg diff+lz+huff --input tests/data/ramp.bin --output tests/data/ramp.dlh"
+run_test "Descompresión diff+lz+huff" "./bin/gsea --decompress --input tests/data/ramp.dlh --output tests/data/ramp_dlh.bin"
+run_test "Verificación diff+lz+huff (cmp)" "cmp tests/data/ramp.bin tests/data/ramp_dlh.bin"
+run_test "huff reduce el log" "[ \$(stat -c%s tests/data/log.huff) -lt \$(stat -c%s tests/data/log.txt) ]"
+run_test "lz+huff comprime más que lz solo" "./bin/gsea --compress --comp-alg lz --input tests/data/log.txt --output tests/data/log.lz && [ \$(stat -c%s tests/data/log.lzh) -lt \$(stat -c%s tests/data/log.lz) ]"
+run_test "Rechazo de huff antes de otra etapa" "! ./bin/gsea --compress --comp-alg huff+lz --input tests/data/log.txt --output tests/data/log.bad 2>/dev/null"
+rm -f tests/data/ramp.bin tests/data/ramp.dlh tests/data/ramp_dlh.bin tests/data/log.txt tests/data/log.huff tests/data/log_huff.txt tests/data/log.lzh tests/data/log_lzh.txt tests/data/log.lz tests/data/log.bad
+echo ""
+
+# PRUEBA 7j: Registro de algoritmos resuelto al parsear la línea de comandos
+echo "=========================================="
+print_info "PRUEBA 7j: Registro de algoritmos"
+run_test "Nombres de algoritmo sin distinguir mayúsculas" "./bin/gsea --compress --encrypt --comp-alg LZ+Huff --enc-alg XOR --key 'clave' --input tests/data/test.txt --output tests/data/test.reg && ./bin/gsea --decompress --decrypt --key 'clave' --input tests/data/test.reg --output tests/data/test_reg.txt && cmp tests/data/test.txt tests/data/test_reg.txt"
+run_test "Algoritmo desconocido rechazado antes de procesar archivos" "! ./bin/gsea --compress --comp-alg lz+rle --input tests/data --output tests/data/reg_out 2>&1 | grep -q 'Found'"
+run_test "Cifrado desconocido rechazado" "! ./bin/gsea --encrypt --enc-alg aes --key 'clave' --input tests/data/test.txt --output tests/data/test.bad 2>/dev/null"
+rm -rf tests/data/test.reg tests/data/test_reg.txt tests/data/test.bad tests/data/reg_out
+echo ""
+
+# PRUEBA 7k: Selección automática del algoritmo por archivo
+echo "=========================================="
+print_info "PRUEBA 7k: Compresión automática (auto)"
+mkdir -p tests/data/mixto
+head -c 300000 /dev/urandom > tests/data/mixto/foto.jpg
+for n in $(seq 1 3000); do echo "2026-01-01 10:00:$((n % 60)) [INFO] worker-$((n % 7)): request $n processed in $((n % 97))ms"; done > tests/data/mixto/log.txt
+run_test "Compresión auto de un directorio mixto" "./bin/gsea --compress --comp-alg auto --input tests/data/mixto --output tests/data/mixto_auto/"
+run_test "Descompresión sin indicar el algoritmo elegido" "./bin/gsea --decompress --input tests/data/mixto_auto --output tests/data/mixto_rest/"
+run_test "Verificación auto (cmp)" "cmp tests/data/mixto/foto.jpg tests/data/mixto_rest/foto.jpg && cmp tests/data/mixto/log.txt tests/data/mixto_rest/log.txt"
+run_test "auto no expande datos aleatorios" "[ \$(stat -c%s tests/data/mixto_auto/foto.jpg) -le \$((300000 + 128)) ]"
+run_test "auto comprime el log a menos de la mitad" "[ \$(stat -c%s tests/data/mixto_auto/log.txt) -lt \$((\$(stat -c%s tests/data/mixto/log.txt) / 2)) ]"
+run_test "auto rechaza entradas sin cabecera al descomprimir" "! ./bin/gsea --decompress --comp-alg auto --input tests/data/mixto/log.txt --output tests/data/mixto_bad 2>/dev/null"
+rm -rf tests/data/mixto tests/data/mixto_auto tests/data/mixto_rest tests/data/mixto_bad
+echo ""
+
+# PRUEBA 7l: Transformaciones en el lugar con read() y io_uring
+echo "=========================================="
+print_info "PRUEBA 7l: Búferes reutilizados y cifrado en el lugar"
+mkdir -p tests/data/lugar
+head -c 2500000 /dev/urandom > tests/data/lugar/a.bin
+for n in $(seq 1 40000); do echo "linea $n: texto repetido para comprimir"; done > tests/data/lugar/b.txt
+run_test "Encriptación en el lugar (read, varios bloques)" "./bin/gsea --encrypt --key k3y --io-mode read --input tests/data/lugar --output tests/data/lugar_enc/"
+run_test "Desencriptación en el lugar (read)" "./bin/gsea --decrypt --key k3y --io-mode read --input tests/data/lugar_enc --output tests/data/lugar_dec/"
+run_test "Verificación en el lugar (cmp)" "cmp tests/data/lugar/a.bin tests/data/lugar_dec/a.bin && cmp tests/data/lugar/b.txt tests/data/lugar_dec/b.txt"
+run_test "Comprimir y encriptar con io_uring" "./bin/gsea -ce --comp-alg lz+huff --enc-alg xor --key k3y --io-mode uring --input tests/data/lugar --output tests/data/lugar_ce/"
+run_test "Desencriptar y descomprimir con read" "./bin/gsea -dr --key k3y --io-mode read --input tests/data/lugar_ce --output tests/data/lugar_dr/"
+run_test "Verificación -ce/-dr (cmp)" "cmp tests/data/lugar/a.bin tests/data/lugar_dr/a.bin && cmp tests/data/lugar/b.txt tests/data/lugar_dr/b.txt"
+run_test "Pool de búferes reutilizado entre archivos" "./bin/gsea -ce --comp-alg lz+huff --key k3y --threads 1 --input tests/data/lugar --output tests/data/lugar_pool/ 2>&1 | grep -Eq 'Buffer pool: [0-9]+ buffer\\(s\\) served, [1-9][0-9]* reused'"
+rm -rf tests/data/lugar tests/data/lugar_enc tests/data/lugar_dec tests/data/lugar_ce tests/data/lugar_dr tests/data/lugar_pool
+echo ""
+
+# PRUEBA 7m: Recorrido paralelo de directorios
+echo "=========================================="
+print_info "PRUEBA 7m: Recorrido paralelo de directorios"
+for a in 1 2 3 4; do for b in 1 2 3; do mkdir -p tests/data/arbol/d$a/e$b; echo "contenido $a $b" > tests/data/arbol/d$a/e$b/f$a$b.txt; done; done
+echo "raiz" > tests/data/arbol/raiz.txt
+ln -s raiz.txt tests/data/arbol/enlace.txt
+mkfifo tests/data/arbol/tuberia
+run_test "Recorrido encuentra archivos en todos los niveles" "./bin/gsea --encrypt --key k3y --threads 4 --input tests/data/arbol --output tests/data/arbol_enc/ 2>&1 | grep -q 'Found 14 file(s)'"
+run_test "Archivo de un subdirectorio profundo procesado" "./bin/gsea --decrypt --key k3y --input tests/data/arbol_enc/f43.txt --output tests/data/arbol_f43.txt && cmp tests/data/arbol/d4/e3/f43.txt tests/data/arbol_f43.txt"
+mkdir -p tests/data/arbol_uno/sub
+cp tests/data/arbol/raiz.txt tests/data/arbol_uno/sub/
+run_test "Directorio con un solo archivo escribe en la ruta de salida" "./bin/gsea --encrypt --key k3y --input tests/data/arbol_uno --output tests/data/arbol_uno.enc && [ -f tests/data/arbol_uno.enc ]"
+mkdir -p tests/data/solape
+for i in 1 2 3; do seq 1 $((i * 500)) > tests/data/solape/f$i.txt; done
+echo "resto" > tests/data/solape/viejo.gsea-tmp
+run_test "Salida dentro de la entrada no se recorre" "./bin/gsea --encrypt --key k3y --input tests/data/solape --output tests/data/solape/enc/ > /dev/null 2>&1 && ./bin/gsea --encrypt --key k3y --input tests/data/solape --output tests/data/solape/enc/ 2>&1 | grep -q 'Found 3 file(s)'"
+rm -rf tests/data/solape/enc
+run_test "Salida igual a la entrada ignora temporales" "./bin/gsea --compress --comp-alg rle --threads 4 --input tests/data/solape --output tests/data/solape 2>&1 | grep -q '3 file(s) processed successfully, 0 file(s) failed'"
+rm -rf tests/data/arbol tests/data/arbol_enc tests/data/arbol_f43.txt tests/data/arbol_uno tests/data/arbol_uno.enc tests/data/solape
+echo ""
+
+# PRUEBA 7n: Modo incremental
+echo "=========================================="
+print_info "PRUEBA 7n: Modo incremental"
+mkdir -p tests/data/incr
+for i in 1 2 3; do seq 1 $((i * 4000)) > tests/data/incr/f$i.txt; done
+run_test "Primera ejecución incremental procesa todo" "./bin/gsea -ce --comp-alg lz --key k3y --incremental --input tests/data/incr --output tests/data/incr_out/ 2>&1 | grep -q '3 file(s) processed successfully'"
+run_test "Segunda ejecución omite archivos sin cambios" "./bin/gsea -ce --comp-alg lz --key k3y --incremental --input tests/data/incr --output tests/data/incr_out/ 2>&1 | grep -q '3 unchanged file(s) skipped'"
+touch tests/data/incr/f1.txt
+echo "cambio" >> tests/data/incr/f2.txt
+run_test "Se reprocesan los archivos modificados" "./bin/gsea -ce --comp-alg lz --key k3y --incremental --input tests/data/incr --output tests/data/incr_out/ 2>&1 | grep -q '1 unchanged file(s) skipped'"
+touch tests/data/incr/f1.txt
+run_test "Un touch se resuelve por hash sin reprocesar" "./bin/gsea -ce --comp-alg lz --key k3y --incremental --input tests/data/incr --output tests/data/incr_out/ 2>&1 | grep -q '3 unchanged file(s) skipped'"
+run_test "Manifiesto que no se puede escribir falla la ejecución" "! ./bin/gsea -ce --comp-alg lz --key k3y --incremental --manifest tests/data/no_existe/m --input tests/data/incr --output tests/data/incr_out/ > /dev/null 2>&1"
+run_test "Salida reprocesada correcta" "./bin/gsea -dr --comp-alg lz --key k3y --input tests/data/incr_out/f2.txt --output tests/data/incr_f2.txt && cmp tests/data/incr/f2.txt tests/data/incr_f2.txt"
+run_test "Otra clave invalida el manifiesto" "./bin/gsea -ce --comp-alg lz --key otra --incremental --input tests/data/incr --output tests/data/incr_out/ 2>&1 | grep -q '0 unchanged file(s) skipped'"
+run_test "El manifiesto guarda una etiqueta con sal, no un hash de la clave" "head -n 1 tests/data/incr_out.gsea-manifest | grep -qE ' [0-9a-f]{16}\\.[0-9a-f]{16}\$'"
+./bin/gsea -c --comp-alg lz --key k3y --incremental --manifest tests/data/incr_c.gsea-manifest --input tests/data/incr --output tests/data/incr_c/ > /dev/null 2>&1
+run_test "Sin cifrado la clave no invalida el manifiesto" "./bin/gsea -c --comp-alg lz --key otra --incremental --manifest tests/data/incr_c.gsea-manifest --input tests/data/incr --output tests/data/incr_c/ 2>&1 | grep -q '3 unchanged file(s) skipped'"
+rm -rf tests/data/incr tests/data/incr_out tests/data/incr_out.gsea-manifest tests/data/incr_f2.txt tests/data/incr_c tests/data/incr_c.gsea-manifest
+echo ""
+
+# PRUEBA 7o: Deduplicación por contenido
+echo "=========================================="
+print_info "PRUEBA 7o: Deduplicación por contenido"
+mkdir -p tests/data/dedup/a tests/data/dedup/b
+seq 1 60000 > tests/data/dedup/a/base.txt
+cp tests/data/dedup/a/base.txt tests/data/dedup/b/copia.txt
+{ seq 1 30000; echo "insertado"; seq 30001 60000; } > tests/data/dedup/b/editado.txt
+run_test "Dedup guarda una sola vez los fragmentos repetidos" "./bin/gsea -ce --comp-alg lz --key k3y --dedup --input tests/data/dedup --output tests/data/dedup_out/ 2>&1 | grep -q 'Dedup: .* [1-9][0-9]* duplicate'"
+run_test "Salidas deduplicadas son solo referencias" "[ \$(stat -c %s tests/data/dedup_out/copia.txt) -lt 4096 ] && [ -f tests/data/dedup_out.gsea-chunks ]"
+run_test "Dedup + restauración ida y vuelta" "./bin/gsea -dr --key k3y --input tests/data/dedup_out --output tests/data/dedup_back/ && cmp tests/data/dedup/b/editado.txt tests/data/dedup_back/editado.txt && cmp tests/data/dedup/a/base.txt tests/data/dedup_back/copia.txt"
+run_test "Segunda ejecución no agrega fragmentos" "./bin/gsea -ce --comp-alg lz --key k3y --dedup --input tests/data/dedup --output tests/data/dedup_out/ 2>&1 | grep -q 'Dedup: 0 chunk(s) added'"
+run_test "Almacén con otra clave rechazado" "! ./bin/gsea -ce --comp-alg lz --key otra --dedup --input tests/data/dedup --output tests/data/dedup_out/ > /dev/null 2>&1"
+run_test "El almacén guarda una etiqueta con sal, no un hash de la clave" "head -c 100 tests/data/dedup_out.gsea-chunks | grep -aqE 'ce:lz:vigenere [0-9a-f]{16}\\.[0-9a-f]{16}'"
+run_test "Almacén en uso por otra ejecución rechazado" "flock tests/data/dedup_out.gsea-chunks sh -c './bin/gsea -ce --comp-alg lz --key k3y --dedup --input tests/data/dedup --output tests/data/dedup_out/ 2>&1 | grep -q \"in use by another run\"'"
+# Un fragmento a medio escribir deja un hueco antes de registros completos
+dd if=/dev/zero of=tests/data/dedup_out.gsea-chunks bs=1 seek=$((22 + $(od -An -tu2 -j8 -N2 tests/data/dedup_out.gsea-chunks))) count=32 conv=notrunc 2>/dev/null
+run_test "Hueco en el almacén se salta sin perder los fragmentos siguientes" "./bin/gsea -ce --comp-alg lz --key k3y --dedup --input tests/data/dedup --output tests/data/dedup_out/ 2>&1 | grep -q 'Dedup: 1 chunk(s) added'"
+run_test "Restauración tras recuperar el almacén" "./bin/gsea -dr --key k3y --input tests/data/dedup_out --output tests/data/dedup_back2/ && cmp tests/data/dedup/b/editado.txt tests/data/dedup_back2/editado.txt && cmp tests/data/dedup/a/base.txt tests/data/dedup_back2/base.txt"
+./bin/gsea -ce --comp-alg lz --key k3y --dedup --incremental --input tests/data/dedup --output tests/data/dedup_inc/ > /dev/null 2>&1
+rm -f tests/data/dedup_inc.gsea-chunks
+run_test "Almacén recreado invalida el manifiesto incremental" "./bin/gsea -ce --comp-alg lz --key k3y --dedup --incremental --input tests/data/dedup --output tests/data/dedup_inc/ 2>&1 | grep -q '0 unchanged file(s) skipped' && ./bin/gsea -dr --key k3y --input tests/data/dedup_inc --output tests/data/dedup_inc_back/ && cmp tests/data/dedup/a/base.txt tests/data/dedup_inc_back/base.txt"
+rm -rf tests/data/dedup tests/data/dedup_out tests/data/dedup_out.gsea-chunks tests/data/dedup_back tests/data/dedup_back2
+rm -rf tests/data/dedup_inc tests/data/dedup_inc.gsea-chunks tests/data/dedup_inc.gsea-manifest tests/data/dedup_inc_back
+echo ""
+
+# PRUEBA 7p: Métricas por etapa (--stats)
+echo "=========================================="
+print_info "PRUEBA 7p: Métricas por etapa (--stats)"
+mkdir -p tests/data/stats
+seq 1 40000 > tests/data/stats/a.txt
+head -c 200000 /dev/urandom > tests/data/stats/b.bin
+run_test "Reporte JSON con una entrada por archivo y totales" "./bin/gsea -c --comp-alg lz --input tests/data/stats --output tests/data/stats_out/ --stats tests/data/stats.json > /dev/null 2>&1 && [ \$(grep -c '\"input\":' tests/data/stats.json) -eq 2 ] && grep -q '\"total\": {\"status\": \"ok\", \"files\": 2' tests/data/stats.json && grep -q '\"peak_buffer_bytes_total\"' tests/data/stats.json"
+run_test "Reporte JSON mide compresión y llamadas al sistema" "grep -q '\"compress\": {\"wall_ns\": [1-9]' tests/data/stats.json && grep -q '\"open\": [1-9]' tests/data/stats.json"
+run_test "Reporte CSV por extensión: cabecera, filas por archivo y total" "./bin/gsea -d --input tests/data/stats_out --output tests/data/stats_back/ --stats tests/data/stats.csv > /dev/null 2>&1 && head -1 tests/data/stats.csv | grep -q '^kind,input,output,status,bytes_in' && [ \$(grep -c '^file,' tests/data/stats.csv) -eq 2 ] && tail -1 tests/data/stats.csv | grep -q '^total,,,ok,' && cmp tests/data/stats/a.txt tests/data/stats_back/a.txt"
+run_test "Bytes de entrada medidos antes de reemplazarla" "cp tests/data/stats/a.txt tests/data/stats/c.txt && ./bin/gsea -c --comp-alg lz --input tests/data/stats/c.txt --output tests/data/stats/c.txt --stats tests/data/stats_c.json > /dev/null 2>&1 && grep -q \"\\\"bytes_in\\\": \$(stat -c %s tests/data/stats/a.txt),\" tests/data/stats_c.json"
+run_test "Ruta de reporte inválida rechazada" "! ./bin/gsea -c --input tests/data/stats --output tests/data/stats_out/ --stats tests/data/no_existe/s.json > /dev/null 2>&1"
+rm -rf tests/data/stats tests/data/stats_out tests/data/stats_back tests/data/stats.json tests/data/stats.csv tests/data/stats_c.json
+echo ""
+
+# PRUEBA 7q: Niveles de log y logging asíncrono
+echo "=========================================="
+print_info "PRUEBA 7q: Niveles de log y logging asíncrono"
+mkdir -p tests/data/logs
+for i in $(seq 1 300); do echo "archivo $i" > tests/data/logs/f$i.txt; done
+run_test "Cada archivo registra su línea completa con varios hilos" "./bin/gsea -c --comp-alg lz --threads 8 --input tests/data/logs --output tests/data/logs_out/ > tests/data/logs.txt 2>&1 && [ \$(grep -c \"Successfully processed and written to 'tests/data/logs_out/f[0-9]*.txt'\$\" tests/data/logs.txt) -eq 300 ] && ! grep -qv '^\\[\\(INFO\\|ERROR\\)\\] ' tests/data/logs.txt"
+run_test "El resumen sale después de los archivos" "tail -2 tests/data/logs.txt | head -1 | grep -q 'Processing complete: 300 file(s)'"
+run_test "--log-level error silencia los mensajes INFO" "[ -z \"\$(./bin/gsea -c --comp-alg lz --log-level error --input tests/data/logs --output tests/data/logs_out/ 2>&1)\" ]"
+run_test "--log-level debug muestra el inicio de cada archivo" "[ \$(./bin/gsea -c --comp-alg lz -L debug --input tests/data/logs --output tests/data/logs_out/ 2>&1 | grep -c '^\\[DEBUG\\] Worker starting') -eq 300 ]"
+run_test "Nivel de log desconocido rechazado" "! ./bin/gsea -c --log-level verbose --input tests/data/logs --output tests/data/logs_out/ > /dev/null 2>&1"
+rm -rf tests/data/logs tests/data/logs_out tests/data/logs.txt
+echo ""
+
+# PRUEBA 7r: Decodificación paralela de un archivo grande
+echo "=========================================="
+print_info "PRUEBA 7r: Decodificación paralela de un archivo grande"
+mkdir -p tests/data/pdec
+seq 1 3000000 > tests/data/pdec/grande.txt
+./bin/gsea -ce --comp-alg lz --key k3y --threads 4 --input tests/data/pdec/grande.txt --output tests/data/pdec/grande.gsea > /dev/null 2>&1
+run_test "Contenedor grande se decodifica en tareas paralelas" "./bin/gsea -dr --key k3y --threads 4 --input tests/data/pdec/grande.gsea --output tests/data/pdec/mmap.txt 2>&1 | grep -q 'parallel tasks' && cmp tests/data/pdec/grande.txt tests/data/pdec/mmap.txt"
+run_test "Decodificación paralela con --io-mode read" "./bin/gsea -dr --key k3y --threads 4 --io-mode read --input tests/data/pdec/grande.gsea --output tests/data/pdec/read.txt > /dev/null 2>&1 && cmp tests/data/pdec/grande.txt tests/data/pdec/read.txt"
+run_test "Un bloque dañado hace fallar la decodificación sin dejar salida" "cp tests/data/pdec/grande.gsea tests/data/pdec/danado.gsea && printf 'X' | dd of=tests/data/pdec/danado.gsea bs=1 seek=3000000 conv=notrunc 2>/dev/null && ! ./bin/gsea -dr --key k3y --threads 4 --input tests/data/pdec/danado.gsea --output tests/data/pdec/danado.txt > /dev/null 2>&1 && [ ! -e tests/data/pdec/danado.txt ]"
+rm -rf tests/data/pdec
+echo ""
+
+# PRUEBA 7s: Extracción parcial por rango de bytes
+echo "=========================================="
+print_info "PRUEBA 7s: Extracción parcial por rango de bytes"
+mkdir -p tests/data/rango
+seq 1 2000000 > tests/data/rango/log.txt
+./bin/gsea -ce --comp-alg lz --key k3y --threads 4 --input tests/data/rango/log.txt --output tests/data/rango/log.gsea > /dev/null 2>&1
+run_test "Rango en medio del archivo decodifica solo sus bloques" "./bin/gsea -dr --key k3y --range 5000000:1048576 --input tests/data/rango/log.gsea --output tests/data/rango/parte.txt 2>&1 | grep -q 'Extracted 1048576 bytes at offset 5000000 (1 of' && tail -c +5000001 tests/data/rango/log.txt | head -c 1048576 | cmp - tests/data/rango/parte.txt"
+run_test "Rango que cruza bloques y pasa del final se recorta" "./bin/gsea -dr --key k3y --io-mode read --range 4194000:99999999 --input tests/data/rango/log.gsea --output tests/data/rango/cola.txt > /dev/null 2>&1 && tail -c +4194001 tests/data/rango/log.txt | cmp - tests/data/rango/cola.txt"
+run_test "Rango más allá del final rechazado" "! ./bin/gsea -dr --key k3y --range 99999999:10 --input tests/data/rango/log.gsea --output tests/data/rango/nada.txt > /dev/null 2>&1"
+run_test "Rango con formato inválido rechazado" "! ./bin/gsea -dr --key k3y --range 10-20 --input tests/data/rango/log.gsea --output tests/data/rango/nada.txt > /dev/null 2>&1"
+run_test "Rango de longitud cero rechazado" "./bin/gsea -dr --key k3y --range 10:0 --input tests/data/rango/log.gsea --output tests/data/rango/nada.txt 2>&1 | grep -q 'requires OFFSET:LEN' && [ ! -e tests/data/rango/nada.txt ]"
+rm -rf tests/data/rango
+echo ""
+
 # PRUEBA 8: Validación de errores
 echo "=========================================="
 print_info "PRUEBA 8: Validación de errores"